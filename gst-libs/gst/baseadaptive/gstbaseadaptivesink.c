@@ -40,6 +40,8 @@
 
 #include <gst/video/video.h>
 #include <gst/app/gstappsrc.h>
+#include <string.h>
+
 #include "gstbaseadaptivesink.h"
 #include "gstadaptive-marshal.h"
 
@@ -72,9 +74,15 @@ enum
   PROP_IS_LIVE,
   PROP_MAX_WINDOW,
   PROP_FRAGMENT_DURATION,
+  PROP_MAX_PENDING_WRITES,
+  PROP_PENDING_WRITES,
+  PROP_BYTES_WRITTEN,
+  PROP_WRITE_STALLS,
   PROP_LAST
 };
 
+#define DEFAULT_MAX_PENDING_WRITES 8
+
 typedef struct
 {
   GstPad *pad;
@@ -85,7 +93,6 @@ typedef struct
   GstClockTime new_fragment_ts;
   GstBuffer *fragment;
   GstBuffer *last_fragment;
-  GCancellable *cancellable;
   guint count;
 
   GMutex *lock;
@@ -95,6 +102,16 @@ typedef struct
   GstBuffer *streamheaders;
 } GstBaseAdaptivePadData;
 
+/* A file written by the I/O thread */
+typedef struct
+{
+  gchar *filename;              /* NULL if there is nothing to write */
+  GstBuffer *buffer;
+  gboolean append;
+  gboolean is_playlist;         /* Replaced atomically and announced */
+  GList *old_files;             /* GFiles to delete once written */
+} GstBaseAdaptiveWriteJob;
+
 
 /* GObject */
 static void gst_base_adaptive_sink_dispose (GObject * object);
@@ -119,12 +136,6 @@ static GstStateChangeReturn gst_base_adaptive_sink_change_state (GstElement *
     element, GstStateChange transition);
 
 /*GstBaseAdaptiveSink */
-typedef GError *(*WriteFunc) (GstBaseAdaptiveSink * sink,
-    GFileOutputStream * output_stream, gpointer data,
-    GCancellable * cancellable);
-static GError *gst_base_adaptive_sink_write_fragment (GstBaseAdaptiveSink *
-    sink, GstBaseAdaptivePadData * pad_data, GFileOutputStream * stream,
-    GCancellable * cancellable);
 static void gst_base_adaptive_sink_pad_data_free (GstBaseAdaptivePadData *
     pad_data);
 static GstBaseAdaptivePadData *gst_base_adaptive_sink_pad_data_new (GstPad *
@@ -136,9 +147,12 @@ static void gst_base_adaptive_sink_unlock (GstBaseAdaptiveSink * sink);
 static void gst_base_adaptive_sink_create_empty_fragment (GstBaseAdaptiveSink *
     sink, GstBaseAdaptivePadData * pad_data, GstClockTime start_ts,
     guint64 offset, guint index);
-static GstFlowReturn gst_base_adaptive_sink_write_element (GstBaseAdaptiveSink *
-    sink, WriteFunc write_func, gchar * filename, gboolean append,
-    gpointer data);
+static GstFlowReturn gst_base_adaptive_sink_queue_write (GstBaseAdaptiveSink *
+    sink, GstBaseAdaptiveWriteJob * job);
+static GstFlowReturn gst_base_adaptive_sink_queue_playlist (GstBaseAdaptiveSink
+    * sink, GstMediaRepFile * rep_file, GList * old_files);
+static void gst_base_adaptive_sink_start_writer (GstBaseAdaptiveSink * sink);
+static void gst_base_adaptive_sink_stop_writer (GstBaseAdaptiveSink * sink);
 static gboolean gst_base_adaptive_sink_parse_stream (GstBaseAdaptiveSink * sink,
     GstBaseAdaptivePadData * pad_data);
 static gboolean gst_base_adaptive_process_new_stream (GstBaseAdaptiveSink *
@@ -271,6 +285,52 @@ gst_base_adaptive_sink_class_init (GstBaseAdaptiveSinkClass * klass)
       g_param_spec_uint ("fragment-duration", "Fragment duration",
           "Duration of fragments in seconds", 0, G_MAXUINT32, 10,
           G_PARAM_READWRITE));
+
+  /**
+   * GstBaseAdaptiveSink:max-pending-writes
+   *
+   * Maximum number of files waiting to be written to disk before the
+   * streaming thread blocks
+   *
+   */
+  g_object_class_install_property (gobject_class, PROP_MAX_PENDING_WRITES,
+      g_param_spec_uint ("max-pending-writes", "Max pending writes",
+          "Maximum number of files waiting to be written to disk", 1,
+          G_MAXUINT, DEFAULT_MAX_PENDING_WRITES,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  /**
+   * GstBaseAdaptiveSink:pending-writes
+   *
+   * Number of files waiting to be written to disk
+   *
+   */
+  g_object_class_install_property (gobject_class, PROP_PENDING_WRITES,
+      g_param_spec_uint ("pending-writes", "Pending writes",
+          "Number of files waiting to be written to disk", 0, G_MAXUINT, 0,
+          G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  /**
+   * GstBaseAdaptiveSink:bytes-written
+   *
+   * Number of bytes written to disk
+   *
+   */
+  g_object_class_install_property (gobject_class, PROP_BYTES_WRITTEN,
+      g_param_spec_uint64 ("bytes-written", "Bytes written",
+          "Number of bytes written to disk", 0, G_MAXUINT64, 0,
+          G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  /**
+   * GstBaseAdaptiveSink:write-stalls
+   *
+   * Number of times the streaming thread waited for the disk
+   *
+   */
+  g_object_class_install_property (gobject_class, PROP_WRITE_STALLS,
+      g_param_spec_uint ("write-stalls", "Write stalls",
+          "Number of times the streaming thread waited for the disk", 0,
+          G_MAXUINT, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
   /**
    * GstBaseAdaptiveSink::eos:
    * @sink: the sink element that emited the signal
@@ -292,7 +352,8 @@ gst_base_adaptive_sink_class_init (GstBaseAdaptiveSinkClass * klass)
    *
    * This signal gets emitted when a media presentation has been updated.
    *
-   * This signal is emited from the steaming thread.
+   * This signal is emited from the I/O thread, once the media presentation
+   * was written to disk.
    *
    */
   gst_base_adaptive_sink_signals[SIGNAL_NEW_PLAYLIST] =
@@ -346,6 +407,10 @@ gst_base_adaptive_sink_init (GstBaseAdaptiveSink * sink)
   sink->fragment_duration = 10 * GST_SECOND;
   sink->prepend_headers = TRUE;
   sink->min_cache = 1;
+  sink->max_pending_writes = DEFAULT_MAX_PENDING_WRITES;
+  sink->write_queue = g_queue_new ();
+  sink->write_lock = g_mutex_new ();
+  sink->write_cond = g_cond_new ();
 
   GST_OBJECT_FLAG_SET (sink, GST_ELEMENT_FLAG_SINK);
 }
@@ -385,6 +450,10 @@ gst_base_adaptive_sink_finalize (GObject * object)
     sink->pad_datas = NULL;
   }
 
+  g_queue_free (sink->write_queue);
+  g_mutex_free (sink->write_lock);
+  g_cond_free (sink->write_cond);
+
   G_OBJECT_CLASS (gst_base_adaptive_sink_parent_class)->finalize (object);
 }
 
@@ -535,6 +604,12 @@ gst_base_adaptive_sink_set_property (GObject * object, guint prop_id,
     case PROP_FRAGMENT_DURATION:
       sink->fragment_duration = g_value_get_uint (value) * GST_SECOND;
       break;
+    case PROP_MAX_PENDING_WRITES:
+      g_mutex_lock (sink->write_lock);
+      sink->max_pending_writes = g_value_get_uint (value);
+      g_cond_broadcast (sink->write_cond);
+      g_mutex_unlock (sink->write_lock);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -578,6 +653,24 @@ gst_base_adaptive_sink_get_property (GObject * object, guint prop_id,
     case PROP_FRAGMENT_DURATION:
       g_value_set_uint (value, sink->fragment_duration / GST_SECOND);
       break;
+    case PROP_MAX_PENDING_WRITES:
+      g_value_set_uint (value, sink->max_pending_writes);
+      break;
+    case PROP_PENDING_WRITES:
+      g_mutex_lock (sink->write_lock);
+      g_value_set_uint (value, g_queue_get_length (sink->write_queue));
+      g_mutex_unlock (sink->write_lock);
+      break;
+    case PROP_BYTES_WRITTEN:
+      g_mutex_lock (sink->write_lock);
+      g_value_set_uint64 (value, sink->bytes_written);
+      g_mutex_unlock (sink->write_lock);
+      break;
+    case PROP_WRITE_STALLS:
+      g_mutex_lock (sink->write_lock);
+      g_value_set_uint (value, sink->write_stalls);
+      g_mutex_unlock (sink->write_lock);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -603,6 +696,9 @@ gst_base_adaptive_sink_change_state (GstElement * element,
         sink->streams_manager = b_class->create_streams_manager (sink);
       else
         sink->streams_manager = gst_streams_manager_new ();
+      sink->bytes_written = 0;
+      sink->write_stalls = 0;
+      gst_base_adaptive_sink_start_writer (sink);
     }
       break;
     case GST_STATE_CHANGE_PAUSED_TO_PLAYING:
@@ -610,6 +706,11 @@ gst_base_adaptive_sink_change_state (GstElement * element,
         gst_base_adaptive_sink_request_first_fragments (sink);
       }
       break;
+    case GST_STATE_CHANGE_PAUSED_TO_READY:
+      /* Unblock the streaming threads waiting for the disk so that the pads
+       * can be deactivated */
+      gst_base_adaptive_sink_unlock (sink);
+      break;
     default:
       break;
   }
@@ -622,8 +723,12 @@ gst_base_adaptive_sink_change_state (GstElement * element,
     case GST_STATE_CHANGE_PLAYING_TO_PAUSED:
       break;
     case GST_STATE_CHANGE_PAUSED_TO_READY:
-      gst_base_adaptive_sink_unlock (sink);
+      /* Write the last fragments and wait for the pending writes */
+      g_mutex_lock (sink->write_lock);
+      sink->write_flushing = FALSE;
+      g_mutex_unlock (sink->write_lock);
       gst_base_adaptive_sink_stop (sink);
+      gst_base_adaptive_sink_stop_writer (sink);
       g_object_unref (sink->streams_manager);
       sink->streams_manager = NULL;
       sink->count = 0;
@@ -640,19 +745,10 @@ gst_base_adaptive_sink_change_state (GstElement * element,
 static void
 gst_base_adaptive_sink_unlock (GstBaseAdaptiveSink * sink)
 {
-  GHashTableIter iter;
-  GstPad *pad;
-  GstBaseAdaptivePadData *pad_data;
-
-  g_hash_table_iter_init (&iter, sink->pad_datas);
-  while (g_hash_table_iter_next (&iter, (void *) &pad, (void *) &pad_data)) {
-    if (pad_data->cancellable == NULL)
-      continue;
-
-    g_cancellable_cancel (pad_data->cancellable);
-    g_object_unref (pad_data->cancellable);
-    pad_data->cancellable = NULL;
-  }
+  g_mutex_lock (sink->write_lock);
+  sink->write_flushing = TRUE;
+  g_cond_broadcast (sink->write_cond);
+  g_mutex_unlock (sink->write_lock);
 }
 
 static void
@@ -756,7 +852,7 @@ gst_base_adaptive_sink_chain (GstPad * pad, GstObject * element,
       }
 
       meta = gst_buffer_get_fragment_meta (pad_data->fragment);
-      meta->offset += gst_buffer_get_size (pad_data->fragment);
+      meta->offset += gst_fragment_get_size (pad_data->fragment);
       offset = meta->offset;
 
       ret = gst_base_adaptive_sink_close_fragment (sink, pad_data, ts);
@@ -898,75 +994,101 @@ gst_base_adaptive_sink_set_caps (GstBaseAdaptiveSink * sink, GstPad * pad,
   return TRUE;
 }
 
-static GError *
-gst_base_adaptive_sink_write_fragment (GstBaseAdaptiveSink * sink,
-    GstBaseAdaptivePadData * pad_data, GFileOutputStream * stream,
-    GCancellable * cancellable)
+/* Writes each memory block of the buffer in turn, without mapping the whole
+ * buffer, which would merge its memory into a new contiguous block */
+static gboolean
+gst_base_adaptive_sink_write_buffer (GOutputStream * stream,
+    GstBuffer * buffer, GError ** error)
 {
   GstMapInfo map;
-  GError *error = NULL;
-
-  pad_data->cancellable = cancellable;
-
-  gst_buffer_map (pad_data->fragment, &map, GST_MAP_READ);
-  g_output_stream_write ((GOutputStream *) stream,
-      map.data, map.size, pad_data->cancellable, &error);
-  gst_buffer_unmap (pad_data->fragment, &map);
+  guint i, len;
+  gboolean ret = TRUE;
 
-  pad_data->cancellable = NULL;
-  return error;
-}
+  len = gst_buffer_n_memory (buffer);
+  for (i = 0; i < len && ret; i++) {
+    GstMemory *mem = gst_buffer_peek_memory (buffer, i);
 
-static GError *
-gst_base_adaptive_sink_write_playlist (GstBaseAdaptiveSink * sink,
-    gchar * playlist_str, GFileOutputStream * stream,
-    GCancellable * cancellable)
-{
-  GError *error = NULL;
+    if (!gst_memory_map (mem, &map, GST_MAP_READ)) {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+          "Could not map memory");
+      return FALSE;
+    }
+    ret = g_output_stream_write_all (stream, map.data, map.size, NULL, NULL,
+        error);
+    gst_memory_unmap (mem, &map);
+  }
 
-  g_output_stream_write ((GOutputStream *) stream, playlist_str,
-      g_utf8_strlen (playlist_str, -1), NULL, &error);
-  return error;
+  return ret;
 }
 
 static GstFlowReturn
 gst_base_adaptive_sink_write_element (GstBaseAdaptiveSink * sink,
-    WriteFunc write_func, gchar * filename, gboolean append, gpointer data)
+    GstBaseAdaptiveWriteJob * job)
 {
-  GFile *file;
-  GFileOutputStream *stream;
+  GFile *file, *tmp_file = NULL;
+  GFileOutputStream *stream = NULL;
   GError *error = NULL;
   GstFlowReturn ret = GST_FLOW_OK;
-  GCancellable *cancellable;
+  GstBufferList *chunks;
+  gchar *filename = job->filename;
 
-  /* Create the new file */
+  /* Playlists are written to a temporary file and renamed once complete, so
+   * that readers never see a partial playlist */
   file = g_file_new_for_path (filename);
-  cancellable = g_cancellable_new ();
-  if (append) {
+  if (job->is_playlist) {
+    gchar *tmp_filename = g_strdup_printf ("%s.tmp", filename);
+
+    tmp_file = g_file_new_for_path (tmp_filename);
+    g_free (tmp_filename);
+  }
+
+  /* Create the new file */
+  if (job->append) {
     stream = g_file_append_to (file, G_FILE_CREATE_REPLACE_DESTINATION,
-        cancellable, &error);
+        NULL, &error);
   } else {
-    stream = g_file_replace (file, NULL, FALSE,
-        G_FILE_CREATE_REPLACE_DESTINATION, cancellable, &error);
+    stream = g_file_replace (tmp_file ? tmp_file : file, NULL, FALSE,
+        G_FILE_CREATE_REPLACE_DESTINATION, NULL, &error);
   }
-  if (error) {
-    if (error->code == G_IO_ERROR_CANCELLED)
-      goto done;
+  if (error)
     goto open_error;
-  }
 
-  if (write_func (sink, data, stream, cancellable) != NULL)
+  /* Fragments are written chunk by chunk, playlists are plain buffers */
+  chunks = NULL;
+  if (gst_buffer_get_fragment_meta (job->buffer) != NULL)
+    chunks = gst_fragment_get_chunks (job->buffer);
+
+  if (chunks != NULL) {
+    guint i, len;
+
+    len = gst_buffer_list_length (chunks);
+    for (i = 0; i < len && error == NULL; i++) {
+      gst_base_adaptive_sink_write_buffer ((GOutputStream *) stream,
+          gst_buffer_list_get (chunks, i), &error);
+    }
+  } else {
+    gst_base_adaptive_sink_write_buffer ((GOutputStream *) stream,
+        job->buffer, &error);
+  }
+  if (error)
     goto write_error;
 
   /* Flush and close file */
-  g_output_stream_flush ((GOutputStream *) stream, cancellable, &error);
+  g_output_stream_flush ((GOutputStream *) stream, NULL, &error);
   if (error)
     goto close_error;
 
-  g_output_stream_close ((GOutputStream *) stream, cancellable, &error);
+  g_output_stream_close ((GOutputStream *) stream, NULL, &error);
   if (error)
     goto close_error;
 
+  if (tmp_file != NULL) {
+    g_file_move (tmp_file, file, G_FILE_COPY_OVERWRITE, NULL, NULL, NULL,
+        &error);
+    if (error)
+      goto close_error;
+  }
+
   ret = GST_FLOW_OK;
   goto done;
 
@@ -974,18 +1096,13 @@ gst_base_adaptive_sink_write_element (GstBaseAdaptiveSink * sink,
 open_error:
   {
     GST_ELEMENT_ERROR (sink, RESOURCE, OPEN_WRITE,
-        ("Error openning file \"%s\".", filename), ("%s", g_strerror (errno)));
+        ("Error openning file \"%s\".", filename), ("%s", error->message));
     ret = GST_FLOW_ERROR;
     goto done;
   }
 
 write_error:
   {
-    if (error->code == G_IO_ERROR_CANCELLED) {
-      ret = GST_FLOW_ERROR;
-      goto done;
-    }
-
     switch (error->code) {
       case G_IO_ERROR_NO_SPACE:{
         GST_ELEMENT_ERROR (sink, RESOURCE, NO_SPACE_LEFT, (NULL), (NULL));
@@ -995,8 +1112,7 @@ write_error:
       default:{
         GST_ELEMENT_ERROR (sink, RESOURCE, WRITE,
             ("Error while writing to file \"%s\".", filename),
-            ("%s", g_strerror (errno)));
-        ret = GST_FLOW_ERROR;
+            ("%s", error->message));
         ret = GST_FLOW_ERROR;
       }
     }
@@ -1005,13 +1121,8 @@ write_error:
 
 close_error:
   {
-    if (error->code == G_IO_ERROR_CANCELLED) {
-      ret = GST_FLOW_ERROR;
-      goto done;
-    }
-
     GST_ELEMENT_ERROR (sink, RESOURCE, CLOSE,
-        ("Error closing file \"%s\".", filename), ("%s", g_strerror (errno)));
+        ("Error closing file \"%s\".", filename), ("%s", error->message));
     ret = GST_FLOW_ERROR;
     goto done;
   }
@@ -1022,13 +1133,163 @@ done:
       g_error_free (error);
     if (stream)
       g_object_unref (stream);
+    if (tmp_file)
+      g_object_unref (tmp_file);
     g_object_unref (file);
-    g_object_unref (cancellable);
-
     return ret;
   }
 }
 
+static void
+gst_base_adaptive_sink_write_job_free (GstBaseAdaptiveWriteJob * job)
+{
+  g_free (job->filename);
+  if (job->buffer != NULL)
+    gst_buffer_unref (job->buffer);
+  g_list_foreach (job->old_files, (GFunc) g_object_unref, NULL);
+  g_list_free (job->old_files);
+  g_free (job);
+}
+
+/* I/O thread: processes the write jobs in order, so a playlist is never
+ * published before the fragments it references are on disk */
+static gpointer
+gst_base_adaptive_sink_writer_func (GstBaseAdaptiveSink * sink)
+{
+  GstBaseAdaptiveWriteJob *job;
+  GstFlowReturn ret;
+
+  while (TRUE) {
+    g_mutex_lock (sink->write_lock);
+    while (g_queue_is_empty (sink->write_queue) && !sink->writer_stop)
+      g_cond_wait (sink->write_cond, sink->write_lock);
+    job = g_queue_peek_head (sink->write_queue);
+    /* Skip everything after an error */
+    ret = sink->write_ret;
+    g_mutex_unlock (sink->write_lock);
+
+    /* Stopped and all the pending jobs are done */
+    if (job == NULL)
+      break;
+
+    if (ret == GST_FLOW_OK && job->filename != NULL) {
+      GST_DEBUG_OBJECT (sink, "Writing %s", job->filename);
+      ret = gst_base_adaptive_sink_write_element (sink, job);
+      if (ret == GST_FLOW_OK && job->is_playlist) {
+        GstMapInfo map;
+
+        /* The content was wrapped from a nul-terminated string */
+        gst_buffer_map (job->buffer, &map, GST_MAP_READ);
+        g_signal_emit (sink,
+            gst_base_adaptive_sink_signals[SIGNAL_NEW_PLAYLIST], 0,
+            job->filename, map.data);
+        gst_buffer_unmap (job->buffer, &map);
+      }
+    }
+
+    /* Delete old files once they are out of the published playlist */
+    if (ret == GST_FLOW_OK && sink->delete_old_files)
+      g_list_foreach (job->old_files, (GFunc) g_file_delete, NULL);
+
+    g_mutex_lock (sink->write_lock);
+    g_queue_pop_head (sink->write_queue);
+    if (ret == GST_FLOW_OK && job->filename != NULL) {
+      /* The data of fragments is in their chunks */
+      if (gst_buffer_get_fragment_meta (job->buffer) != NULL)
+        sink->bytes_written += gst_fragment_get_size (job->buffer);
+      else
+        sink->bytes_written += gst_buffer_get_size (job->buffer);
+    }
+    sink->write_ret = ret;
+    g_cond_broadcast (sink->write_cond);
+    g_mutex_unlock (sink->write_lock);
+
+    gst_base_adaptive_sink_write_job_free (job);
+  }
+
+  GST_DEBUG_OBJECT (sink, "Writer thread stopped");
+  return NULL;
+}
+
+/* Queue a job for the I/O thread, waiting if there are too many pending
+ * jobs already. Takes ownership of @job */
+static GstFlowReturn
+gst_base_adaptive_sink_queue_write (GstBaseAdaptiveSink * sink,
+    GstBaseAdaptiveWriteJob * job)
+{
+  GstFlowReturn ret;
+
+  g_mutex_lock (sink->write_lock);
+  if (g_queue_get_length (sink->write_queue) >= sink->max_pending_writes
+      && !sink->write_flushing) {
+    GST_WARNING_OBJECT (sink, "Too many pending writes, waiting for the "
+        "disk to catch up");
+    sink->write_stalls++;
+    while (g_queue_get_length (sink->write_queue) >= sink->max_pending_writes
+        && !sink->write_flushing && sink->write_ret == GST_FLOW_OK)
+      g_cond_wait (sink->write_cond, sink->write_lock);
+  }
+
+  ret = sink->write_flushing ? GST_FLOW_FLUSHING : sink->write_ret;
+  if (ret == GST_FLOW_OK) {
+    g_queue_push_tail (sink->write_queue, job);
+    g_cond_broadcast (sink->write_cond);
+  }
+  g_mutex_unlock (sink->write_lock);
+
+  if (ret != GST_FLOW_OK)
+    gst_base_adaptive_sink_write_job_free (job);
+
+  return ret;
+}
+
+static GstFlowReturn
+gst_base_adaptive_sink_queue_playlist (GstBaseAdaptiveSink * sink,
+    GstMediaRepFile * rep_file, GList * old_files)
+{
+  GstBaseAdaptiveWriteJob *job;
+
+  job = g_new0 (GstBaseAdaptiveWriteJob, 1);
+  if (rep_file != NULL) {
+    job->filename = g_file_get_path (rep_file->file);
+    /* The rendered playlist is handed over to the writer, no need to copy */
+    job->buffer = gst_buffer_new_wrapped (rep_file->content,
+        strlen (rep_file->content));
+    rep_file->content = NULL;
+    job->is_playlist = TRUE;
+    GST_DEBUG_OBJECT (sink, "Updating playlist: %s", job->filename);
+  }
+  job->old_files = old_files;
+
+  return gst_base_adaptive_sink_queue_write (sink, job);
+}
+
+static void
+gst_base_adaptive_sink_start_writer (GstBaseAdaptiveSink * sink)
+{
+  sink->writer_stop = FALSE;
+  sink->write_flushing = FALSE;
+  sink->write_ret = GST_FLOW_OK;
+  sink->writer = g_thread_new ("adaptivesink-writer",
+      (GThreadFunc) gst_base_adaptive_sink_writer_func, sink);
+}
+
+/* Wait until all the pending jobs are written and stop the I/O thread */
+static void
+gst_base_adaptive_sink_stop_writer (GstBaseAdaptiveSink * sink)
+{
+  if (sink->writer == NULL)
+    return;
+
+  g_mutex_lock (sink->write_lock);
+  sink->writer_stop = TRUE;
+  g_cond_broadcast (sink->write_cond);
+  g_mutex_unlock (sink->write_lock);
+
+  g_thread_join (sink->writer);
+  sink->writer = NULL;
+}
+
 static gboolean
 gst_base_adaptive_process_new_stream (GstBaseAdaptiveSink * sink, GstPad * pad,
     GstBaseAdaptivePadData * pad_data)
@@ -1044,7 +1305,7 @@ gst_base_adaptive_process_new_stream (GstBaseAdaptiveSink * sink, GstPad * pad,
   GST_INFO_OBJECT (sink, "Adding new stream for pad %s:%s",
       GST_DEBUG_PAD_NAME (pad));
 
-  avg_bitrate = gst_buffer_get_size (pad_data->fragment);
+  avg_bitrate = gst_fragment_get_size (pad_data->fragment);
   avg_bitrate /= sink->fragment_duration / GST_SECOND;
 
   if (!gst_streams_manager_add_stream (sink->streams_manager, pad, avg_bitrate,
@@ -1055,17 +1316,11 @@ gst_base_adaptive_process_new_stream (GstBaseAdaptiveSink * sink, GstPad * pad,
   }
 
   if (rep_file) {
-    gchar *path;
-    gboolean ret;
-
-    path = g_file_get_path (rep_file->file);
-    ret = gst_base_adaptive_sink_write_element (sink,
-        (WriteFunc) gst_base_adaptive_sink_write_playlist,
-        path, FALSE, rep_file->content);
-    if (ret != GST_FLOW_OK) {
-      GST_ERROR_OBJECT (sink, "Could not save playlist %s", path);
+    if (sink->write_to_disk &&
+        gst_base_adaptive_sink_queue_playlist (sink, rep_file, NULL) !=
+        GST_FLOW_OK) {
+      GST_ERROR_OBJECT (sink, "Could not save playlist");
     }
-    g_free (path);
     gst_media_rep_file_free (rep_file);
   }
 
@@ -1178,51 +1433,32 @@ gst_base_adaptive_sink_close_fragment (GstBaseAdaptiveSink * sink,
   GST_INFO_OBJECT (sink, "Creating new fragment %s with duration: %"
       GST_TIME_FORMAT, fragment_filename, GST_TIME_ARGS (duration));
 
-  /* Write fragment to disk */
+  /* Queue the fragment for writing. The I/O thread writes the files in
+   * order, so the fragment is on disk before the playlist referencing it */
   if (sink->write_to_disk) {
+    GstBaseAdaptiveWriteJob *job;
+
     GST_DEBUG_OBJECT (sink, "Writting fragment to disk %s", fragment_filename);
-    ret = gst_base_adaptive_sink_write_element (sink,
-        (WriteFunc) gst_base_adaptive_sink_write_fragment,
-        fragment_filename, !sink->chunked, pad_data);
+    job = g_new0 (GstBaseAdaptiveWriteJob, 1);
+    job->filename = g_strdup (fragment_filename);
+    job->buffer = gst_buffer_ref (pad_data->fragment);
+    job->append = !sink->chunked;
+    ret = gst_base_adaptive_sink_queue_write (sink, job);
     if (ret != GST_FLOW_OK)
       goto done;
   }
 
-  /* Add the new entry to the playlist after the fragment was succeesfully
-   * written to disk */
+  /* Add the new entry to the playlist */
   gst_streams_manager_add_fragment (sink->streams_manager,
       pad_data->pad, pad_data->fragment, &rep_file, &old_files);
 
-  /* Delete old files */
-  if (sink->delete_old_files && old_files != NULL) {
-    g_list_foreach (old_files, (GFunc) g_file_delete, NULL);
-  }
-  g_list_foreach (old_files, (GFunc) g_object_unref, NULL);
-  g_list_free (old_files);
-
-  /* Write playlist to disk */
-  if (sink->write_to_disk) {
-    if (rep_file != NULL) {
-      gchar *filename;
-
-      filename = g_file_get_path (rep_file->file);
-      GST_DEBUG_OBJECT (sink, "Updating playlist: %s", filename);
-      ret = gst_base_adaptive_sink_write_element (sink,
-          (WriteFunc) gst_base_adaptive_sink_write_playlist,
-          filename, FALSE, rep_file->content);
-
-      if (ret != GST_FLOW_OK) {
-        gst_media_rep_file_free (rep_file);
-        g_free (filename);
-        goto done;
-      }
-
-      g_signal_emit (sink, gst_base_adaptive_sink_signals[SIGNAL_NEW_PLAYLIST],
-          0, filename, rep_file->content);
-      gst_media_rep_file_free (rep_file);
-      g_free (filename);
-    }
-  }
+  /* Write playlist to disk and delete the old files */
+  ret = gst_base_adaptive_sink_queue_playlist (sink,
+      sink->write_to_disk ? rep_file : NULL, old_files);
+  if (rep_file != NULL)
+    gst_media_rep_file_free (rep_file);
+  if (ret != GST_FLOW_OK)
+    goto done;
 
   g_signal_emit (sink, gst_base_adaptive_sink_signals[SIGNAL_NEW_FRAGMENT], 0);
 
@@ -1253,7 +1489,6 @@ gst_base_adaptive_sink_pad_data_new (GstPad * pad)
   pad_data->count = 0;
   pad_data->new_fragment_ts = GST_CLOCK_TIME_NONE;
   pad_data->fragment = NULL;
-  pad_data->cancellable = NULL;
   pad_data->streamheaders = NULL;
   pad_data->lock = g_mutex_new ();
   pad_data->discover_lock = g_mutex_new ();
@@ -1276,11 +1511,6 @@ gst_base_adaptive_sink_pad_data_free (GstBaseAdaptivePadData * pad_data)
     pad_data->streamheaders = NULL;
   }
 
-  if (pad_data->cancellable != NULL) {
-    g_object_unref (pad_data->cancellable);
-    pad_data->cancellable = NULL;
-  }
-
   if (pad_data->decoded_caps != NULL) {
     g_list_foreach (pad_data->decoded_caps, (GFunc) gst_caps_unref, NULL);
     g_list_free (pad_data->decoded_caps);
@@ -1338,8 +1568,10 @@ gst_base_adaptive_sink_parse_stream (GstBaseAdaptiveSink * sink,
     GstBaseAdaptivePadData * pad_data)
 {
   GstElement *pipeline, *appsrc, *decodebin;
+  GstBufferList *chunks;
   GTimeVal timeout;
   gboolean ret = TRUE;
+  guint i, n_buffers;
 
   GST_DEBUG_OBJECT (sink, "Demuxing first fragment");
 
@@ -1363,16 +1595,20 @@ gst_base_adaptive_sink_parse_stream (GstBaseAdaptiveSink * sink,
   /* Push buffer and wait for the "drained" signal */
   g_mutex_lock (pad_data->discover_lock);
 
-  /* Push the headers and the first fragment */
+  /* Push the headers and the buffers of the first fragment */
+  chunks = gst_fragment_get_chunks (pad_data->fragment);
+  n_buffers = gst_buffer_list_length (chunks);
   if (pad_data->streamheaders && !sink->chunked) {
-    g_object_set (G_OBJECT (appsrc), "num-buffers", 2, NULL);
+    g_object_set (G_OBJECT (appsrc), "num-buffers", n_buffers + 1, NULL);
     gst_buffer_ref (pad_data->streamheaders);
     gst_app_src_push_buffer (GST_APP_SRC (appsrc), pad_data->streamheaders);
   } else {
-    g_object_set (G_OBJECT (appsrc), "num-buffers", 1, NULL);
+    g_object_set (G_OBJECT (appsrc), "num-buffers", n_buffers, NULL);
+  }
+  for (i = 0; i < n_buffers; i++) {
+    gst_app_src_push_buffer (GST_APP_SRC (appsrc),
+        gst_buffer_ref (gst_buffer_list_get (chunks, i)));
   }
-  gst_buffer_ref (pad_data->fragment);
-  gst_app_src_push_buffer (GST_APP_SRC (appsrc), pad_data->fragment);
 
   gst_element_set_state (pipeline, GST_STATE_PAUSED);
 
@@ -68,6 +68,7 @@ struct _GstBaseAdaptiveSink
   gchar *output_directory;         /* output directory for new fragments and media representation files */
   gchar *fragment_prefix;          /* prefix used for naming fragments */
   const gchar *fragment_tpl;       /* Filename template for fragments */
+  guint max_pending_writes;        /* Maximum number of files waiting to be written */
 
   /*< protected >*/
   gboolean append_headers;    /* True if the headers should be appended to each fragment */
@@ -78,6 +79,17 @@ struct _GstBaseAdaptiveSink
   GstStreamsManager *streams_manager;
   GHashTable * pad_datas;
   guint count;
+
+  /* Write-behind I/O, protected by write_lock */
+  GThread *writer;
+  GQueue *write_queue;             /* Pending write jobs */
+  GMutex *write_lock;
+  GCond *write_cond;
+  gboolean writer_stop;
+  gboolean write_flushing;
+  GstFlowReturn write_ret;         /* Result of the last write */
+  guint64 bytes_written;
+  guint write_stalls;
 };
 
 struct _GstBaseAdaptiveSinkClass
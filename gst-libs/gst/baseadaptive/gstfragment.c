@@ -71,6 +71,8 @@ gst_fragment_meta_init (GstFragmentMeta * meta, gpointer params,
   meta->discontinuous = FALSE;
   meta->file = NULL;
   meta->headers = NULL;
+  meta->chunks = gst_buffer_list_new ();
+  meta->size = 0;
 
   return TRUE;
 }
@@ -91,6 +93,11 @@ gst_fragment_meta_free (GstFragmentMeta * meta, GstBuffer * buffer)
     g_object_unref (meta->file);
     meta->file = NULL;
   }
+
+  if (meta->chunks != NULL) {
+    gst_buffer_list_unref (meta->chunks);
+    meta->chunks = NULL;
+  }
 }
 
 GstBuffer *
@@ -176,17 +183,51 @@ gst_fragment_add_buffer (GstBuffer * fragment, GstBuffer * buffer)
 
   meta = gst_fragment_get_meta (fragment);
   if (!meta) {
+    gst_buffer_unref (buffer);
     return FALSE;
   }
 
   if (meta->completed) {
     GST_DEBUG ("Fragment is completed, you can't add new buffers to it");
+    gst_buffer_unref (buffer);
     return FALSE;
   }
-  gst_buffer_append (fragment, buffer);
+
+  /* Keep a reference to the buffer instead of appending its memory to the
+   * fragment: a buffer can only hold a few memory blocks and merges them all
+   * into a new one once the limit is reached, which copies the whole
+   * fragment over and over as it grows */
+  meta->size += gst_buffer_get_size (buffer);
+  gst_buffer_list_add (meta->chunks, buffer);
   return TRUE;
 }
 
+guint64
+gst_fragment_get_size (GstBuffer * fragment)
+{
+  GstFragmentMeta *meta;
+
+  meta = gst_fragment_get_meta (fragment);
+  if (!meta) {
+    return 0;
+  }
+
+  return meta->size;
+}
+
+GstBufferList *
+gst_fragment_get_chunks (GstBuffer * fragment)
+{
+  GstFragmentMeta *meta;
+
+  meta = gst_fragment_get_meta (fragment);
+  if (!meta) {
+    return NULL;
+  }
+
+  return meta->chunks;
+}
+
 void
 gst_fragment_set_file (GstBuffer * fragment, GFile * file)
 {
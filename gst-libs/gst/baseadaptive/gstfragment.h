@@ -49,6 +49,8 @@ struct _GstFragmentMeta
   gboolean discontinuous;       /* Whether this fragment is discontinuous or not */
   GFile *file;                  /* File where this fragment is stored in disk */
   GstBuffer *headers;
+  GstBufferList *chunks;        /* Buffers appended to the fragment, in order */
+  guint64 size;                 /* Total size of the appended buffers */
 };
 
 GType gst_fragment_meta_api_get_type (void);
@@ -58,6 +60,8 @@ gboolean gst_fragment_add_buffer (GstBuffer *fragment, GstBuffer *buffer);
 void gst_fragment_set_name (GstBuffer *buffer, gchar *name);
 guint64 gst_fragment_get_duration (GstBuffer *fragment);
 void gst_fragment_set_file (GstBuffer *fragment, GFile *file);
+guint64 gst_fragment_get_size (GstBuffer *fragment);
+GstBufferList * gst_fragment_get_chunks (GstBuffer *fragment);
 GstBuffer * gst_fragment_new (void);
 
 G_END_DECLS
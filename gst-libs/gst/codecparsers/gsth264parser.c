@@ -85,6 +85,7 @@
 #endif
 
 #include "gsth264parser.h"
+#include "parserutils.h"
 
 #include <gst/base/gstbytereader.h>
 #include <gst/base/gstbitreader.h>
@@ -194,29 +195,37 @@ typedef struct
   guint size;
 
   guint n_epb;                  /* Number of emulation prevention bytes */
+  guint epb_end;                /* Byte position after the last one */
   guint byte;                   /* Byte position */
-  guint bits_in_cache;          /* bitpos in the cache of next bit */
-  guint8 first_byte;
-  guint64 cache;                /* cached bytes */
+  guint bits_in_cache;          /* Number of unread bits in the cache */
+  guint64 cache;                /* cached bytes, most recent in the low bits */
 } NalReader;
 
+/* Whether any of the bytes of @w is 0x03, see
+ * <http://graphics.stanford.edu/~seander/bithacks.html#ValueInWord> */
+#define NAL_READER_HAS_03_BYTE(w) \
+  ((((w) ^ 0x03030303) - 0x01010101) & ~((w) ^ 0x03030303) & 0x80808080)
+
 static void
 nal_reader_init (NalReader * nr, const guint8 * data, guint size)
 {
   nr->data = data;
   nr->size = size;
   nr->n_epb = 0;
+  nr->epb_end = 0;
 
   nr->byte = 0;
   nr->bits_in_cache = 0;
   /* fill with something other than 0 to detect emulation prevention bytes */
-  nr->first_byte = 0xff;
-  nr->cache = 0xff;
+  nr->cache = 0xffff;
 }
 
 static inline gboolean
 nal_reader_read (NalReader * nr, guint nbits)
 {
+  if (G_LIKELY (nr->bits_in_cache >= nbits))
+    return TRUE;
+
   if (G_UNLIKELY (nr->byte * 8 + (nbits - nr->bits_in_cache) > nr->size * 8)) {
     GST_DEBUG ("Can not read %u bits, bits in cache %u, Byte * 8 %u, size in "
         "bits %u", nbits, nr->bits_in_cache, nr->byte * 8, nr->size * 8);
@@ -225,25 +234,35 @@ nal_reader_read (NalReader * nr, guint nbits)
 
   while (nr->bits_in_cache < nbits) {
     guint8 byte;
-    gboolean check_three_byte;
 
-    check_three_byte = TRUE;
+    /* None of the next 4 bytes is 0x03, so none of them can be an emulation
+     * prevention byte and they can all go to the cache at once */
+    if (nr->bits_in_cache < 32 && nr->size - nr->byte >= 4) {
+      guint32 word = GST_READ_UINT32_BE (nr->data + nr->byte);
+
+      if (G_LIKELY (!NAL_READER_HAS_03_BYTE (word))) {
+        nr->cache = (nr->cache << 32) | word;
+        nr->byte += 4;
+        nr->bits_in_cache += 32;
+        continue;
+      }
+    }
+
   next_byte:
     if (G_UNLIKELY (nr->byte >= nr->size))
       return FALSE;
 
     byte = nr->data[nr->byte++];
 
-    /* check if the byte is a emulation_prevention_three_byte */
-    if (check_three_byte && byte == 0x03 && nr->first_byte == 0x00 &&
-        ((nr->cache & 0xff) == 0)) {
-      /* next byte goes unconditionally to the cache, even if it's 0x03 */
-      check_three_byte = FALSE;
+    /* check if the byte is a emulation_prevention_three_byte, the two zero
+     * bytes before it must not be separated by a previous one */
+    if (byte == 0x03 && (nr->cache & 0xffff) == 0 &&
+        nr->byte >= nr->epb_end + 3) {
       nr->n_epb++;
+      nr->epb_end = nr->byte;
       goto next_byte;
     }
-    nr->cache = (nr->cache << 8) | nr->first_byte;
-    nr->first_byte = byte;
+    nr->cache = (nr->cache << 8) | byte;
     nr->bits_in_cache += 8;
   }
 
@@ -253,6 +272,14 @@ nal_reader_read (NalReader * nr, guint nbits)
 static inline gboolean
 nal_reader_skip (NalReader * nr, guint nbits)
 {
+  /* the cache can't hold more than 32 bits on top of the unread ones */
+  while (G_UNLIKELY (nbits > 32)) {
+    if (G_UNLIKELY (!nal_reader_read (nr, 32)))
+      return FALSE;
+    nr->bits_in_cache -= 32;
+    nbits -= 32;
+  }
+
   if (G_UNLIKELY (!nal_reader_read (nr, nbits)))
     return FALSE;
 
@@ -269,10 +296,12 @@ nal_reader_skip_to_byte (NalReader * nr)
       nr->byte++;
     else
       return FALSE;
+  } else if (nr->bits_in_cache % 8 == 0) {
+    nr->bits_in_cache -= 8;
+  } else {
+    nr->bits_in_cache -= nr->bits_in_cache % 8;
   }
 
-  nr->bits_in_cache = 0;
-
   return TRUE;
 }
 
@@ -305,9 +334,8 @@ nal_reader_get_bits_uint##bits (NalReader *nr, guint##bits *val, guint nbits) \
   \
   /* bring the required bits down and truncate */ \
   shift = nr->bits_in_cache - nbits; \
-  *val = nr->first_byte >> shift; \
+  *val = nr->cache >> shift; \
   \
-  *val |= nr->cache << (8 - shift); \
   /* mask out required bits */ \
   if (nbits < bits) \
     *val &= ((guint##bits)1 << nbits) - 1; \
@@ -337,21 +365,39 @@ static gboolean
 nal_reader_get_ue (NalReader * nr, guint32 * val)
 {
   guint i = 0;
-  guint8 bit;
+  guint n;
+  guint32 bits;
   guint32 value;
 
-  if (G_UNLIKELY (!nal_reader_get_bits_uint8 (nr, &bit, 1))) {
+  /* count the leading zero bits using all the cached bits at once */
+  for (;;) {
+    if (nr->bits_in_cache == 0 && G_UNLIKELY (!nal_reader_read (nr, 1)))
+      return FALSE;
 
-    return FALSE;
-  }
+    n = MIN (nr->bits_in_cache, 32);
+    bits = nr->cache >> (nr->bits_in_cache - n);
+    if (n < 32)
+      bits &= (1U << n) - 1;
+
+    if (bits != 0)
+      break;
 
-  while (bit == 0) {
-    i++;
-    if G_UNLIKELY
-      ((!nal_reader_get_bits_uint8 (nr, &bit, 1)))
-          return FALSE;
+    i += n;
+    nr->bits_in_cache -= n;
+    if (G_UNLIKELY (i > 32))
+      return FALSE;
   }
 
+  /* skip the zeros and the marker bit */
+#if defined (__GNUC__)
+  n -= 31 - __builtin_clz (bits);
+#else
+  /* ceil_log2 (bits + 1) is the number of significant bits in the window */
+  n -= ceil_log2 (bits + 1) - 1;
+#endif
+  i += n - 1;
+  nr->bits_in_cache -= n;
+
   if (G_UNLIKELY (i > 32))
     return FALSE;
 
@@ -379,6 +425,13 @@ nal_reader_get_se (NalReader * nr, gint32 * val)
   return TRUE;
 }
 
+/* Use the NalReader instead of the GstBitReader from parserutils.h */
+#undef CHECK_ALLOWED
+#undef READ_UINT8
+#undef READ_UINT16
+#undef READ_UINT32
+#undef READ_UINT64
+
 #define CHECK_ALLOWED(val, min, max) { \
   if (val < min || val > max) { \
     GST_WARNING ("value not in allowed range. value: %d, range %d-%d", \
@@ -486,17 +539,6 @@ set_nalu_datas (GstH264NalUnit * nalu)
   GST_DEBUG ("Nal type %u, ref_idc %u", nalu->type, nalu->ref_idc);
 }
 
-static inline gint
-scan_for_start_codes (const guint8 * data, guint size)
-{
-  GstByteReader br;
-  gst_byte_reader_init (&br, data, size);
-
-  /* NALU not empty, so we can at least expect 1 (even 2) bytes following sc */
-  return gst_byte_reader_masked_scan_uint32 (&br, 0xffffff00, 0x00000100,
-      0, size);
-}
-
 static gboolean
 gst_h264_parser_more_data (NalReader * nr)
 {
@@ -21,6 +21,13 @@
 
 #include "parserutils.h"
 
+#if defined (__SSE2__)
+#include <emmintrin.h>
+#elif defined (__ARM_NEON__) || defined (__ARM_NEON)
+#include <arm_neon.h>
+#define HAVE_NEON_SCAN 1
+#endif
+
 gboolean
 decode_vlc (GstBitReader * br, guint * res, const VLCTable * table,
     guint length)
@@ -55,3 +62,138 @@ failed:
     return FALSE;
   }
 }
+
+#if defined (__SSE2__) || defined (HAVE_NEON_SCAN)
+/* Returns the position of the first start code prefix beginning in the 16
+ * bytes at @data, or -1. Reads 18 bytes. */
+static inline gint
+scan_block (const guint8 * data)
+{
+#if defined (__SSE2__)
+  const __m128i zero = _mm_setzero_si128 ();
+  __m128i a, b, c;
+  gint mask;
+
+  /* no zero byte, no start code beginning here */
+  a = _mm_cmpeq_epi8 (_mm_loadu_si128 ((const __m128i *) data), zero);
+  if (G_LIKELY (_mm_movemask_epi8 (a) == 0))
+    return -1;
+
+  b = _mm_cmpeq_epi8 (_mm_loadu_si128 ((const __m128i *) (data + 1)), zero);
+  c = _mm_cmpeq_epi8 (_mm_loadu_si128 ((const __m128i *) (data + 2)),
+      _mm_set1_epi8 (1));
+
+  mask = _mm_movemask_epi8 (_mm_and_si128 (_mm_and_si128 (a, b), c));
+  if (G_LIKELY (mask == 0))
+    return -1;
+
+  return __builtin_ctz (mask);
+#else
+  uint8x16_t a, b, c;
+  uint64x2_t m;
+  gint i;
+
+  /* no zero byte, no start code beginning here */
+  a = vceqq_u8 (vld1q_u8 (data), vdupq_n_u8 (0));
+  m = vreinterpretq_u64_u8 (a);
+  if (G_LIKELY ((vgetq_lane_u64 (m, 0) | vgetq_lane_u64 (m, 1)) == 0))
+    return -1;
+
+  b = vceqq_u8 (vld1q_u8 (data + 1), vdupq_n_u8 (0));
+  c = vceqq_u8 (vld1q_u8 (data + 2), vdupq_n_u8 (1));
+  m = vreinterpretq_u64_u8 (vandq_u8 (vandq_u8 (a, b), c));
+
+  if (G_LIKELY ((vgetq_lane_u64 (m, 0) | vgetq_lane_u64 (m, 1)) == 0))
+    return -1;
+
+  for (i = 0; i < 15; i++) {
+    if (data[i] == 0 && data[i + 1] == 0 && data[i + 2] == 1)
+      break;
+  }
+
+  return i;
+#endif
+}
+#endif
+
+/**
+ * scan_for_start_codes:
+ * @data: the data to scan
+ * @size: the size of @data
+ *
+ * Looks for the first 0x000001 start code prefix in @data that is followed by
+ * at least one more byte, in the same way as
+ * gst_byte_reader_masked_scan_uint32() with mask 0xffffff00 and pattern
+ * 0x00000100 would.
+ *
+ * When SSE2 or NEON are available, 16 positions are checked at a time.
+ *
+ * Returns: the offset of the start code prefix, or -1 if there is none.
+ */
+gint
+scan_for_start_codes (const guint8 * data, guint size)
+{
+  guint i = 0;
+
+  /* we can't find the pattern with less than 4 bytes */
+  if (G_UNLIKELY (size < 4))
+    return -1;
+
+#if defined (__SSE2__) || defined (HAVE_NEON_SCAN)
+  /* check 16 positions at a time, as long as the start code prefix at the
+   * last one would still be followed by a byte */
+  while (i + 19 <= size) {
+    gint off = scan_block (data + i);
+
+    if (G_UNLIKELY (off >= 0))
+      return i + off;
+    i += 16;
+  }
+#endif
+
+  while (i <= size - 4) {
+    if (data[i + 2] > 1) {
+      i += 3;
+    } else if (data[i + 1]) {
+      i += 2;
+    } else if (data[i] || data[i + 2] != 1) {
+      i++;
+    } else {
+      return i;
+    }
+  }
+
+  /* nothing found */
+  return -1;
+}
+
+/**
+ * scan_for_all_start_codes:
+ * @data: the data to scan
+ * @size: the size of @data
+ * @offsets: (out): array where to store the start code offsets
+ * @max_offsets: the number of elements of @offsets
+ *
+ * Finds the offsets of up to @max_offsets start code prefixes in @data, as
+ * returned by scan_for_start_codes(), in a single pass over the data.
+ *
+ * Returns: the number of offsets stored in @offsets.
+ */
+guint
+scan_for_all_start_codes (const guint8 * data, guint size, guint * offsets,
+    guint max_offsets)
+{
+  guint n = 0, pos = 0;
+  gint off;
+
+  while (n < max_offsets && pos < size) {
+    off = scan_for_start_codes (data + pos, size - pos);
+    if (off < 0)
+      break;
+
+    offsets[n++] = pos + off;
+    pos += off + 3;
+  }
+
+  return n;
+}
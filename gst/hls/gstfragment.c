@@ -26,6 +26,10 @@
 
 #define GST_CAT_DEFAULT fragmented_debug
 
+/* Amount of data received before typefinding a streamed fragment */
+#define TYPEFIND_MIN_SIZE 4096
+#define TYPEFIND_MAX_SIZE (64 * 1024)
+
 #define GST_FRAGMENT_GET_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE ((obj), GST_TYPE_FRAGMENT, GstFragmentPrivate))
 
 enum
@@ -45,6 +49,12 @@ struct _GstFragmentPrivate
   GstBuffer *buffer;
   GstCaps *caps;
   GMutex lock;
+
+  /* Streaming mode: buffers not consumed yet, protected by the lock */
+  gboolean streaming;
+  gboolean aborted;
+  GQueue *chunks;
+  GCond cond;
 };
 
 G_DEFINE_TYPE (GstFragment, gst_fragment, G_TYPE_OBJECT);
@@ -158,7 +168,11 @@ gst_fragment_init (GstFragment * fragment)
   fragment->priv = priv = GST_FRAGMENT_GET_PRIVATE (fragment);
 
   g_mutex_init (&fragment->priv->lock);
+  g_cond_init (&fragment->priv->cond);
   priv->buffer = NULL;
+  priv->chunks = g_queue_new ();
+  priv->streaming = FALSE;
+  priv->aborted = FALSE;
   fragment->download_start_time = gst_util_get_timestamp ();
   fragment->start_time = 0;
   fragment->stop_time = 0;
@@ -166,6 +180,7 @@ gst_fragment_init (GstFragment * fragment)
   fragment->name = g_strdup ("");
   fragment->completed = FALSE;
   fragment->discontinuous = FALSE;
+  fragment->size = 0;
 }
 
 GstFragment *
@@ -180,7 +195,9 @@ gst_fragment_finalize (GObject * gobject)
   GstFragment *fragment = GST_FRAGMENT (gobject);
 
   g_free (fragment->name);
+  g_queue_free (fragment->priv->chunks);
   g_mutex_clear (&fragment->priv->lock);
+  g_cond_clear (&fragment->priv->cond);
 
   G_OBJECT_CLASS (gst_fragment_parent_class)->finalize (gobject);
 }
@@ -200,6 +217,9 @@ gst_fragment_dispose (GObject * object)
     priv->caps = NULL;
   }
 
+  while (!g_queue_is_empty (priv->chunks))
+    gst_buffer_unref (g_queue_pop_head (priv->chunks));
+
   G_OBJECT_CLASS (gst_fragment_parent_class)->dispose (object);
 }
 
@@ -208,7 +228,7 @@ gst_fragment_get_buffer (GstFragment * fragment)
 {
   g_return_val_if_fail (fragment != NULL, NULL);
 
-  if (!fragment->completed)
+  if (!fragment->completed || fragment->priv->buffer == NULL)
     return NULL;
 
   gst_buffer_ref (fragment->priv->buffer);
@@ -225,22 +245,130 @@ gst_fragment_set_caps (GstFragment * fragment, GstCaps * caps)
   g_mutex_unlock (&fragment->priv->lock);
 }
 
+/* Typefind a streamed fragment on the data received so far, waiting for
+ * more data while it's not enough. Must be called with the lock */
+static GstCaps *
+gst_fragment_typefind_chunks (GstFragment * fragment)
+{
+  GstFragmentPrivate *priv = fragment->priv;
+  GstCaps *caps = NULL;
+  GstBuffer *buf;
+  gboolean done;
+  gsize size;
+  GList *l;
+
+  while (TRUE) {
+    done = fragment->completed || priv->aborted;
+    size = 0;
+    for (l = priv->chunks->head; l; l = l->next)
+      size += gst_buffer_get_size (l->data);
+
+    if (size >= TYPEFIND_MIN_SIZE || done) {
+      buf = gst_buffer_new ();
+      for (l = priv->chunks->head; l; l = l->next)
+        buf = gst_buffer_append (buf, gst_buffer_ref (l->data));
+      if (size > 0)
+        caps = gst_type_find_helper_for_buffer (NULL, buf, NULL);
+      gst_buffer_unref (buf);
+
+      if (caps != NULL || done || size >= TYPEFIND_MAX_SIZE)
+        break;
+    }
+    g_cond_wait (&priv->cond, &priv->lock);
+  }
+
+  return caps;
+}
+
 GstCaps *
 gst_fragment_get_caps (GstFragment * fragment)
 {
+  GstCaps *caps;
+
   g_return_val_if_fail (fragment != NULL, NULL);
 
-  if (!fragment->completed)
+  if (!fragment->completed && !fragment->priv->streaming)
     return NULL;
 
   g_mutex_lock (&fragment->priv->lock);
-  if (fragment->priv->caps == NULL)
-    fragment->priv->caps =
-        gst_type_find_helper_for_buffer (NULL, fragment->priv->buffer, NULL);
-  gst_caps_ref (fragment->priv->caps);
+  if (fragment->priv->caps == NULL) {
+    if (fragment->priv->streaming)
+      fragment->priv->caps = gst_fragment_typefind_chunks (fragment);
+    else
+      fragment->priv->caps =
+          gst_type_find_helper_for_buffer (NULL, fragment->priv->buffer, NULL);
+  }
+  caps = fragment->priv->caps;
+  if (caps != NULL)
+    gst_caps_ref (caps);
+  g_mutex_unlock (&fragment->priv->lock);
+
+  return caps;
+}
+
+void
+gst_fragment_set_streaming (GstFragment * fragment, gboolean streaming)
+{
+  g_return_if_fail (fragment != NULL);
+
+  fragment->priv->streaming = streaming;
+}
+
+gboolean
+gst_fragment_is_streaming (GstFragment * fragment)
+{
+  g_return_val_if_fail (fragment != NULL, FALSE);
+
+  return fragment->priv->streaming;
+}
+
+/* Returns the next buffer of a streamed fragment, waiting until one is
+ * received. Returns NULL when there are no more buffers, in which case the
+ * download was aborted unless the fragment is completed */
+GstBuffer *
+gst_fragment_pop_buffer (GstFragment * fragment)
+{
+  GstFragmentPrivate *priv;
+  GstBuffer *buf;
+
+  g_return_val_if_fail (fragment != NULL, NULL);
+
+  priv = fragment->priv;
+  g_mutex_lock (&priv->lock);
+  while (g_queue_is_empty (priv->chunks) && !fragment->completed
+      && !priv->aborted)
+    g_cond_wait (&priv->cond, &priv->lock);
+  buf = g_queue_pop_head (priv->chunks);
+  g_mutex_unlock (&priv->lock);
+
+  return buf;
+}
+
+void
+gst_fragment_complete (GstFragment * fragment)
+{
+  g_return_if_fail (fragment != NULL);
+
+  g_mutex_lock (&fragment->priv->lock);
+  fragment->completed = TRUE;
+  g_cond_broadcast (&fragment->priv->cond);
   g_mutex_unlock (&fragment->priv->lock);
+}
+
+void
+gst_fragment_abort (GstFragment * fragment)
+{
+  GstFragmentPrivate *priv;
+
+  g_return_if_fail (fragment != NULL);
 
-  return fragment->priv->caps;
+  priv = fragment->priv;
+  g_mutex_lock (&priv->lock);
+  priv->aborted = TRUE;
+  while (!g_queue_is_empty (priv->chunks))
+    gst_buffer_unref (g_queue_pop_head (priv->chunks));
+  g_cond_broadcast (&priv->cond);
+  g_mutex_unlock (&priv->lock);
 }
 
 gboolean
@@ -255,10 +383,18 @@ gst_fragment_add_buffer (GstFragment * fragment, GstBuffer * buffer)
   }
 
   GST_DEBUG ("Adding new buffer to the fragment");
+  fragment->size += gst_buffer_get_size (buffer);
+
   /* We steal the buffers you pass in */
-  if (fragment->priv->buffer == NULL)
+  if (fragment->priv->streaming) {
+    g_mutex_lock (&fragment->priv->lock);
+    g_queue_push_tail (fragment->priv->chunks, buffer);
+    g_cond_broadcast (&fragment->priv->cond);
+    g_mutex_unlock (&fragment->priv->lock);
+  } else if (fragment->priv->buffer == NULL) {
     fragment->priv->buffer = buffer;
-  else
+  } else {
     fragment->priv->buffer = gst_buffer_append (fragment->priv->buffer, buffer);
+  }
   return TRUE;
 }
@@ -49,6 +49,7 @@ struct _GstFragment
   guint64 stop_time;            /* Stop time of the fragment */
   gboolean index;               /* Index of the fragment */
   gboolean discontinuous;       /* Whether this fragment is discontinuous or not */
+  guint64 size;                 /* Number of bytes downloaded */
 
   GstFragmentPrivate *priv;
 };
@@ -65,6 +66,11 @@ void gst_fragment_set_caps (GstFragment * fragment, GstCaps * caps);
 GstCaps * gst_fragment_get_caps (GstFragment * fragment);
 gboolean gst_fragment_add_buffer (GstFragment *fragment, GstBuffer *buffer);
 GstFragment * gst_fragment_new (void);
+void gst_fragment_set_streaming (GstFragment * fragment, gboolean streaming);
+gboolean gst_fragment_is_streaming (GstFragment * fragment);
+GstBuffer * gst_fragment_pop_buffer (GstFragment * fragment);
+void gst_fragment_complete (GstFragment * fragment);
+void gst_fragment_abort (GstFragment * fragment);
 
 G_END_DECLS
 #endif /* __GSTFRAGMENT_H__ */
@@ -0,0 +1,152 @@
+/* GStreamer
+ *
+ * gsthlsadaptation.c:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <math.h>
+#include "gstfragmented.h"
+#include "gsthlsadaptation.h"
+
+#define GST_CAT_DEFAULT fragmented_debug
+
+/* Half-lives of the moving averages, in seconds of transfer time */
+#define FAST_HALF_LIFE 2.0
+#define SLOW_HALF_LIFE 5.0
+
+/* Downloads smaller than this mostly measure the request latency */
+#define MIN_SAMPLE_BYTES 16384
+
+GType
+gst_hls_adaptation_algorithm_get_type (void)
+{
+  static GType algorithm_type = 0;
+
+  if (!algorithm_type) {
+    static GEnumValue algorithms[] = {
+      {GST_HLS_ADAPTATION_EWMA, "Exponentially weighted moving average",
+          "ewma"},
+      {GST_HLS_ADAPTATION_HARMONIC_MEAN, "Harmonic mean of the last samples",
+          "harmonic-mean"},
+      {0, NULL, NULL},
+    };
+
+    algorithm_type = g_enum_register_static ("GstHLSAdaptationAlgorithm",
+        algorithms);
+  }
+
+  return algorithm_type;
+}
+
+void
+gst_hls_adaptation_init (GstHLSAdaptation * adaptation,
+    GstHLSAdaptationAlgorithm algorithm)
+{
+  adaptation->algorithm = algorithm;
+  gst_hls_adaptation_reset (adaptation);
+}
+
+void
+gst_hls_adaptation_reset (GstHLSAdaptation * adaptation)
+{
+  adaptation->fast_estimate = 0;
+  adaptation->slow_estimate = 0;
+  adaptation->total_weight = 0;
+  adaptation->n_samples = 0;
+}
+
+static void
+update_ewma (gdouble * estimate, gdouble half_life, gdouble weight,
+    gdouble value)
+{
+  gdouble alpha = pow (0.5, weight / half_life);
+
+  *estimate = value * (1 - alpha) + alpha * *estimate;
+}
+
+/* The averages start at 0, compensate for it until enough samples were
+ * added */
+static gdouble
+get_ewma (gdouble estimate, gdouble half_life, gdouble total_weight)
+{
+  return estimate / (1 - pow (0.5, total_weight / half_life));
+}
+
+void
+gst_hls_adaptation_add_sample (GstHLSAdaptation * adaptation,
+    guint64 bytes, GstClockTime transfer_time)
+{
+  gdouble seconds, bitrate;
+
+  if (bytes < MIN_SAMPLE_BYTES || transfer_time == 0
+      || !GST_CLOCK_TIME_IS_VALID (transfer_time))
+    return;
+
+  seconds = (gdouble) transfer_time / GST_SECOND;
+  bitrate = bytes * 8 / seconds;
+
+  GST_DEBUG ("Downloaded %" G_GUINT64_FORMAT " bytes in %" GST_TIME_FORMAT
+      ": %.0f bps", bytes, GST_TIME_ARGS (transfer_time), bitrate);
+
+  update_ewma (&adaptation->fast_estimate, FAST_HALF_LIFE, seconds, bitrate);
+  update_ewma (&adaptation->slow_estimate, SLOW_HALF_LIFE, seconds, bitrate);
+  adaptation->total_weight += seconds;
+
+  adaptation->samples[adaptation->n_samples % GST_HLS_ADAPTATION_WINDOW] =
+      bitrate;
+  adaptation->n_samples++;
+}
+
+/* Returns the estimated bandwidth in bits per second, or 0 if there are no
+ * samples yet */
+guint
+gst_hls_adaptation_get_bandwidth (GstHLSAdaptation * adaptation)
+{
+  gdouble bandwidth = 0;
+  guint i, n;
+
+  if (adaptation->n_samples == 0)
+    return 0;
+
+  switch (adaptation->algorithm) {
+    case GST_HLS_ADAPTATION_EWMA:
+    {
+      gdouble fast, slow;
+
+      /* Take the lowest one: react quickly to drops and slowly to raises */
+      fast = get_ewma (adaptation->fast_estimate, FAST_HALF_LIFE,
+          adaptation->total_weight);
+      slow = get_ewma (adaptation->slow_estimate, SLOW_HALF_LIFE,
+          adaptation->total_weight);
+      bandwidth = MIN (fast, slow);
+      break;
+    }
+    case GST_HLS_ADAPTATION_HARMONIC_MEAN:
+    {
+      gdouble sum = 0;
+
+      /* Dominated by the slow samples, so it filters out bursts */
+      n = MIN (adaptation->n_samples, GST_HLS_ADAPTATION_WINDOW);
+      for (i = 0; i < n; i++)
+        sum += 1 / adaptation->samples[i];
+      bandwidth = n / sum;
+      break;
+    }
+  }
+
+  return (guint) MIN (bandwidth, G_MAXUINT);
+}
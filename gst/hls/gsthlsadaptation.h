@@ -0,0 +1,67 @@
+/* GStreamer
+ *
+ * gsthlsadaptation.h:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __GST_HLS_ADAPTATION_H__
+#define __GST_HLS_ADAPTATION_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_HLS_ADAPTATION_ALGORITHM (gst_hls_adaptation_algorithm_get_type())
+
+/* Number of samples used by the harmonic mean estimator */
+#define GST_HLS_ADAPTATION_WINDOW 5
+
+typedef enum
+{
+  GST_HLS_ADAPTATION_EWMA,
+  GST_HLS_ADAPTATION_HARMONIC_MEAN
+} GstHLSAdaptationAlgorithm;
+
+typedef struct _GstHLSAdaptation GstHLSAdaptation;
+
+/* Estimates the available bandwidth from the measured fragment downloads */
+struct _GstHLSAdaptation
+{
+  GstHLSAdaptationAlgorithm algorithm;
+
+  /* EWMA: a fast and a slow moving average, in bits per second, weighted
+   * by the transfer time in seconds */
+  gdouble fast_estimate;
+  gdouble slow_estimate;
+  gdouble total_weight;
+
+  /* Harmonic mean: ring of the last samples, in bits per second */
+  gdouble samples[GST_HLS_ADAPTATION_WINDOW];
+  guint n_samples;
+};
+
+GType gst_hls_adaptation_algorithm_get_type (void);
+
+void gst_hls_adaptation_init (GstHLSAdaptation * adaptation,
+    GstHLSAdaptationAlgorithm algorithm);
+void gst_hls_adaptation_reset (GstHLSAdaptation * adaptation);
+void gst_hls_adaptation_add_sample (GstHLSAdaptation * adaptation,
+    guint64 bytes, GstClockTime transfer_time);
+guint gst_hls_adaptation_get_bandwidth (GstHLSAdaptation * adaptation);
+
+G_END_DECLS
+#endif /* __GST_HLS_ADAPTATION_H__ */
@@ -69,6 +69,10 @@ enum
   PROP_FRAGMENTS_CACHE,
   PROP_BITRATE_LIMIT,
   PROP_CONNECTION_SPEED,
+  PROP_MAX_DOWNLOADS,
+  PROP_ADAPTATION_ALGORITHM,
+  PROP_BANDWIDTH_ESTIMATE,
+  PROP_STREAM_FRAGMENTS,
   PROP_LAST
 };
 
@@ -78,6 +82,24 @@ static const float update_interval_factor[] = { 1, 0.5, 1.5, 3 };
 #define DEFAULT_FAILED_COUNT 3
 #define DEFAULT_BITRATE_LIMIT 0.8
 #define DEFAULT_CONNECTION_SPEED    0
+#define DEFAULT_MAX_DOWNLOADS 2
+#define DEFAULT_ADAPTATION_ALGORITHM GST_HLS_ADAPTATION_EWMA
+#define DEFAULT_STREAM_FRAGMENTS FALSE
+
+/* Number of consecutive estimations above the next variant's bitrate needed
+ * before switching up */
+#define UPSWITCH_ESTIMATIONS 2
+
+/* A fragment download handled by one of the download workers */
+typedef struct
+{
+  gchar *uri;
+  GstFragment *fragment;
+
+  /* Set by the worker, protected by the download lock */
+  gboolean success;
+  gboolean done;
+} GstHLSDemuxDownload;
 
 /* GObject */
 static void gst_hls_demux_set_property (GObject * object, guint prop_id,
@@ -105,8 +127,11 @@ static void gst_hls_demux_stop (GstHLSDemux * demux);
 static gboolean gst_hls_demux_cache_fragments (GstHLSDemux * demux);
 static gboolean gst_hls_demux_schedule (GstHLSDemux * demux);
 static gboolean gst_hls_demux_switch_playlist (GstHLSDemux * demux);
-static gboolean gst_hls_demux_get_next_fragment (GstHLSDemux * demux,
-    gboolean caching);
+static void gst_hls_demux_start_downloads (GstHLSDemux * demux);
+static void gst_hls_demux_download_func (GstHLSDemuxDownload * download,
+    GstHLSDemux * demux);
+static void gst_hls_demux_cancel_downloads (GstHLSDemux * demux);
+static void gst_hls_demux_drop_downloads (GstHLSDemux * demux);
 static gboolean gst_hls_demux_update_playlist (GstHLSDemux * demux,
     gboolean update);
 static void gst_hls_demux_reset (GstHLSDemux * demux, gboolean dispose);
@@ -145,6 +170,18 @@ gst_hls_demux_dispose (GObject * obj)
     demux->updates_task = NULL;
   }
 
+  if (demux->download_pool) {
+    demux->cancelled = TRUE;
+    gst_hls_demux_drop_downloads (demux);
+    g_thread_pool_free (demux->download_pool, FALSE, TRUE);
+    demux->download_pool = NULL;
+    g_queue_free (demux->downloads);
+    g_async_queue_unref (demux->idle_downloaders);
+    g_ptr_array_free (demux->downloaders, TRUE);
+    g_mutex_clear (&demux->download_lock);
+    g_cond_clear (&demux->download_cond);
+  }
+
   if (demux->downloader != NULL) {
     g_object_unref (demux->downloader);
     demux->downloader = NULL;
@@ -189,6 +226,29 @@ gst_hls_demux_class_init (GstHLSDemuxClass * klass)
           0, G_MAXUINT / 1000, DEFAULT_CONNECTION_SPEED,
           G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
+  g_object_class_install_property (gobject_class, PROP_MAX_DOWNLOADS,
+      g_param_spec_uint ("max-downloads", "Maximum downloads",
+          "Maximum number of fragments downloaded in parallel",
+          1, 16, DEFAULT_MAX_DOWNLOADS,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_ADAPTATION_ALGORITHM,
+      g_param_spec_enum ("adaptation-algorithm", "Adaptation algorithm",
+          "Algorithm used to estimate the available bandwidth",
+          GST_TYPE_HLS_ADAPTATION_ALGORITHM, DEFAULT_ADAPTATION_ALGORITHM,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_STREAM_FRAGMENTS,
+      g_param_spec_boolean ("stream-fragments", "Stream fragments",
+          "Push the fragments downstream while they are downloaded instead "
+          "of caching them completely", DEFAULT_STREAM_FRAGMENTS,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_BANDWIDTH_ESTIMATE,
+      g_param_spec_uint ("bandwidth-estimate", "Bandwidth estimate",
+          "Estimated available bandwidth in bps (0 = unknown)",
+          0, G_MAXUINT, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
   element_class->change_state = GST_DEBUG_FUNCPTR (gst_hls_demux_change_state);
 
   gst_element_class_add_pad_template (element_class,
@@ -222,12 +282,25 @@ gst_hls_demux_init (GstHLSDemux * demux)
   /* Downloader */
   demux->downloader = gst_uri_downloader_new ();
 
+  /* Fragment downloaders, created on demand */
+  demux->downloaders = g_ptr_array_new_with_free_func (g_object_unref);
+  demux->downloads = g_queue_new ();
+  demux->idle_downloaders = g_async_queue_new ();
+  g_mutex_init (&demux->download_lock);
+  g_cond_init (&demux->download_cond);
+  demux->download_pool =
+      g_thread_pool_new ((GFunc) gst_hls_demux_download_func, demux,
+      DEFAULT_MAX_DOWNLOADS, FALSE, NULL);
+
   demux->do_typefind = TRUE;
 
   /* Properties */
   demux->fragments_cache = DEFAULT_FRAGMENTS_CACHE;
   demux->bitrate_limit = DEFAULT_BITRATE_LIMIT;
   demux->connection_speed = DEFAULT_CONNECTION_SPEED;
+  demux->max_downloads = DEFAULT_MAX_DOWNLOADS;
+  gst_hls_adaptation_init (&demux->adaptation, DEFAULT_ADAPTATION_ALGORITHM);
+  demux->stream_fragments = DEFAULT_STREAM_FRAGMENTS;
 
   demux->queue = g_queue_new ();
 
@@ -261,6 +334,19 @@ gst_hls_demux_set_property (GObject * object, guint prop_id,
     case PROP_CONNECTION_SPEED:
       demux->connection_speed = g_value_get_uint (value) * 1000;
       break;
+    case PROP_MAX_DOWNLOADS:
+      demux->max_downloads = g_value_get_uint (value);
+      g_thread_pool_set_max_threads (demux->download_pool,
+          demux->max_downloads, NULL);
+      break;
+    case PROP_STREAM_FRAGMENTS:
+      demux->stream_fragments = g_value_get_boolean (value);
+      break;
+    case PROP_ADAPTATION_ALGORITHM:
+      GST_OBJECT_LOCK (demux);
+      gst_hls_adaptation_init (&demux->adaptation, g_value_get_enum (value));
+      GST_OBJECT_UNLOCK (demux);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -283,6 +369,21 @@ gst_hls_demux_get_property (GObject * object, guint prop_id, GValue * value,
     case PROP_CONNECTION_SPEED:
       g_value_set_uint (value, demux->connection_speed / 1000);
       break;
+    case PROP_MAX_DOWNLOADS:
+      g_value_set_uint (value, demux->max_downloads);
+      break;
+    case PROP_STREAM_FRAGMENTS:
+      g_value_set_boolean (value, demux->stream_fragments);
+      break;
+    case PROP_ADAPTATION_ALGORITHM:
+      g_value_set_enum (value, demux->adaptation.algorithm);
+      break;
+    case PROP_BANDWIDTH_ESTIMATE:
+      GST_OBJECT_LOCK (demux);
+      g_value_set_uint (value,
+          gst_hls_adaptation_get_bandwidth (&demux->adaptation));
+      GST_OBJECT_UNLOCK (demux);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -321,6 +422,7 @@ gst_hls_demux_change_state (GstElement * element, GstStateChange transition)
       demux->cancelled = TRUE;
       gst_hls_demux_stop (demux);
       gst_task_join (demux->stream_task);
+      gst_hls_demux_drop_downloads (demux);
       gst_hls_demux_reset (demux, FALSE);
       break;
     default:
@@ -395,19 +497,24 @@ gst_hls_demux_src_event (GstPad * pad, GstObject * parent, GstEvent * event)
 
       demux->cancelled = TRUE;
       gst_task_pause (demux->stream_task);
-      gst_uri_downloader_cancel (demux->downloader);
+      gst_hls_demux_cancel_downloads (demux);
       gst_task_stop (demux->updates_task);
       gst_task_pause (demux->stream_task);
 
       /* wait for streaming to finish */
       g_rec_mutex_lock (&demux->stream_lock);
+      gst_hls_demux_drop_downloads (demux);
 
       demux->need_cache = TRUE;
+      demux->end_of_playlist = FALSE;
       while (!g_queue_is_empty (demux->queue)) {
         GstFragment *fragment = g_queue_pop_head (demux->queue);
         g_object_unref (fragment);
       }
       g_queue_clear (demux->queue);
+      GST_OBJECT_LOCK (demux);
+      demux->queued_duration = 0;
+      GST_OBJECT_UNLOCK (demux);
 
       GST_M3U8_CLIENT_LOCK (demux->client);
       GST_DEBUG_OBJECT (demux, "seeking to sequence %d", current_sequence);
@@ -586,7 +693,7 @@ gst_hls_demux_chain (GstPad * pad, GstObject * parent, GstBuffer * buf)
 static void
 gst_hls_demux_stop (GstHLSDemux * demux)
 {
-  gst_uri_downloader_cancel (demux->downloader);
+  gst_hls_demux_cancel_downloads (demux);
 
   if (GST_TASK_STATE (demux->updates_task) != GST_TASK_STOPPED) {
     demux->stop_stream_task = TRUE;
@@ -635,6 +742,30 @@ switch_pads (GstHLSDemux * demux, GstCaps * newcaps)
   }
 }
 
+/* Push the buffers of a streamed fragment while it is downloaded */
+static GstFlowReturn
+gst_hls_demux_push_chunks (GstHLSDemux * demux, GstFragment * fragment)
+{
+  GstFlowReturn ret = GST_FLOW_OK;
+  gboolean first = TRUE;
+  GstBuffer *buf;
+
+  while (ret == GST_FLOW_OK && (buf = gst_fragment_pop_buffer (fragment))) {
+    if (first) {
+      buf = gst_buffer_make_writable (buf);
+      GST_BUFFER_PTS (buf) = fragment->start_time;
+      if (fragment->discontinuous) {
+        GST_DEBUG_OBJECT (demux, "Marking fragment as discontinuous");
+        GST_BUFFER_FLAG_SET (buf, GST_BUFFER_FLAG_DISCONT);
+      }
+      first = FALSE;
+    }
+    ret = gst_pad_push (demux->srcpad, buf);
+  }
+
+  return ret;
+}
+
 static void
 gst_hls_demux_stream_loop (GstHLSDemux * demux)
 {
@@ -659,20 +790,36 @@ gst_hls_demux_stream_loop (GstHLSDemux * demux)
     GST_INFO_OBJECT (demux, "First fragments cached successfully");
   }
 
+  g_mutex_lock (&demux->download_lock);
   if (g_queue_is_empty (demux->queue)) {
-    if (demux->end_of_playlist)
+    if (demux->end_of_playlist && g_queue_is_empty (demux->downloads)) {
+      g_mutex_unlock (&demux->download_lock);
       goto end_of_playlist;
+    }
 
-    goto pause_task;
+    /* Paused with the download lock held, so that a fragment queued
+     * meanwhile by the download workers starts the task again */
+    gst_task_pause (demux->stream_task);
+    g_mutex_unlock (&demux->download_lock);
+    return;
   }
 
   fragment = g_queue_pop_head (demux->queue);
-  buf = gst_fragment_get_buffer (fragment);
+  gst_hls_demux_start_downloads (demux);
+  g_mutex_unlock (&demux->download_lock);
+
+  GST_OBJECT_LOCK (demux);
+  demux->queued_duration -= MIN (demux->queued_duration,
+      fragment->stop_time - fragment->start_time);
+  GST_OBJECT_UNLOCK (demux);
 
-  /* Figure out if we need to create/switch pads */
+  /* Figure out if we need to create/switch pads. Streamed fragments are
+   * typefound as soon as enough data was received */
+  bufcaps = gst_fragment_get_caps (fragment);
+  if (G_UNLIKELY (bufcaps == NULL))
+    goto download_error;
   if (G_LIKELY (demux->srcpad))
     srccaps = gst_pad_get_current_caps (demux->srcpad);
-  bufcaps = gst_fragment_get_caps (fragment);
   if (G_UNLIKELY (!srccaps || !gst_caps_is_equal_fixed (bufcaps, srccaps)
           || demux->need_segment)) {
     switch_pads (demux, bufcaps);
@@ -681,11 +828,10 @@ gst_hls_demux_stream_loop (GstHLSDemux * demux)
   gst_caps_unref (bufcaps);
   if (G_LIKELY (srccaps))
     gst_caps_unref (srccaps);
-  g_object_unref (fragment);
 
   if (demux->need_segment) {
     GstSegment segment;
-    GstClockTime start = GST_BUFFER_PTS (buf);
+    GstClockTime start = fragment->start_time;
 
     start += demux->position_shift;
     /* And send a newsegment */
@@ -699,9 +845,19 @@ gst_hls_demux_stream_loop (GstHLSDemux * demux)
     demux->position_shift = 0;
   }
 
-  ret = gst_pad_push (demux->srcpad, buf);
-  if (ret != GST_FLOW_OK)
+  if (gst_fragment_is_streaming (fragment)) {
+    ret = gst_hls_demux_push_chunks (demux, fragment);
+  } else {
+    buf = gst_fragment_get_buffer (fragment);
+    ret = gst_pad_push (demux->srcpad, buf);
+  }
+  if (ret != GST_FLOW_OK) {
+    g_object_unref (fragment);
     goto error_pushing;
+  }
+  if (!fragment->completed)
+    goto download_error;
+  g_object_unref (fragment);
 
   return;
 
@@ -724,6 +880,18 @@ cache_error:
     return;
   }
 
+download_error:
+  {
+    g_object_unref (fragment);
+    gst_task_pause (demux->stream_task);
+    if (!demux->cancelled) {
+      GST_ELEMENT_ERROR (demux, RESOURCE, NOT_FOUND,
+          ("Could not fetch the next fragment"), (NULL));
+      gst_hls_demux_stop (demux);
+    }
+    return;
+  }
+
 error_pushing:
   {
     /* FIXME: handle error */
@@ -732,12 +900,6 @@ error_pushing:
     gst_hls_demux_stop (demux);
     return;
   }
-
-pause_task:
-  {
-    gst_task_pause (demux->stream_task);
-    return;
-  }
 }
 
 static void
@@ -773,6 +935,13 @@ gst_hls_demux_reset (GstHLSDemux * demux, gboolean dispose)
   }
   g_queue_clear (demux->queue);
 
+  GST_OBJECT_LOCK (demux);
+  gst_hls_adaptation_reset (&demux->adaptation);
+  demux->queued_duration = 0;
+  GST_OBJECT_UNLOCK (demux);
+  demux->upswitch_count = 0;
+  demux->last_download_time = 0;
+
   demux->position_shift = 0;
   demux->need_segment = TRUE;
 }
@@ -834,27 +1003,15 @@ gst_hls_demux_updates_loop (GstHLSDemux * demux)
       continue;
     }
 
-    /* fetch the next fragment */
-    if (g_queue_is_empty (demux->queue)) {
-      if (!gst_hls_demux_get_next_fragment (demux, FALSE)) {
-        if (!demux->end_of_playlist && !demux->cancelled) {
-          demux->client->update_failed_count++;
-          if (demux->client->update_failed_count < DEFAULT_FAILED_COUNT) {
-            GST_WARNING_OBJECT (demux, "Could not fetch the next fragment");
-            continue;
-          } else {
-            GST_ELEMENT_ERROR (demux, RESOURCE, NOT_FOUND,
-                ("Could not fetch the next fragment"), (NULL));
-            goto quit;
-          }
-        }
-      } else {
-        demux->client->update_failed_count = 0;
+    /* fetch the fragments added to the playlist. The download workers
+     * fetch the next ones as they go idle, so this doesn't wait for them
+     * and the next update stays on time */
+    g_mutex_lock (&demux->download_lock);
+    gst_hls_demux_start_downloads (demux);
+    g_mutex_unlock (&demux->download_lock);
 
-        /* try to switch to another bitrate if needed */
-        gst_hls_demux_switch_playlist (demux);
-      }
-    }
+    /* try to switch to another bitrate if needed */
+    gst_hls_demux_switch_playlist (demux);
   }
 
 quit:
@@ -868,7 +1025,7 @@ quit:
 static gboolean
 gst_hls_demux_cache_fragments (GstHLSDemux * demux)
 {
-  gint i;
+  guint cached, reported = G_MAXUINT, cache_size;
 
   /* If this playlist is a variant playlist, select the first one
    * and update it */
@@ -905,24 +1062,32 @@ gst_hls_demux_cache_fragments (GstHLSDemux * demux)
           gst_message_new_duration_changed (GST_OBJECT (demux)));
   }
 
-  /* Cache the first fragments */
-  for (i = 0; i < demux->fragments_cache; i++) {
-    gst_element_post_message (GST_ELEMENT (demux),
-        gst_message_new_buffering (GST_OBJECT (demux),
-            100 * i / demux->fragments_cache));
-    g_get_current_time (&demux->next_update);
-    if (!gst_hls_demux_get_next_fragment (demux, TRUE)) {
-      if (demux->end_of_playlist)
-        break;
-      if (!demux->cancelled)
-        GST_ERROR_OBJECT (demux, "Error caching the first fragments");
-      return FALSE;
+  /* Cache the first fragments, fetching up to max-downloads of them at
+   * the same time. Streamed fragments are pushed while they are downloaded,
+   * so only the first ones are waited for */
+  cache_size = demux->stream_fragments ? demux->max_downloads :
+      demux->fragments_cache;
+  g_mutex_lock (&demux->download_lock);
+  gst_hls_demux_start_downloads (demux);
+  while (!demux->cancelled && !g_queue_is_empty (demux->downloads)
+      && (cached = g_queue_get_length (demux->queue)) < cache_size) {
+    if (cached != reported) {
+      g_mutex_unlock (&demux->download_lock);
+      gst_element_post_message (GST_ELEMENT (demux),
+          gst_message_new_buffering (GST_OBJECT (demux),
+              100 * cached / cache_size));
+      gst_hls_demux_switch_playlist (demux);
+      g_mutex_lock (&demux->download_lock);
+      reported = cached;
+      continue;
     }
-    /* make sure we stop caching fragments if something cancelled it */
-    if (demux->cancelled)
-      return FALSE;
-    gst_hls_demux_switch_playlist (demux);
+    g_cond_wait (&demux->download_cond, &demux->download_lock);
   }
+  g_mutex_unlock (&demux->download_lock);
+
+  /* make sure we stop caching fragments if something cancelled it */
+  if (demux->cancelled)
+    return FALSE;
   gst_element_post_message (GST_ELEMENT (demux),
       gst_message_new_buffering (GST_OBJECT (demux), 100));
 
@@ -1109,96 +1274,320 @@ gst_hls_demux_schedule (GstHLSDemux * demux)
 static gboolean
 gst_hls_demux_switch_playlist (GstHLSDemux * demux)
 {
-  GTimeVal now;
-  GstClockTime diff;
-  gsize size;
-  gint bitrate;
-  GstFragment *fragment = g_queue_peek_tail (demux->queue);
-  GstBuffer *buffer;
+  GList *current_variant, *next_variant;
+  GstClockTime buffer_level, low_watermark;
+  guint bandwidth, max_bitrate;
+  guint current_bandwidth, next_bandwidth;
+  gboolean buffer_low;
+  GstStructure *s;
 
   GST_M3U8_CLIENT_LOCK (demux->client);
   if (!demux->client->main->lists) {
     GST_M3U8_CLIENT_UNLOCK (demux->client);
     return TRUE;
   }
+  current_variant = demux->client->main->current_variant;
+  next_variant = g_list_next (current_variant);
+  current_bandwidth = GST_M3U8 (current_variant->data)->bandwidth;
+  next_bandwidth = next_variant ? GST_M3U8 (next_variant->data)->bandwidth : 0;
+  low_watermark = GST_M3U8 (current_variant->data)->targetduration;
   GST_M3U8_CLIENT_UNLOCK (demux->client);
 
-  /* compare the time when the fragment was downloaded with the time when it was
-   * scheduled */
-  g_get_current_time (&now);
-  diff = (GST_TIMEVAL_TO_TIME (now) - GST_TIMEVAL_TO_TIME (demux->next_update));
-  buffer = gst_fragment_get_buffer (fragment);
-  size = gst_buffer_get_size (buffer);
-  bitrate = (size * 8) / ((double) diff / GST_SECOND);
+  GST_OBJECT_LOCK (demux);
+  bandwidth = gst_hls_adaptation_get_bandwidth (&demux->adaptation);
+  buffer_level = demux->queued_duration;
+  GST_OBJECT_UNLOCK (demux);
+
+  /* No measurement yet */
+  if (bandwidth == 0)
+    return TRUE;
+
+  max_bitrate = bandwidth * demux->bitrate_limit;
+  buffer_low = buffer_level < low_watermark;
+
+  GST_DEBUG_OBJECT (demux, "Estimated bandwidth is %u bps, buffer level is %"
+      GST_TIME_FORMAT, bandwidth, GST_TIME_ARGS (buffer_level));
 
-  GST_DEBUG ("Downloaded %d bytes in %" GST_TIME_FORMAT ". Bitrate is : %d",
-      (guint) size, GST_TIME_ARGS (diff), bitrate);
+  s = gst_structure_new ("hls-adaptation",
+      "bandwidth", G_TYPE_UINT, bandwidth,
+      "buffer-level", G_TYPE_UINT64, buffer_level,
+      "bitrate", G_TYPE_UINT, current_bandwidth, NULL);
+  gst_element_post_message (GST_ELEMENT_CAST (demux),
+      gst_message_new_element (GST_OBJECT_CAST (demux), s));
 
-  gst_buffer_unref (buffer);
-  return gst_hls_demux_change_playlist (demux, bitrate * demux->bitrate_limit);
+  if (max_bitrate < current_bandwidth) {
+    demux->upswitch_count = 0;
+    /* Only the safety margin is exceeded and there is enough data queued:
+     * stay on this variant instead of oscillating around it */
+    if (!buffer_low && bandwidth >= current_bandwidth)
+      return TRUE;
+  } else {
+    /* Switch up only after a few estimations allowing it and with enough
+     * data queued to survive a bad estimation */
+    if (next_bandwidth == 0 || max_bitrate < next_bandwidth || buffer_low) {
+      demux->upswitch_count = 0;
+      return TRUE;
+    }
+    if (++demux->upswitch_count < UPSWITCH_ESTIMATIONS)
+      return TRUE;
+    demux->upswitch_count = 0;
+  }
+
+  return gst_hls_demux_change_playlist (demux, max_bitrate);
 }
 
-static gboolean
-gst_hls_demux_get_next_fragment (GstHLSDemux * demux, gboolean caching)
+static void
+gst_hls_demux_cancel_downloads (GstHLSDemux * demux)
 {
-  GstFragment *download;
-  const gchar *next_fragment_uri;
-  GstClockTime duration;
-  GstClockTime timestamp;
-  GstBuffer *buf;
-  gboolean discont;
+  guint i;
 
-  if (!gst_m3u8_client_get_next_fragment (demux->client, &discont,
-          &next_fragment_uri, &duration, &timestamp)) {
-    GST_INFO_OBJECT (demux, "This playlist doesn't contain more fragments");
-    demux->end_of_playlist = TRUE;
-    gst_task_start (demux->stream_task);
-    return FALSE;
-  }
+  gst_uri_downloader_cancel (demux->downloader);
 
-  GST_INFO_OBJECT (demux, "Fetching next fragment %s", next_fragment_uri);
+  g_mutex_lock (&demux->download_lock);
+  for (i = 0; i < demux->downloaders->len; i++)
+    gst_uri_downloader_cancel (g_ptr_array_index (demux->downloaders, i));
+  g_mutex_unlock (&demux->download_lock);
+}
 
-  download = gst_uri_downloader_fetch_uri (demux->downloader,
-      next_fragment_uri);
+static void
+gst_hls_demux_download_free (GstHLSDemuxDownload * download)
+{
+  g_object_unref (download->fragment);
+  g_free (download->uri);
+  g_free (download);
+}
 
-  if (download == NULL)
-    goto error;
+/* Called with the download lock */
+static void
+gst_hls_demux_queue_fragment (GstHLSDemux * demux, GstFragment * fragment)
+{
+  GstClockTime duration = fragment->stop_time - fragment->start_time;
+
+  /* Streamed fragments are typefound and flagged by the streaming task as
+   * their data is received, and failed downloads are reported by it */
+  if (!gst_fragment_is_streaming (fragment) && fragment->completed) {
+    GstBuffer *buf = gst_fragment_get_buffer (fragment);
+
+    GST_BUFFER_DURATION (buf) = duration;
+    GST_BUFFER_PTS (buf) = fragment->start_time;
+
+    /* We actually need to do this every time we switch bitrate */
+    if (G_UNLIKELY (demux->do_typefind)) {
+      GstCaps *caps = gst_fragment_get_caps (fragment);
+
+      if (!demux->input_caps || !gst_caps_is_equal (caps, demux->input_caps)) {
+        gst_caps_replace (&demux->input_caps, caps);
+        /* gst_pad_set_caps (demux->srcpad, demux->input_caps); */
+        GST_INFO_OBJECT (demux, "Input source caps: %" GST_PTR_FORMAT,
+            demux->input_caps);
+        demux->do_typefind = FALSE;
+      }
+      gst_caps_unref (caps);
+    } else {
+      gst_fragment_set_caps (fragment, demux->input_caps);
+    }
 
-  buf = gst_fragment_get_buffer (download);
-  GST_BUFFER_DURATION (buf) = duration;
-  GST_BUFFER_PTS (buf) = timestamp;
-
-  /* We actually need to do this every time we switch bitrate */
-  if (G_UNLIKELY (demux->do_typefind)) {
-    GstCaps *caps = gst_fragment_get_caps (download);
-
-    if (!demux->input_caps || !gst_caps_is_equal (caps, demux->input_caps)) {
-      gst_caps_replace (&demux->input_caps, caps);
-      /* gst_pad_set_caps (demux->srcpad, demux->input_caps); */
-      GST_INFO_OBJECT (demux, "Input source caps: %" GST_PTR_FORMAT,
-          demux->input_caps);
-      demux->do_typefind = FALSE;
+    if (fragment->discontinuous) {
+      GST_DEBUG_OBJECT (demux, "Marking fragment as discontinuous");
+      GST_BUFFER_FLAG_SET (buf, GST_BUFFER_FLAG_DISCONT);
     }
-    gst_caps_unref (caps);
-  } else {
-    gst_fragment_set_caps (download, demux->input_caps);
+    gst_buffer_unref (buf);
   }
 
-  if (discont) {
-    GST_DEBUG_OBJECT (demux, "Marking fragment as discontinuous");
-    GST_BUFFER_FLAG_SET (buf, GST_BUFFER_FLAG_DISCONT);
+  GST_OBJECT_LOCK (demux);
+  demux->queued_duration += duration;
+  GST_OBJECT_UNLOCK (demux);
+
+  g_queue_push_tail (demux->queue, g_object_ref (fragment));
+
+  /* Wake up the streaming task if it's waiting for fragments, but don't
+   * start it again if it was stopped */
+  if (GST_TASK_STATE (demux->stream_task) == GST_TASK_PAUSED)
+    gst_task_start (demux->stream_task);
+}
+
+/* Parallel downloads share the bandwidth, so each download is measured from
+ * the end of the previous one, or from its start if it started later.
+ * Called with the download lock */
+static void
+gst_hls_demux_add_sample (GstHLSDemux * demux, GstFragment * fragment)
+{
+  guint64 start_time;
+
+  start_time = MAX (demux->last_download_time, fragment->download_start_time);
+  if (fragment->download_stop_time <= start_time)
+    return;
+
+  GST_OBJECT_LOCK (demux);
+  gst_hls_adaptation_add_sample (&demux->adaptation, fragment->size,
+      fragment->download_stop_time - start_time);
+  GST_OBJECT_UNLOCK (demux);
+
+  demux->last_download_time = fragment->download_stop_time;
+}
+
+/* Queue the fragments that are done downloading, in playlist order. Failed
+ * downloads are queued too, so that the streaming task reports the error
+ * when it reaches them. Called with the download lock */
+static void
+gst_hls_demux_deliver_downloads (GstHLSDemux * demux)
+{
+  GstHLSDemuxDownload *download;
+  gboolean delivered = FALSE;
+
+  while ((download = g_queue_peek_head (demux->downloads)) && download->done) {
+    g_queue_pop_head (demux->downloads);
+
+    /* Streamed fragments were queued when their download started */
+    if (!gst_fragment_is_streaming (download->fragment))
+      gst_hls_demux_queue_fragment (demux, download->fragment);
+    gst_hls_demux_download_free (download);
+    delivered = TRUE;
   }
 
-  g_queue_push_tail (demux->queue, download);
-  if (!caching) {
-    GST_TASK_SIGNAL (demux->updates_task);
+  /* At the end of the playlist, the streaming task waits for the last
+   * downloads before sending EOS */
+  if (delivered && GST_TASK_STATE (demux->stream_task) == GST_TASK_PAUSED)
     gst_task_start (demux->stream_task);
+}
+
+/* Runs in the download pool. Each download uses its own downloader, taken
+ * from the idle downloaders while the download is running. The fragments
+ * are queued from here, and the next one is started as soon as the worker
+ * is done, so nothing else waits for the downloads */
+static void
+gst_hls_demux_download_func (GstHLSDemuxDownload * download,
+    GstHLSDemux * demux)
+{
+  GstUriDownloader *downloader;
+  gboolean success = FALSE;
+
+  downloader = g_async_queue_pop (demux->idle_downloaders);
+  if (!demux->cancelled) {
+    GST_INFO_OBJECT (demux, "Fetching fragment %s", download->uri);
+    success = gst_uri_downloader_fetch_fragment (downloader, download->uri,
+        download->fragment);
   }
-  return TRUE;
+  g_async_queue_push (demux->idle_downloaders, downloader);
+
+  /* Wake up the streaming task if it's waiting for this fragment */
+  if (!success)
+    gst_fragment_abort (download->fragment);
+
+  g_mutex_lock (&demux->download_lock);
+  download->success = success;
+  download->done = TRUE;
+  if (success)
+    gst_hls_demux_add_sample (demux, download->fragment);
+  /* The downloads being dropped are freed by gst_hls_demux_drop_downloads */
+  if (!demux->cancelled) {
+    gst_hls_demux_deliver_downloads (demux);
+    /* This worker is idle now */
+    gst_hls_demux_start_downloads (demux);
+  }
+  g_cond_broadcast (&demux->download_cond);
+  g_mutex_unlock (&demux->download_lock);
+}
 
-error:
-  {
-    gst_hls_demux_stop (demux);
-    return FALSE;
+/* Cancel the pending downloads and wait until the workers are done with
+ * them */
+static void
+gst_hls_demux_drop_downloads (GstHLSDemux * demux)
+{
+  GstHLSDemuxDownload *download;
+
+  gst_hls_demux_cancel_downloads (demux);
+
+  g_mutex_lock (&demux->download_lock);
+  while ((download = g_queue_pop_head (demux->downloads))) {
+    while (!download->done)
+      g_cond_wait (&demux->download_cond, &demux->download_lock);
+    gst_hls_demux_download_free (download);
+  }
+  g_mutex_unlock (&demux->download_lock);
+}
+
+/* Number of fragments downloaded ahead of the streaming task. Streamed
+ * fragments are pushed while they are downloaded, so there is no need to
+ * fetch more of them than can be downloaded at the same time */
+static guint
+gst_hls_demux_get_prefetch_size (GstHLSDemux * demux)
+{
+  if (demux->stream_fragments)
+    return demux->max_downloads;
+
+  return MAX (demux->fragments_cache, demux->max_downloads);
+}
+
+/* Start downloading the next fragments of the playlist while fewer than
+ * max-downloads are running and fewer than the prefetch size are waiting to
+ * be pushed. A fragment is started as soon as a worker is free, without
+ * waiting for the others. The download workers queue the fragments in
+ * playlist order once downloaded or, when streaming them, they are queued as
+ * soon as their download starts. Called with the download lock */
+static void
+gst_hls_demux_start_downloads (GstHLSDemux * demux)
+{
+  GstHLSDemuxDownload *download;
+  GstFragment *fragment;
+  const gchar *next_fragment_uri;
+  GstClockTime duration, timestamp;
+  gboolean discont;
+  guint running = 0, ahead, prefetch_size;
+  GList *l;
+
+  if (demux->cancelled)
+    return;
+
+  /* Streamed fragments are in the queue as soon as they are started */
+  ahead = g_queue_get_length (demux->queue);
+  for (l = demux->downloads->head; l; l = l->next) {
+    download = l->data;
+    if (!download->done)
+      running++;
+    if (!gst_fragment_is_streaming (download->fragment))
+      ahead++;
+  }
+  prefetch_size = gst_hls_demux_get_prefetch_size (demux);
+
+  /* Make sure there is a downloader for each parallel download */
+  while (demux->downloaders->len < demux->max_downloads) {
+    GstUriDownloader *downloader = gst_uri_downloader_new ();
+
+    g_ptr_array_add (demux->downloaders, downloader);
+    g_async_queue_push (demux->idle_downloaders, downloader);
+  }
+
+  /* Claim the fragments in playlist order and start downloading them */
+  while (running < demux->max_downloads && ahead < prefetch_size) {
+    if (!gst_m3u8_client_get_next_fragment (demux->client, &discont,
+            &next_fragment_uri, &duration, &timestamp)) {
+      /* Live playlists get more fragments with the next update */
+      if (!gst_m3u8_client_is_live (demux->client)) {
+        GST_INFO_OBJECT (demux, "This playlist doesn't contain more fragments");
+        demux->end_of_playlist = TRUE;
+        if (GST_TASK_STATE (demux->stream_task) == GST_TASK_PAUSED)
+          gst_task_start (demux->stream_task);
+      }
+      break;
+    }
+
+    fragment = gst_fragment_new ();
+    fragment->start_time = timestamp;
+    fragment->stop_time = timestamp + duration;
+    fragment->discontinuous = discont;
+    gst_fragment_set_streaming (fragment, demux->stream_fragments);
+
+    download = g_new0 (GstHLSDemuxDownload, 1);
+    download->uri = g_strdup (next_fragment_uri);
+    download->fragment = fragment;
+
+    if (gst_fragment_is_streaming (fragment))
+      gst_hls_demux_queue_fragment (demux, fragment);
+    g_queue_push_tail (demux->downloads, download);
+    g_thread_pool_push (demux->download_pool, download, NULL);
+
+    running++;
+    ahead++;
   }
 }
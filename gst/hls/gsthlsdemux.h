@@ -29,6 +29,7 @@
 #include "m3u8.h"
 #include "gstfragmented.h"
 #include "gsturidownloader.h"
+#include "gsthlsadaptation.h"
 
 G_BEGIN_DECLS
 #define GST_TYPE_HLS_DEMUX \
@@ -71,6 +72,22 @@ struct _GstHLSDemux
   guint fragments_cache;        /* number of fragments needed to be cached to start playing */
   gfloat bitrate_limit;         /* limit of the available bitrate to use */
   guint connection_speed;       /* Network connection speed in kbps (0 = unknown) */
+  guint max_downloads;          /* Maximum number of parallel fragment downloads */
+  gboolean stream_fragments;    /* Push the fragments while they are downloaded */
+
+  /* Fragment downloads */
+  GThreadPool *download_pool;
+  GPtrArray *downloaders;       /* All the fragment downloaders */
+  GAsyncQueue *idle_downloaders;        /* Downloaders not in use */
+  GQueue *downloads;            /* Pending downloads, in playlist order */
+  GMutex download_lock;
+  GCond download_cond;
+
+  /* Bitrate adaptation */
+  GstHLSAdaptation adaptation;  /* Bandwidth estimator, protected by the object lock */
+  GstClockTime queued_duration; /* Duration of the queued fragments, protected by the object lock */
+  guint upswitch_count;         /* Consecutive estimations allowing to switch up */
+  guint64 last_download_time;   /* End of the last download, protected by the download lock */
 
   /* Streaming task */
   GstTask *stream_task;
@@ -148,7 +148,7 @@ gst_m3u8_manager_add_fragment (GstStreamsManager * bmanager,
   *removed_fragments =
       gst_m3u8_playlist_add_entry (playlist, meta->name, meta->file,
       bmanager->title, ((gfloat) duration) / GST_SECOND,
-      gst_buffer_get_size (fragment), meta->offset, meta->index,
+      gst_fragment_get_size (fragment), meta->offset, meta->index,
       meta->discontinuous);
   *rep_file =
       gst_media_rep_file_new (gst_m3u8_playlist_render (playlist),
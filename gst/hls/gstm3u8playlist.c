@@ -20,6 +20,7 @@
  */
 
 #include <glib.h>
+#include <string.h>
 
 #include "gstfragmented.h"
 #include "gstm3u8playlist.h"
@@ -83,6 +84,8 @@ gst_m3u8_entry_free (GstM3U8Entry * entry)
     g_object_unref (entry->file);
     entry->file = NULL;
   }
+
+  g_free (entry);
 }
 
 static gchar *
@@ -136,6 +139,9 @@ gst_m3u8_playlist_new (gchar * name, gchar * base_url, GFile * file,
   playlist->type = GST_M3U8_PLAYLIST_TYPE_EVENT;
   playlist->end_list = FALSE;
   playlist->entries = g_queue_new ();
+  playlist->entries_str = g_string_new ("");
+  playlist->entries_head = 0;
+  playlist->target_duration = 0;
   g_object_ref (file);
   playlist->file = file;
 
@@ -155,6 +161,7 @@ gst_m3u8_playlist_free (GstM3U8Playlist * playlist)
 
   g_queue_foreach (playlist->entries, (GFunc) gst_m3u8_entry_free, NULL);
   g_queue_free (playlist->entries);
+  g_string_free (playlist->entries_str, TRUE);
 
   if (playlist->name != NULL) {
     g_free (playlist->name);
@@ -174,20 +181,67 @@ gst_m3u8_playlist_free (GstM3U8Playlist * playlist)
   g_free (playlist);
 }
 
-static guint
-gst_m3u8_playlist_target_duration (GstM3U8Playlist * playlist)
+static void
+gst_m3u8_playlist_update_target_duration (GstM3U8Playlist * playlist)
 {
   gint i;
   GstM3U8Entry *entry;
-  gfloat target_duration = 0;
 
+  playlist->target_duration = 0;
   for (i = 0; i < playlist->entries->length; i++) {
     entry = (GstM3U8Entry *) g_queue_peek_nth (playlist->entries, i);
-    if (entry->duration > target_duration)
-      target_duration = entry->duration;
+    if (entry->duration > playlist->target_duration)
+      playlist->target_duration = entry->duration;
   }
+}
 
-  return target_duration;
+static guint
+gst_m3u8_playlist_target_duration (GstM3U8Playlist * playlist)
+{
+  return playlist->target_duration;
+}
+
+static void
+gst_m3u8_playlist_push_entry (GstM3U8Playlist * playlist,
+    GstM3U8Entry * entry)
+{
+  gchar *entry_str;
+
+  /* Entries never change once added, so they are rendered only once and
+   * appended to the rendered entries of the playlist */
+  entry_str = gst_m3u8_entry_render (entry, playlist->version,
+      !playlist->chunked);
+  entry->rendered_len = strlen (entry_str);
+  g_string_append_len (playlist->entries_str, entry_str, entry->rendered_len);
+  g_free (entry_str);
+
+  if (entry->duration > playlist->target_duration)
+    playlist->target_duration = entry->duration;
+
+  g_queue_push_tail (playlist->entries, entry);
+}
+
+static GstM3U8Entry *
+gst_m3u8_playlist_pop_entry (GstM3U8Playlist * playlist)
+{
+  GstM3U8Entry *entry;
+
+  entry = g_queue_pop_head (playlist->entries);
+
+  /* Skip the rendered entry, and only compact the rendered entries once the
+   * skipped part is bigger than the rest, which keeps it amortized
+   * constant-time */
+  playlist->entries_head += entry->rendered_len;
+  if (playlist->entries_head > playlist->entries_str->len / 2) {
+    g_string_erase (playlist->entries_str, 0, playlist->entries_head);
+    playlist->entries_head = 0;
+  }
+
+  /* Only rescan the entries when the longest one is removed */
+  if (entry->duration >= playlist->target_duration)
+    gst_m3u8_playlist_update_target_duration (playlist);
+
+  return entry;
 }
 
 GList *
@@ -216,7 +270,7 @@ gst_m3u8_playlist_add_entry (GstM3U8Playlist * playlist,
         playlist->window_size) {
       GstM3U8Entry *old_entry;
 
-      old_entry = g_queue_pop_head (playlist->entries);
+      old_entry = gst_m3u8_playlist_pop_entry (playlist);
       g_object_ref (old_entry->file);
       old_files = g_list_prepend (old_files, old_entry->file);
       gst_m3u8_entry_free (old_entry);
@@ -224,52 +278,39 @@ gst_m3u8_playlist_add_entry (GstM3U8Playlist * playlist,
   }
 
   playlist->sequence_number = index + 1;
-  g_queue_push_tail (playlist->entries, entry);
+  gst_m3u8_playlist_push_entry (playlist, entry);
 
   return old_files;
 }
 
-static void
-render_entry (GstM3U8Entry * entry, GstM3U8Playlist * playlist)
-{
-  gchar *entry_str;
-
-  entry_str = gst_m3u8_entry_render (entry, playlist->version,
-      !playlist->chunked);
-  g_string_append_printf (playlist->playlist_str, "%s", entry_str);
-  g_free (entry_str);
-}
-
 gchar *
 gst_m3u8_playlist_render (GstM3U8Playlist * playlist)
 {
-  gchar *pl;
+  gchar *header, *pl;
+  const gchar *end_list;
+  gsize header_len, entries_len, end_list_len;
 
   g_return_val_if_fail (playlist != NULL, NULL);
 
-  playlist->playlist_str = g_string_new ("");
-
-  /* #EXTM3U */
-  g_string_append_printf (playlist->playlist_str, M3U8_HEADER_TAG);
-  /* #EXT-X-VERSION */
-//  g_string_append_printf (playlist->playlist_str, M3U8_VERSION_TAG,
-//      playlist->version);
-  /* #EXT-X-MEDIA-SEQUENCE */
-  g_string_append_printf (playlist->playlist_str, M3U8_MEDIA_SEQUENCE_TAG,
-      playlist->sequence_number - playlist->entries->length);
-  /* #EXT-X-TARGETDURATION */
-  g_string_append_printf (playlist->playlist_str, M3U8_TARGETDURATION_TAG,
+  /* #EXTM3U, #EXT-X-MEDIA-SEQUENCE and #EXT-X-TARGETDURATION */
+  header = g_strdup_printf (M3U8_HEADER_TAG M3U8_MEDIA_SEQUENCE_TAG
+      M3U8_TARGETDURATION_TAG "\n",
+      playlist->sequence_number - playlist->entries->length,
       gst_m3u8_playlist_target_duration (playlist));
-  g_string_append_printf (playlist->playlist_str, "\n");
+  header_len = strlen (header);
 
-  /* Entries */
-  g_queue_foreach (playlist->entries, (GFunc) render_entry, playlist);
+  /* Entries are already rendered, only the header is formatted again */
+  entries_len = playlist->entries_str->len - playlist->entries_head;
+  end_list = playlist->end_list ? M3U8_ENDLIST_TAG : "";
+  end_list_len = strlen (end_list);
 
-  if (playlist->end_list)
-    g_string_append_printf (playlist->playlist_str, M3U8_ENDLIST_TAG);
+  pl = g_malloc (header_len + entries_len + end_list_len + 1);
+  memcpy (pl, header, header_len);
+  memcpy (pl + header_len,
+      playlist->entries_str->str + playlist->entries_head, entries_len);
+  memcpy (pl + header_len + entries_len, end_list, end_list_len + 1);
+  g_free (header);
 
-  pl = playlist->playlist_str->str;
-  g_string_free (playlist->playlist_str, FALSE);
   return pl;
 }
 
@@ -280,6 +321,9 @@ gst_m3u8_playlist_clear (GstM3U8Playlist * playlist)
 
   g_queue_foreach (playlist->entries, (GFunc) gst_m3u8_entry_free, NULL);
   g_queue_clear (playlist->entries);
+  g_string_truncate (playlist->entries_str, 0);
+  playlist->entries_head = 0;
+  playlist->target_duration = 0;
 }
 
 guint
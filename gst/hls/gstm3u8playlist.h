@@ -41,6 +41,9 @@ struct _GstM3U8Entry
   guint length;
   guint offset;
   gboolean discontinuous;
+
+  /*< Private >*/
+  gsize rendered_len;           /* Length of the entry in the rendered entries */
 };
 
 struct _GstM3U8Playlist
@@ -59,7 +62,9 @@ struct _GstM3U8Playlist
 
   /*< Private >*/
   GQueue *entries;
-  GString *playlist_str;
+  GString *entries_str;         /* Rendered entries, appended as they are added */
+  gsize entries_head;           /* Offset of the first entry in entries_str */
+  gfloat target_duration;       /* Longest entry duration */
 };
 
 struct _GstM3U8VariantPlaylist
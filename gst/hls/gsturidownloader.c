@@ -162,9 +162,9 @@ gst_uri_downloader_sink_event (GstPad * pad, GstObject * parent,
       GST_DEBUG_OBJECT (downloader, "Got EOS on the fetcher pad");
       if (downloader->priv->download != NULL) {
         /* signal we have fetched the URI */
-        downloader->priv->download->completed = TRUE;
         downloader->priv->download->download_stop_time =
             gst_util_get_timestamp ();
+        gst_fragment_complete (downloader->priv->download);
         GST_OBJECT_UNLOCK (downloader);
         GST_DEBUG_OBJECT (downloader, "Signaling chain funtion");
         g_cond_signal (&downloader->priv->cond);
@@ -267,6 +267,7 @@ gst_uri_downloader_cancel (GstUriDownloader * downloader)
   GST_OBJECT_LOCK (downloader);
   if (downloader->priv->download != NULL) {
     GST_DEBUG_OBJECT (downloader, "Cancelling download");
+    gst_fragment_abort (downloader->priv->download);
     g_object_unref (downloader->priv->download);
     downloader->priv->download = NULL;
     GST_OBJECT_UNLOCK (downloader);
@@ -309,6 +310,22 @@ gst_uri_downloader_set_uri (GstUriDownloader * downloader, const gchar * uri)
 
 GstFragment *
 gst_uri_downloader_fetch_uri (GstUriDownloader * downloader, const gchar * uri)
+{
+  GstFragment *download = gst_fragment_new ();
+
+  if (!gst_uri_downloader_fetch_fragment (downloader, uri, download)) {
+    g_object_unref (download);
+    download = NULL;
+  }
+
+  return download;
+}
+
+/* Download @uri into @fragment, which can be consumed while the download is
+ * in progress if it is in streaming mode */
+gboolean
+gst_uri_downloader_fetch_fragment (GstUriDownloader * downloader,
+    const gchar * uri, GstFragment * fragment)
 {
   GstStateChangeReturn ret;
   GstFragment *download = NULL;
@@ -319,8 +336,11 @@ gst_uri_downloader_fetch_uri (GstUriDownloader * downloader, const gchar * uri)
     goto quit;
   }
 
-  downloader->priv->download = gst_fragment_new ();
+  downloader->priv->download = g_object_ref (fragment);
 
+  /* Measure the transfer time from the request, not from the time the
+   * download was scheduled */
+  downloader->priv->download->download_start_time = gst_util_get_timestamp ();
   ret = gst_element_set_state (downloader->priv->urisrc, GST_STATE_PLAYING);
   if (ret == GST_STATE_CHANGE_FAILURE) {
     g_object_unref (downloader->priv->download);
@@ -341,15 +361,17 @@ gst_uri_downloader_fetch_uri (GstUriDownloader * downloader, const gchar * uri)
   downloader->priv->download = NULL;
   GST_OBJECT_UNLOCK (downloader);
 
-  if (download != NULL)
+  if (download != NULL) {
     GST_INFO_OBJECT (downloader, "URI fetched successfully");
-  else
+    g_object_unref (download);
+  } else {
     GST_INFO_OBJECT (downloader, "Error fetching URI");
+  }
 
 quit:
   {
     gst_uri_downloader_stop (downloader);
     g_mutex_unlock (&downloader->priv->lock);
-    return download;
+    return download != NULL;
   }
 }
@@ -20,6 +20,7 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 #include <errno.h>
 #include <glib.h>
@@ -211,17 +212,116 @@ gst_m3u8_compare_playlist_by_bitrate (gconstpointer a, gconstpointer b)
   return ((GstM3U8 *) (a))->bandwidth - ((GstM3U8 *) (b))->bandwidth;
 }
 
+/* Whether the media file URI @line of @len bytes, absolute or relative to the
+ * playlist URI, resolves to @uri */
+static gboolean
+gst_m3u8_uri_is_equal (GstM3U8 * self, const gchar * uri, const gchar * line,
+    gsize len)
+{
+  const gchar *slash;
+  gsize base_len;
+
+  if (strncmp (uri, line, len) == 0 && uri[len] == '\0')
+    return TRUE;
+
+  if (!self->uri || !(slash = strrchr (self->uri, '/')))
+    return FALSE;
+
+  base_len = slash - self->uri + 1;
+  return strncmp (uri, self->uri, base_len) == 0
+      && strncmp (uri + base_len, line, len) == 0
+      && uri[base_len + len] == '\0';
+}
+
+/* Takes the media file with the given sequence number from the files of the
+ * previous update if it is the same file, dropping the older ones */
+static GstM3U8MediaFile *
+gst_m3u8_reuse_media_file (GstM3U8 * self, GList ** old_files,
+    guint sequence, const gchar * line, gsize len)
+{
+  GstM3U8MediaFile *file;
+
+  while (*old_files) {
+    file = GST_M3U8_MEDIA_FILE ((*old_files)->data);
+    if (file->sequence >= sequence)
+      break;
+    gst_m3u8_media_file_free (file);
+    *old_files = g_list_delete_link (*old_files, *old_files);
+  }
+
+  if (*old_files == NULL)
+    return NULL;
+
+  file = GST_M3U8_MEDIA_FILE ((*old_files)->data);
+  if (file->sequence != sequence
+      || !gst_m3u8_uri_is_equal (self, file->uri, line, len))
+    return NULL;
+
+  *old_files = g_list_delete_link (*old_files, *old_files);
+  return file;
+}
+
+/* Moves the media files of the previous update that are listed again at the
+ * start of @data to the new files. Only the URI lines are compared, the
+ * EXTINF lines of those entries are skipped without being parsed. Returns the
+ * start of the first entry that isn't known */
+static gchar *
+gst_m3u8_skip_known_media_files (GstM3U8 * self, GList ** old_files,
+    gchar * data, guint * n_reused)
+{
+  gchar *entry = data;
+
+  while (*old_files && *data) {
+    GstM3U8MediaFile *file;
+    gchar *end, *next;
+    gsize len;
+
+    end = strchr (data, '\n');
+    next = end ? end + 1 : data + strlen (data);
+    len = (end ? end : next) - data;
+    if (len > 0 && data[len - 1] == '\r')
+      len--;
+
+    if (data[0] == '#') {
+      /* any other tag needs to be parsed */
+      if (!g_str_has_prefix (data, "#EXTINF:"))
+        break;
+    } else if (len > 0) {
+      file = gst_m3u8_reuse_media_file (self, old_files, self->mediasequence,
+          data, len);
+      if (file == NULL)
+        break;
+      self->mediasequence++;
+      self->files = g_list_prepend (self->files, file);
+      (*n_reused)++;
+      entry = next;
+    }
+
+    data = next;
+  }
+
+  return entry;
+}
+
 /*
  * @data: a m3u8 playlist text data, taking ownership
+ *
+ * Live playlists usually only differ from the previous update by a few
+ * entries at the end. The entries that are already known, from the media
+ * sequence on, are skipped and their media files reused, and only the new
+ * entries are parsed.
  */
 static gboolean
 gst_m3u8_update (GstM3U8 * self, gchar * data, gboolean * updated)
 {
   gint val;
   GstClockTime duration;
-  gchar *title, *end;
+  gchar *title, *end, *r, *orig_data;
+  gsize title_len;
 //  gboolean discontinuity;
   GstM3U8 *list;
+  GList *old_files;
+  guint n_reused = 0, n_new = 0;
 
   g_return_val_if_fail (self != NULL, FALSE);
   g_return_val_if_fail (data != NULL, FALSE);
@@ -244,32 +344,52 @@ gst_m3u8_update (GstM3U8 * self, gchar * data, gboolean * updated)
     return FALSE;
   }
 
-  g_free (self->last_data);
-  self->last_data = data;
+  orig_data = data;
 
-  if (self->files) {
-    g_list_foreach (self->files, (GFunc) gst_m3u8_media_file_free, NULL);
-    g_list_free (self->files);
-    self->files = NULL;
-  }
+  /* Files are prepended and the list reversed at the end */
+  old_files = self->files;
+  self->files = NULL;
 
   list = NULL;
   duration = 0;
   title = NULL;
+  title_len = 0;
   data += 7;
   while (TRUE) {
+    if (old_files != NULL && list == NULL && duration == 0)
+      data = gst_m3u8_skip_known_media_files (self, &old_files, data,
+          &n_reused);
+
+    /* Lines are only terminated while they are parsed, the data is kept
+     * intact to be compared with the next update */
     end = g_utf8_strchr (data, -1, '\n');
     if (end)
       *end = '\0';
+    r = g_utf8_strchr (data, -1, '\r');
+    if (r)
+      *r = '\0';
 
     if (data[0] != '#') {
-      gchar *r;
-
       if (duration <= 0 && list == NULL) {
         GST_LOG ("%s: got line without EXTINF or EXTSTREAMINF, dropping", data);
         goto next_line;
       }
 
+      if (list == NULL) {
+        GstM3U8MediaFile *file;
+
+        file = gst_m3u8_reuse_media_file (self, &old_files,
+            self->mediasequence, data, strlen (data));
+        if (file != NULL) {
+          self->mediasequence++;
+          self->files = g_list_prepend (self->files, file);
+          duration = 0;
+          title = NULL;
+          n_reused++;
+          goto next_line;
+        }
+      }
+
       if (!gst_uri_is_valid (data)) {
         gchar *slash;
         if (!self->uri) {
@@ -289,10 +409,6 @@ gst_m3u8_update (GstM3U8 * self, gchar * data, gboolean * updated)
         data = g_strdup (data);
       }
 
-      r = g_utf8_strchr (data, -1, '\r');
-      if (r)
-        *r = '\0';
-
       if (list != NULL) {
         if (g_list_find_custom (self->lists, data,
                 (GCompareFunc) _m3u8_compare_uri)) {
@@ -307,11 +423,13 @@ gst_m3u8_update (GstM3U8 * self, gchar * data, gboolean * updated)
       } else {
         GstM3U8MediaFile *file;
         file =
-            gst_m3u8_media_file_new (data, title, duration,
+            gst_m3u8_media_file_new (data,
+            title ? g_strndup (title, title_len) : NULL, duration,
             self->mediasequence++);
         duration = 0;
         title = NULL;
-        self->files = g_list_append (self->files, file);
+        self->files = g_list_prepend (self->files, file);
+        n_new++;
       }
 
     } else if (g_str_has_prefix (data, "#EXT-X-ENDLIST")) {
@@ -320,7 +438,7 @@ gst_m3u8_update (GstM3U8 * self, gchar * data, gboolean * updated)
       if (int_from_string (data + 15, &data, &val))
         self->version = val;
     } else if (g_str_has_prefix (data, "#EXT-X-STREAM-INF:")) {
-      gchar *v, *a;
+      gchar *v, *a, *attributes;
 
       if (list != NULL) {
         GST_WARNING ("Found a list without a uri..., dropping");
@@ -328,7 +446,8 @@ gst_m3u8_update (GstM3U8 * self, gchar * data, gboolean * updated)
       }
 
       list = gst_m3u8_new ();
-      data = data + 18;
+      /* the attributes are tokenized in place */
+      data = attributes = g_strdup (data + 18);
       while (data && parse_attributes (&data, &a, &v)) {
         if (g_str_equal (a, "BANDWIDTH")) {
           if (!int_from_string (v, NULL, &list->bandwidth))
@@ -351,6 +470,7 @@ gst_m3u8_update (GstM3U8 * self, gchar * data, gboolean * updated)
           }
         }
       }
+      g_free (attributes);
     } else if (g_str_has_prefix (data, "#EXT-X-TARGETDURATION:")) {
       if (int_from_string (data + 22, &data, &val))
         self->targetduration = val * GST_SECOND;
@@ -377,20 +497,32 @@ gst_m3u8_update (GstM3U8 * self, gchar * data, gboolean * updated)
       if (!data || *data != ',')
         goto next_line;
       data = g_utf8_next_char (data);
-      if (data != end) {
-        g_free (title);
-        title = g_strdup (data);
+      /* Points into the data, only copied for new media files */
+      if (*data != '\0') {
+        title = data;
+        title_len = strlen (data);
       }
     } else {
       GST_LOG ("Ignored line: %s", data);
     }
 
   next_line:
+    if (r)
+      *r = '\r';
     if (!end)
       break;
+    *end = '\n';
     data = g_utf8_next_char (end);      /* skip \n */
   }
 
+  g_list_foreach (old_files, (GFunc) gst_m3u8_media_file_free, NULL);
+  g_list_free (old_files);
+  self->files = g_list_reverse (self->files);
+  g_free (self->last_data);
+  self->last_data = orig_data;
+
+  GST_LOG ("Updated playlist: %u media files reused, %u new", n_reused, n_new);
+
   /* redorder playlists by bitrate */
   if (self->lists) {
     gchar *top_variant_uri = NULL;
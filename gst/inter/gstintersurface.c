@@ -49,6 +49,7 @@ gst_inter_surface_get (const char *name)
   surface = g_malloc0 (sizeof (GstInterSurface));
   surface->name = g_strdup (name);
   surface->mutex = g_mutex_new ();
+  g_rw_lock_init (&surface->video_lock);
   surface->audio_adapter = gst_adapter_new ();
 
   list = g_list_append (list, surface);
@@ -62,3 +63,152 @@ gst_inter_surface_unref (GstInterSurface * surface)
 {
 
 }
+
+/* Number of the last frames to keep, at least the current one. Called with
+ * the video lock held */
+static guint
+gst_inter_surface_video_depth (GstInterSurface * surface)
+{
+  guint depth;
+
+  for (depth = GST_INTER_SURFACE_VIDEO_SLOTS; depth > 1; depth--) {
+    if (surface->video_readers[depth] > 0)
+      break;
+  }
+
+  return depth;
+}
+
+/* Removes the frames older than the depth from the slots, storing them in
+ * old to be unreffed without the lock. Called with the video lock held */
+static guint
+gst_inter_surface_drop_old_video (GstInterSurface * surface,
+    GstBuffer * old[GST_INTER_SURFACE_VIDEO_SLOTS])
+{
+  guint i, depth, n_old = 0;
+  GstBuffer **slot;
+
+  depth = gst_inter_surface_video_depth (surface);
+  for (i = depth; i < GST_INTER_SURFACE_VIDEO_SLOTS && i < surface->video_seq;
+      i++) {
+    slot = &surface->video_slots[(surface->video_seq - 1 - i) %
+        GST_INTER_SURFACE_VIDEO_SLOTS];
+    if (*slot) {
+      old[n_old++] = *slot;
+      *slot = NULL;
+    }
+  }
+
+  return n_old;
+}
+
+/* Sources register the maximum backlog they read with, the surface keeps
+ * the frames they can still read */
+void
+gst_inter_surface_add_video_reader (GstInterSurface * surface,
+    guint max_backlog)
+{
+  g_return_if_fail (max_backlog > 0 &&
+      max_backlog <= GST_INTER_SURFACE_VIDEO_SLOTS);
+
+  g_rw_lock_writer_lock (&surface->video_lock);
+  surface->video_readers[max_backlog]++;
+  g_rw_lock_writer_unlock (&surface->video_lock);
+}
+
+void
+gst_inter_surface_remove_video_reader (GstInterSurface * surface,
+    guint max_backlog)
+{
+  GstBuffer *old[GST_INTER_SURFACE_VIDEO_SLOTS];
+  guint i, n_old;
+
+  g_return_if_fail (max_backlog > 0 &&
+      max_backlog <= GST_INTER_SURFACE_VIDEO_SLOTS);
+
+  g_rw_lock_writer_lock (&surface->video_lock);
+  if (surface->video_readers[max_backlog] > 0)
+    surface->video_readers[max_backlog]--;
+  n_old = gst_inter_surface_drop_old_video (surface, old);
+  g_rw_lock_writer_unlock (&surface->video_lock);
+
+  for (i = 0; i < n_old; i++)
+    gst_buffer_unref (old[i]);
+}
+
+void
+gst_inter_surface_push_video (GstInterSurface * surface, GstBuffer * buffer)
+{
+  GstBuffer *old[GST_INTER_SURFACE_VIDEO_SLOTS + 1];
+  GstBuffer **slot;
+  guint i, n_old;
+
+  g_rw_lock_writer_lock (&surface->video_lock);
+  slot = &surface->video_slots[surface->video_seq %
+      GST_INTER_SURFACE_VIDEO_SLOTS];
+  old[0] = *slot;
+  *slot = gst_buffer_ref (buffer);
+  surface->video_seq++;
+  n_old = gst_inter_surface_drop_old_video (surface, old + 1) + 1;
+  g_rw_lock_writer_unlock (&surface->video_lock);
+
+  for (i = 0; i < n_old; i++) {
+    if (old[i])
+      gst_buffer_unref (old[i]);
+  }
+}
+
+void
+gst_inter_surface_clear_video (GstInterSurface * surface)
+{
+  GstBuffer *old[GST_INTER_SURFACE_VIDEO_SLOTS];
+  int i;
+
+  g_rw_lock_writer_lock (&surface->video_lock);
+  memcpy (old, surface->video_slots, sizeof (old));
+  memset (surface->video_slots, 0, sizeof (surface->video_slots));
+  g_rw_lock_writer_unlock (&surface->video_lock);
+
+  for (i = 0; i < GST_INTER_SURFACE_VIDEO_SLOTS; i++) {
+    if (old[i])
+      gst_buffer_unref (old[i]);
+  }
+}
+
+/* Returns the frame at *cursor, the next one to read, and advances it, or
+ * returns NULL if no new frame was pushed. When more than max_backlog frames
+ * are waiting, the oldest ones are skipped and counted in *dropped, bounding
+ * the latency when the sink runs faster than the source. max_backlog must
+ * not be larger than the one the source registered with. */
+GstBuffer *
+gst_inter_surface_pull_video (GstInterSurface * surface, guint64 * cursor,
+    guint max_backlog, guint64 * dropped)
+{
+  GstBuffer *buffer = NULL;
+  guint64 seq, available;
+
+  g_return_val_if_fail (max_backlog > 0 &&
+      max_backlog <= GST_INTER_SURFACE_VIDEO_SLOTS, NULL);
+
+  g_rw_lock_reader_lock (&surface->video_lock);
+  seq = surface->video_seq;
+
+  if (*cursor == GST_INTER_SURFACE_CURSOR_NONE)
+    *cursor = seq > 0 ? seq - 1 : 0;
+
+  available = seq - *cursor;
+  if (available > max_backlog) {
+    *dropped += available - max_backlog;
+    *cursor = seq - max_backlog;
+  }
+
+  if (*cursor < seq) {
+    buffer = surface->video_slots[*cursor % GST_INTER_SURFACE_VIDEO_SLOTS];
+    if (buffer)
+      gst_buffer_ref (buffer);
+    (*cursor)++;
+  }
+  g_rw_lock_reader_unlock (&surface->video_lock);
+
+  return buffer;
+}
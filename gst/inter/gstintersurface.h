@@ -27,6 +27,9 @@ G_BEGIN_DECLS
 
 typedef struct _GstInterSurface GstInterSurface;
 
+/* Maximum number of the last video frames kept for the sources */
+#define GST_INTER_SURFACE_VIDEO_SLOTS 8
+
 struct _GstInterSurface
 {
   GMutex *mutex;
@@ -39,21 +42,40 @@ struct _GstInterSurface
   int width;
   int height;
   int n_frames;
-  int video_buffer_count;
 
   /* audio */
   int sample_rate;
   int n_channels;
 
-  GstBuffer *video_buffer;
+  /* video frames, frame n is in slot n % GST_INTER_SURFACE_VIDEO_SLOTS.
+   * Sources only take the read lock, so they never wait on each other */
+  GRWLock video_lock;
+  GstBuffer *video_slots[GST_INTER_SURFACE_VIDEO_SLOTS];
+  guint64 video_seq;            /* number of frames pushed so far */
+  /* number of sources for each maximum backlog, only as many frames as the
+   * largest backlog are kept */
+  guint video_readers[GST_INTER_SURFACE_VIDEO_SLOTS + 1];
+
   GstBuffer *sub_buffer;
   GstAdapter *audio_adapter;
 };
 
+/* Initial read cursor, starting at the latest frame */
+#define GST_INTER_SURFACE_CURSOR_NONE G_MAXUINT64
 
 GstInterSurface * gst_inter_surface_get (const char *name);
 void gst_inter_surface_unref (GstInterSurface *surface);
 
+void gst_inter_surface_add_video_reader (GstInterSurface *surface,
+    guint max_backlog);
+void gst_inter_surface_remove_video_reader (GstInterSurface *surface,
+    guint max_backlog);
+void gst_inter_surface_push_video (GstInterSurface *surface,
+    GstBuffer *buffer);
+void gst_inter_surface_clear_video (GstInterSurface *surface);
+GstBuffer * gst_inter_surface_pull_video (GstInterSurface *surface,
+    guint64 *cursor, guint max_backlog, guint64 *dropped);
+
 
 G_END_DECLS
 
@@ -206,12 +206,7 @@ gst_inter_video_sink_stop (GstBaseSink * sink)
 {
   GstInterVideoSink *intervideosink = GST_INTER_VIDEO_SINK (sink);
 
-  g_mutex_lock (intervideosink->surface->mutex);
-  if (intervideosink->surface->video_buffer) {
-    gst_buffer_unref (intervideosink->surface->video_buffer);
-  }
-  intervideosink->surface->video_buffer = NULL;
-  g_mutex_unlock (intervideosink->surface->mutex);
+  gst_inter_surface_clear_video (intervideosink->surface);
 
   gst_inter_surface_unref (intervideosink->surface);
   intervideosink->surface = NULL;
@@ -224,13 +219,7 @@ gst_inter_video_sink_render (GstBaseSink * sink, GstBuffer * buffer)
 {
   GstInterVideoSink *intervideosink = GST_INTER_VIDEO_SINK (sink);
 
-  g_mutex_lock (intervideosink->surface->mutex);
-  if (intervideosink->surface->video_buffer) {
-    gst_buffer_unref (intervideosink->surface->video_buffer);
-  }
-  intervideosink->surface->video_buffer = gst_buffer_ref (buffer);
-  intervideosink->surface->video_buffer_count = 0;
-  g_mutex_unlock (intervideosink->surface->mutex);
+  gst_inter_surface_push_video (intervideosink->surface, buffer);
 
   return GST_FLOW_OK;
 }
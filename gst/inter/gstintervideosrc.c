@@ -70,9 +70,17 @@ static GstCaps *gst_inter_video_src_fixate (GstBaseSrc * src, GstCaps * caps);
 enum
 {
   PROP_0,
-  PROP_CHANNEL
+  PROP_CHANNEL,
+  PROP_MAX_BACKLOG,
+  PROP_DROP,
+  PROP_DUPLICATE
 };
 
+#define DEFAULT_MAX_BACKLOG 2
+
+/* Frames output again when the sink stalls, before falling back to black */
+#define MAX_REPEAT_COUNT 30
+
 /* pad templates */
 
 static GstStaticPadTemplate gst_inter_video_src_src_template =
@@ -121,6 +129,21 @@ gst_inter_video_src_class_init (GstInterVideoSrcClass * klass)
           "Channel name to match inter src and sink elements",
           "default", G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
+  g_object_class_install_property (gobject_class, PROP_MAX_BACKLOG,
+      g_param_spec_uint ("max-backlog", "Maximum backlog",
+          "Maximum number of frames waiting to be output before dropping the "
+          "oldest ones", 1, GST_INTER_SURFACE_VIDEO_SLOTS, DEFAULT_MAX_BACKLOG,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_DROP,
+      g_param_spec_uint64 ("drop", "Drop",
+          "Number of frames of the sink that were dropped", 0, G_MAXUINT64, 0,
+          G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_DUPLICATE,
+      g_param_spec_uint64 ("duplicate", "Duplicate",
+          "Number of frames that were output again while waiting for the sink",
+          0, G_MAXUINT64, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
 }
 
 static void
@@ -130,6 +153,7 @@ gst_inter_video_src_init (GstInterVideoSrc * intervideosrc)
   gst_base_src_set_live (GST_BASE_SRC (intervideosrc), TRUE);
 
   intervideosrc->channel = g_strdup ("default");
+  intervideosrc->max_backlog = DEFAULT_MAX_BACKLOG;
 }
 
 void
@@ -143,6 +167,17 @@ gst_inter_video_src_set_property (GObject * object, guint property_id,
       g_free (intervideosrc->channel);
       intervideosrc->channel = g_value_dup_string (value);
       break;
+    case PROP_MAX_BACKLOG:
+      GST_OBJECT_LOCK (intervideosrc);
+      if (intervideosrc->surface) {
+        gst_inter_surface_add_video_reader (intervideosrc->surface,
+            g_value_get_uint (value));
+        gst_inter_surface_remove_video_reader (intervideosrc->surface,
+            intervideosrc->max_backlog);
+      }
+      intervideosrc->max_backlog = g_value_get_uint (value);
+      GST_OBJECT_UNLOCK (intervideosrc);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -159,6 +194,21 @@ gst_inter_video_src_get_property (GObject * object, guint property_id,
     case PROP_CHANNEL:
       g_value_set_string (value, intervideosrc->channel);
       break;
+    case PROP_MAX_BACKLOG:
+      GST_OBJECT_LOCK (intervideosrc);
+      g_value_set_uint (value, intervideosrc->max_backlog);
+      GST_OBJECT_UNLOCK (intervideosrc);
+      break;
+    case PROP_DROP:
+      GST_OBJECT_LOCK (intervideosrc);
+      g_value_set_uint64 (value, intervideosrc->dropped);
+      GST_OBJECT_UNLOCK (intervideosrc);
+      break;
+    case PROP_DUPLICATE:
+      GST_OBJECT_LOCK (intervideosrc);
+      g_value_set_uint64 (value, intervideosrc->duplicated);
+      GST_OBJECT_UNLOCK (intervideosrc);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -199,7 +249,16 @@ gst_inter_video_src_start (GstBaseSrc * src)
 
   GST_DEBUG_OBJECT (intervideosrc, "start");
 
+  intervideosrc->video_cursor = GST_INTER_SURFACE_CURSOR_NONE;
+  intervideosrc->repeat_count = 0;
+
+  GST_OBJECT_LOCK (intervideosrc);
   intervideosrc->surface = gst_inter_surface_get (intervideosrc->channel);
+  gst_inter_surface_add_video_reader (intervideosrc->surface,
+      intervideosrc->max_backlog);
+  intervideosrc->dropped = 0;
+  intervideosrc->duplicated = 0;
+  GST_OBJECT_UNLOCK (intervideosrc);
 
   return TRUE;
 }
@@ -208,11 +267,18 @@ static gboolean
 gst_inter_video_src_stop (GstBaseSrc * src)
 {
   GstInterVideoSrc *intervideosrc = GST_INTER_VIDEO_SRC (src);
+  GstInterSurface *surface;
 
   GST_DEBUG_OBJECT (intervideosrc, "stop");
 
-  gst_inter_surface_unref (intervideosrc->surface);
+  GST_OBJECT_LOCK (intervideosrc);
+  surface = intervideosrc->surface;
+  gst_inter_surface_remove_video_reader (surface, intervideosrc->max_backlog);
   intervideosrc->surface = NULL;
+  GST_OBJECT_UNLOCK (intervideosrc);
+
+  gst_inter_surface_unref (surface);
+  gst_buffer_replace (&intervideosrc->last_buffer, NULL);
 
   return TRUE;
 }
@@ -251,21 +317,43 @@ gst_inter_video_src_create (GstBaseSrc * src, guint64 offset, guint size,
 {
   GstInterVideoSrc *intervideosrc = GST_INTER_VIDEO_SRC (src);
   GstBuffer *buffer;
+  guint64 dropped = 0;
+  gboolean duplicate = FALSE;
+  guint max_backlog;
 
   GST_DEBUG_OBJECT (intervideosrc, "create");
 
-  buffer = NULL;
-
-  g_mutex_lock (intervideosrc->surface->mutex);
-  if (intervideosrc->surface->video_buffer) {
-    buffer = gst_buffer_ref (intervideosrc->surface->video_buffer);
-    intervideosrc->surface->video_buffer_count++;
-    if (intervideosrc->surface->video_buffer_count >= 30) {
-      gst_buffer_unref (intervideosrc->surface->video_buffer);
-      intervideosrc->surface->video_buffer = NULL;
+  GST_OBJECT_LOCK (intervideosrc);
+  max_backlog = intervideosrc->max_backlog;
+  GST_OBJECT_UNLOCK (intervideosrc);
+
+  /* Each source reads the frames at its own pace, repeating the last one
+   * when the sink is slower and dropping when it is faster */
+  buffer = gst_inter_surface_pull_video (intervideosrc->surface,
+      &intervideosrc->video_cursor, max_backlog, &dropped);
+
+  if (buffer) {
+    gst_buffer_replace (&intervideosrc->last_buffer, buffer);
+    intervideosrc->repeat_count = 1;
+  } else if (intervideosrc->last_buffer) {
+    if (intervideosrc->repeat_count < MAX_REPEAT_COUNT) {
+      buffer = gst_buffer_ref (intervideosrc->last_buffer);
+      intervideosrc->repeat_count++;
+      duplicate = TRUE;
+    } else {
+      gst_buffer_replace (&intervideosrc->last_buffer, NULL);
     }
   }
-  g_mutex_unlock (intervideosrc->surface->mutex);
+
+  if (dropped > 0 || duplicate) {
+    GST_LOG_OBJECT (intervideosrc, "dropped %" G_GUINT64_FORMAT
+        " frames, duplicate %d", dropped, duplicate);
+    GST_OBJECT_LOCK (intervideosrc);
+    intervideosrc->dropped += dropped;
+    if (duplicate)
+      intervideosrc->duplicated++;
+    GST_OBJECT_UNLOCK (intervideosrc);
+  }
 
   if (buffer == NULL) {
     GstMapInfo map;
@@ -45,6 +45,13 @@ struct _GstInterVideoSrc
 
   GstVideoInfo info;
   int n_frames;
+
+  guint max_backlog;
+  guint64 video_cursor;         /* next frame to read from the surface */
+  GstBuffer *last_buffer;
+  int repeat_count;             /* times last_buffer was output */
+  guint64 dropped;
+  guint64 duplicated;
 };
 
 struct _GstInterVideoSrcClass
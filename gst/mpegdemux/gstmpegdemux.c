@@ -65,6 +65,8 @@
 #define VIDEO_SEGMENT_THRESHOLD (500*GST_MSECOND)
 
 #define DURATION_SCAN_LIMIT         4 * 1024 * 1024
+/* distance between the packs remembered while playing */
+#define SCR_INDEX_INTERVAL          1024 * 1024
 
 typedef enum
 {
@@ -272,6 +274,8 @@ gst_flups_demux_init (GstFluPSDemux * demux)
       g_malloc0 (sizeof (GstFluPSStream *) * (GST_FLUPS_DEMUX_MAX_STREAMS));
   demux->found_count = 0;
 
+  demux->scr_index = g_array_new (FALSE, FALSE,
+      sizeof (GstFluPSScrIndexEntry));
 }
 
 static void
@@ -280,6 +284,7 @@ gst_flups_demux_finalize (GstFluPSDemux * demux)
   gst_flups_demux_reset (demux);
   g_free (demux->streams);
   g_free (demux->streams_found);
+  g_array_free (demux->scr_index, TRUE);
 
   G_OBJECT_CLASS (parent_class)->finalize (G_OBJECT (demux));
 }
@@ -305,6 +310,8 @@ gst_flups_demux_reset (GstFluPSDemux * demux)
   memset (demux->streams_found, 0,
       sizeof (GstFluPSStream *) * (GST_FLUPS_DEMUX_MAX_STREAMS));
   demux->found_count = 0;
+  g_array_set_size (demux->scr_index, 0);
+  demux->last_indexed_offset = G_MAXUINT64;
   p_ev = &demux->lang_codes;
 
   gst_event_replace (p_ev, NULL);
@@ -1044,52 +1051,211 @@ not_supported:
   }
 }
 
-#define MAX_RECURSION_COUNT 100
+#define MAX_SEEK_ITERATIONS 100
 
-/* Binary search for requested SCR */
-static inline guint64
-find_offset (GstFluPSDemux * demux, guint64 scr,
-    guint64 min_scr, guint64 min_scr_offset,
-    guint64 max_scr, guint64 max_scr_offset, int recursion_count)
+/* Returns the position of the first index entry at or after @offset */
+static guint
+gst_flups_demux_scr_index_find (GstFluPSDemux * demux, guint64 offset)
 {
-  guint64 scr_rate_n = max_scr_offset - min_scr_offset;
-  guint64 scr_rate_d = max_scr - min_scr;
-  guint64 fscr = scr;
-  gboolean found;
-  guint64 offset;
+  GstFluPSScrIndexEntry *entries =
+      (GstFluPSScrIndexEntry *) demux->scr_index->data;
+  guint lo = 0, hi = demux->scr_index->len;
 
-  if (recursion_count > MAX_RECURSION_COUNT) {
-    return -1;
+  while (lo < hi) {
+    guint mid = (lo + hi) / 2;
+
+    if (entries[mid].offset < offset)
+      lo = mid + 1;
+    else
+      hi = mid;
   }
+  return lo;
+}
 
-  offset = min_scr_offset +
-      MIN (gst_util_uint64_scale (scr - min_scr, scr_rate_n,
-          scr_rate_d), demux->sink_segment.stop);
+/* Returns the position of the first index entry with an SCR above @scr */
+static guint
+gst_flups_demux_scr_index_find_scr (GstFluPSDemux * demux, guint64 scr)
+{
+  GstFluPSScrIndexEntry *entries =
+      (GstFluPSScrIndexEntry *) demux->scr_index->data;
+  guint lo = 0, hi = demux->scr_index->len;
 
-  found = gst_flups_demux_scan_forward_ts (demux, &offset, SCAN_SCR, &fscr, 0);
+  while (lo < hi) {
+    guint mid = (lo + hi) / 2;
 
-  if (!found) {
-    found =
-        gst_flups_demux_scan_backward_ts (demux, &offset, SCAN_SCR, &fscr, 0);
+    if (entries[mid].scr <= scr)
+      lo = mid + 1;
+    else
+      hi = mid;
   }
+  return lo;
+}
+
+/* Remembers the SCR of the pack at @offset and returns the position of its
+ * entry, or -1 if it would make the SCR go backwards in the index, like
+ * after a discontinuity */
+static gint
+gst_flups_demux_scr_index_add (GstFluPSDemux * demux, guint64 scr,
+    guint64 offset)
+{
+  GArray *index = demux->scr_index;
+  GstFluPSScrIndexEntry entry;
+  guint pos;
 
-  if (fscr == scr || fscr == min_scr || fscr == max_scr) {
-    return offset;
+  pos = gst_flups_demux_scr_index_find (demux, offset);
+
+  if (pos < index->len) {
+    GstFluPSScrIndexEntry *next =
+        &g_array_index (index, GstFluPSScrIndexEntry, pos);
+
+    if (next->offset == offset)
+      return next->scr == scr ? pos : -1;
+    if (next->scr < scr)
+      return -1;
   }
+  if (pos > 0) {
+    GstFluPSScrIndexEntry *prev =
+        &g_array_index (index, GstFluPSScrIndexEntry, pos - 1);
 
-  if (fscr < scr) {
-    return find_offset (demux, scr, fscr, offset, max_scr, max_scr_offset,
-        recursion_count + 1);
-  } else {
-    return find_offset (demux, scr, min_scr, min_scr_offset, fscr, offset,
-        recursion_count + 1);
+    if (prev->scr > scr)
+      return -1;
+    prev->next_is_adjacent = FALSE;
+  }
+
+  entry.scr = scr;
+  entry.offset = offset;
+  entry.next_is_adjacent = FALSE;
+  g_array_insert_val (index, pos, entry);
+
+  return pos;
+}
+
+/* Finds the last pack with an SCR not above @scr. The packs already in the
+ * index bound the search, inside of them the offset is interpolated from
+ * the SCR, with a bisection every other step so that uneven bitrates still
+ * converge. When no pack is found between a guess and the upper bound, the
+ * pack right before the upper bound is found by scanning backwards from
+ * it. The packs found adjacent are marked so that seeking there again
+ * needs no I/O. */
+static guint64
+find_offset (GstFluPSDemux * demux, guint64 scr, guint64 * rscr)
+{
+  GArray *index = demux->scr_index;
+  GstFluPSScrIndexEntry *lo, *hi;
+  guint64 lo_scr, lo_offset, hi_scr, hi_offset;
+  guint64 guess, offset, fscr;
+  gboolean found, next_pack;
+  gint lo_pos, pos, i;
+
+  if (index->len == 0)
+    return -1;
+
+  pos = gst_flups_demux_scr_index_find_scr (demux, scr);
+  if (pos == 0)
+    pos = 1;
+  lo_pos = pos - 1;
+  lo = &g_array_index (index, GstFluPSScrIndexEntry, lo_pos);
+  lo_scr = lo->scr;
+  lo_offset = lo->offset;
+
+  if (pos == (gint) index->len || lo_scr >= scr || lo->next_is_adjacent) {
+    GST_DEBUG_OBJECT (demux, "SCR %" G_GUINT64_FORMAT " found in index",
+        scr);
+    *rscr = lo_scr;
+    return lo_offset;
+  }
+
+  hi = &g_array_index (index, GstFluPSScrIndexEntry, pos);
+  hi_scr = hi->scr;
+  hi_offset = hi->offset;
+
+  for (i = 0; i < MAX_SEEK_ITERATIONS; i++) {
+    if (hi_offset - lo_offset <= SCAN_SCR_SZ) {
+      guess = lo_offset + 1;
+    } else if (i & 1) {
+      guess = lo_offset + (hi_offset - lo_offset) / 2;
+    } else {
+      guess = lo_offset + gst_util_uint64_scale (scr - lo_scr,
+          hi_offset - lo_offset, hi_scr - lo_scr);
+      guess = CLAMP (guess, lo_offset + 1, hi_offset - 1);
+    }
+    next_pack = (guess == lo_offset + 1);
+
+    offset = guess;
+    found = gst_flups_demux_scan_forward_ts (demux, &offset, SCAN_SCR, &fscr,
+        MIN (hi_offset - guess, G_MAXINT));
+
+    pos = -1;
+    if (found) {
+      pos = gst_flups_demux_scr_index_add (demux, fscr, offset);
+      if (next_pack && pos >= 0 && pos == lo_pos + 1)
+        g_array_index (index, GstFluPSScrIndexEntry,
+            lo_pos).next_is_adjacent = TRUE;
+    }
+
+    if (!found || offset >= hi_offset) {
+      if (next_pack)
+        break;
+
+      /* No pack between the guess and the upper bound, so the pack right
+       * before the upper bound is before the guess. Find it with a single
+       * scan backwards instead of halving the interval down to the size of
+       * a pack header. */
+      offset = hi_offset;
+      found = gst_flups_demux_scan_backward_ts (demux, &offset, SCAN_SCR,
+          &fscr, MIN (hi_offset - lo_offset, G_MAXINT));
+      if (!found || offset <= lo_offset) {
+        offset = lo_offset;
+        pos = lo_pos;
+      } else {
+        pos = gst_flups_demux_scr_index_add (demux, fscr, offset);
+      }
+
+      if (pos >= 0 && pos + 1 < (gint) index->len &&
+          g_array_index (index, GstFluPSScrIndexEntry, pos + 1).offset ==
+          hi_offset)
+        g_array_index (index, GstFluPSScrIndexEntry,
+            pos).next_is_adjacent = TRUE;
+
+      /* The lower bound is the pack right before the upper bound */
+      if (offset == lo_offset)
+        break;
+
+      if (fscr > scr || fscr < lo_scr) {
+        hi_scr = MAX (fscr, scr + 1);
+        hi_offset = offset;
+        continue;
+      }
+      lo_scr = fscr;
+      lo_offset = offset;
+      lo_pos = pos;
+      break;
+    }
+
+    if (fscr > scr || fscr < lo_scr) {
+      if (next_pack)
+        break;
+      hi_scr = MAX (fscr, scr + 1);
+      hi_offset = offset;
+    } else {
+      lo_scr = fscr;
+      lo_offset = offset;
+      lo_pos = pos;
+      if (fscr == scr || pos < 0)
+        break;
+    }
   }
+
+  GST_DEBUG_OBJECT (demux, "SCR %" G_GUINT64_FORMAT " found after %d scans",
+      scr, i + 1);
+
+  *rscr = lo_scr;
+  return lo_offset;
 }
 
 static inline gboolean
 gst_flups_demux_do_seek (GstFluPSDemux * demux, GstSegment * seeksegment)
 {
-  gboolean found = FALSE;
   guint64 fscr, offset;
   guint64 scr = GSTTIME_TO_MPEGTIME (seeksegment->position + demux->base_time);
 
@@ -1101,31 +1267,16 @@ gst_flups_demux_do_seek (GstFluPSDemux * demux, GstSegment * seeksegment)
 
   scr = MIN (demux->last_scr, scr);
   scr = MAX (demux->first_scr, scr);
-  fscr = scr;
 
   GST_INFO_OBJECT (demux, "sink segment configured %" GST_SEGMENT_FORMAT
       ", trying to go at SCR: %" G_GUINT64_FORMAT, &demux->sink_segment, scr);
 
-  offset =
-      find_offset (demux, scr, demux->first_scr, demux->first_scr_offset,
-      demux->last_scr, demux->last_scr_offset, 0);
+  offset = find_offset (demux, scr, &fscr);
 
   if (offset == (guint64) - 1) {
     return FALSE;
   }
 
-  while (found && fscr < scr) {
-    offset++;
-    found =
-        gst_flups_demux_scan_forward_ts (demux, &offset, SCAN_SCR, &fscr, 0);
-  }
-
-  while (found && fscr > scr && offset > 0) {
-    offset--;
-    found =
-        gst_flups_demux_scan_backward_ts (demux, &offset, SCAN_SCR, &fscr, 0);
-  }
-
   GST_INFO_OBJECT (demux, "doing seek at offset %" G_GUINT64_FORMAT
       " SCR: %" G_GUINT64_FORMAT " %" GST_TIME_FORMAT,
       offset, fscr, GST_TIME_ARGS (MPEGTIME_TO_GSTTIME (fscr)));
@@ -1627,6 +1778,16 @@ gst_flups_demux_parse_pack_start (GstFluPSDemux * demux)
       scr, scr_adjusted, new_rate,
       GST_TIME_ARGS (MPEGTIME_TO_GSTTIME ((guint64) scr)));
 
+  /* remember a pack now and then, for seeking back here later */
+  if (demux->random_access && demux->sink_segment.rate >= 0.0 &&
+      demux->adapter_offset != G_MAXUINT64 &&
+      (demux->last_indexed_offset == G_MAXUINT64 ||
+          demux->adapter_offset >=
+          demux->last_indexed_offset + SCR_INDEX_INTERVAL)) {
+    if (gst_flups_demux_scr_index_add (demux, scr, demux->adapter_offset) >= 0)
+      demux->last_indexed_offset = demux->adapter_offset;
+  }
+
   /* keep the first src in order to calculate delta time */
   if (G_UNLIKELY (demux->first_scr == G_MAXUINT64)) {
     demux->first_scr = scr;
@@ -2500,6 +2661,8 @@ gst_flups_demux_scan_forward_ts (GstFluPSDemux * demux, guint64 * pos,
     if (found) {
       *rts = ts;
       *pos = offset + cursor - 1;
+      if (mode == SCAN_SCR)
+        gst_flups_demux_scr_index_add (demux, ts, *pos);
     } else {
       offset += cursor;
     }
@@ -2566,6 +2729,8 @@ gst_flups_demux_scan_backward_ts (GstFluPSDemux * demux, guint64 * pos,
     if (found) {
       *rts = ts;
       *pos = offset + cursor;
+      if (mode == SCAN_SCR)
+        gst_flups_demux_scr_index_add (demux, ts, *pos);
     }
 
   } while (!found && offset > 0);
@@ -2662,6 +2827,16 @@ gst_flups_sink_get_duration (GstFluPSDemux * demux)
       }
     }
   }
+  /* The scans above indexed the packs they went through, including the
+   * wrong SCRs, which would make the index reject the packs found later.
+   * Start again from the bounds of the stream instead. */
+  g_array_set_size (demux->scr_index, 0);
+  if (demux->first_scr != G_MAXUINT64 && demux->last_scr != G_MAXUINT64) {
+    gst_flups_demux_scr_index_add (demux, demux->first_scr,
+        demux->first_scr_offset);
+    gst_flups_demux_scr_index_add (demux, demux->last_scr,
+        demux->last_scr_offset);
+  }
   /* Set the base_time and avg rate */
   demux->base_time = MPEGTIME_TO_GSTTIME (demux->first_scr);
   demux->scr_rate_n = demux->last_scr_offset - demux->first_scr_offset;
@@ -3098,6 +3273,8 @@ gst_flups_demux_change_state (GstElement * element, GstStateChange transition)
       demux->need_no_more_pads = TRUE;
       demux->first_pts = G_MAXUINT64;
       demux->last_pts = G_MAXUINT64;
+      g_array_set_size (demux->scr_index, 0);
+      demux->last_indexed_offset = G_MAXUINT64;
       gst_flups_demux_reset_psm (demux);
       gst_segment_init (&demux->sink_segment, GST_FORMAT_UNDEFINED);
       gst_segment_init (&demux->src_segment, GST_FORMAT_TIME);
@@ -80,6 +80,15 @@ typedef enum
   STATE_FLUPS_DEMUX_NEED_MORE_DATA,
 } GstFluPSDemuxState;
 
+/* SCR of a pack header and the offset of the pack in the stream */
+typedef struct
+{
+  guint64 scr;
+  guint64 offset;
+  /* TRUE if the next entry is known to be the next pack */
+  gboolean next_is_adjacent;
+} GstFluPSScrIndexEntry;
+
 /* Information associated with a single FluPS stream. */
 struct _GstFluPSStream
 {
@@ -126,6 +135,11 @@ struct _GstFluPSDemux
   guint64 last_scr_offset;
   guint64 cur_scr_offset;
 
+  /* GstFluPSScrIndexEntry of the packs found so far, sorted by offset and
+   * SCR, reused across seeks */
+  GArray *scr_index;
+  guint64 last_indexed_offset;
+
   guint64 first_pts;
   guint64 last_pts;
 
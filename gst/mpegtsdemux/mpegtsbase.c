@@ -1513,6 +1513,7 @@ mpegts_base_scan (MpegTSBase * base)
         /* Mark the initial sync point and remember the packetsize */
         base->seek_offset = base->packetizer->offset;
         GST_DEBUG ("Sync point is now %" G_GUINT64_FORMAT, base->seek_offset);
+        base->sync_offset = base->seek_offset;
         base->packetsize = base->packetizer->packet_size;
       }
       while (1) {
@@ -1590,11 +1591,16 @@ no_initial_pcr:
 static void
 mpegts_base_loop (MpegTSBase * base)
 {
+  MpegTSBaseClass *klass = GST_MPEGTS_BASE_GET_CLASS (base);
   GstFlowReturn ret = GST_FLOW_ERROR;
+
   switch (base->mode) {
     case BASE_MODE_SCANNING:
-      /* Find first sync point */
-      ret = mpegts_base_scan (base);
+      /* Find first sync point, unless the subclass has it already */
+      if (klass->load_index && klass->load_index (base))
+        ret = GST_FLOW_OK;
+      else
+        ret = mpegts_base_scan (base);
       if (G_UNLIKELY (ret != GST_FLOW_OK))
         goto error;
       base->mode = BASE_MODE_STREAMING;
@@ -103,6 +103,9 @@ struct _MpegTSBase {
   /* Current pull offset (also set by seek handler) */
   guint64	seek_offset;
 
+  /* Initial sync point, found while scanning */
+  guint64	sync_offset;
+
   /* Cached packetsize */
   guint16	packetsize;
 
@@ -159,6 +162,11 @@ struct _MpegTSBaseClass {
   /* stream_removed is called whenever a stream is no longer referenced */
   void (*stream_removed) (MpegTSBase *base, MpegTSBaseStream *stream);
 
+  /* load_index is called in pull mode before scanning. If it returns TRUE,
+   * the subclass restored seek_offset, sync_offset, packetsize and the PCR
+   * observations and the scan is skipped */
+  gboolean (*load_index) (MpegTSBase * base);
+
   /* find_timestamps is called to find PCR */
   GstFlowReturn (*find_timestamps) (MpegTSBase * base, guint64 initoff, guint64 *offset);
 
@@ -216,6 +216,11 @@ struct _MpegTSPacketizerPrivate
   guint offset;
   guint mapped_size;
 
+  /* Buffer taken out of the adapter backing @mapped, so that consumers
+   * can create sub-buffers sharing its memory */
+  GstBuffer *mapped_buffer;
+  GstMapInfo mapinfo;
+
   /* Reference offset */
   guint64 refoffset;
 
@@ -234,6 +239,8 @@ struct _MpegTSPacketizerPrivate
 };
 
 static void mpegts_packetizer_dispose (GObject * object);
+static void mpegts_packetizer_release_mapped (MpegTSPacketizer2 * packetizer,
+    gboolean keep_remaining);
 static void mpegts_packetizer_finalize (GObject * object);
 static gchar *get_encoding_and_convert (MpegTSPacketizer2 * packetizer,
     const gchar * text, guint length);
@@ -381,6 +388,7 @@ mpegts_packetizer_init (MpegTSPacketizer2 * packetizer)
   priv->mapped = NULL;
   priv->mapped_size = 0;
   priv->offset = 0;
+  priv->mapped_buffer = NULL;
 
   memset (priv->pcrtablelut, 0xff, 0x200);
   memset (priv->observations, 0x0, sizeof (priv->observations));
@@ -415,6 +423,7 @@ mpegts_packetizer_dispose (GObject * object)
       g_free (packetizer->streams);
     }
 
+    mpegts_packetizer_release_mapped (packetizer, FALSE);
     gst_adapter_clear (packetizer->adapter);
     g_object_unref (packetizer->adapter);
     packetizer->disposed = TRUE;
@@ -2446,6 +2455,7 @@ mpegts_packetizer_clear (MpegTSPacketizer2 * packetizer)
     memset (packetizer->streams, 0, 8192 * sizeof (MpegTSPacketizerStream *));
   }
 
+  mpegts_packetizer_release_mapped (packetizer, FALSE);
   gst_adapter_clear (packetizer->adapter);
   packetizer->offset = 0;
   packetizer->empty = TRUE;
@@ -2469,6 +2479,7 @@ mpegts_packetizer_flush (MpegTSPacketizer2 * packetizer)
       }
     }
   }
+  mpegts_packetizer_release_mapped (packetizer, FALSE);
   gst_adapter_clear (packetizer->adapter);
 
   packetizer->offset = 0;
@@ -2502,9 +2513,40 @@ mpegts_packetizer_new (void)
   return packetizer;
 }
 
+/* Releases the buffer currently taken out of the adapter. If @keep_remaining
+ * is TRUE, the bytes that haven't been consumed yet are put back in the
+ * adapter. Since the whole adapter content is taken when mapping, the adapter
+ * is always empty at this point and ordering is preserved */
+static void
+mpegts_packetizer_release_mapped (MpegTSPacketizer2 * packetizer,
+    gboolean keep_remaining)
+{
+  MpegTSPacketizerPrivate *priv = packetizer->priv;
+
+  if (priv->mapped_buffer == NULL)
+    return;
+
+  gst_buffer_unmap (priv->mapped_buffer, &priv->mapinfo);
+  if (keep_remaining && priv->offset < priv->mapped_size) {
+    GST_LOG ("Putting back %u bytes", priv->mapped_size - priv->offset);
+    gst_adapter_push (packetizer->adapter,
+        gst_buffer_copy_region (priv->mapped_buffer, GST_BUFFER_COPY_MEMORY,
+            priv->offset, priv->mapped_size - priv->offset));
+  }
+  gst_buffer_unref (priv->mapped_buffer);
+  priv->mapped_buffer = NULL;
+  priv->mapped = NULL;
+  priv->mapped_size = 0;
+  priv->offset = 0;
+}
+
 void
 mpegts_packetizer_push (MpegTSPacketizer2 * packetizer, GstBuffer * buffer)
 {
+  /* The leftovers of a previous chunk must come before the new data */
+  if (G_UNLIKELY (packetizer->priv->mapped_buffer))
+    mpegts_packetizer_release_mapped (packetizer, TRUE);
+
   if (G_UNLIKELY (packetizer->empty)) {
     packetizer->empty = FALSE;
     packetizer->offset = GST_BUFFER_OFFSET (buffer);
@@ -2619,10 +2661,15 @@ mpegts_packetizer_next_packet (MpegTSPacketizer2 * packetizer,
 
   while ((avail = priv->available) >= packetizer->packet_size) {
     if (priv->mapped == NULL) {
-      priv->mapped_size =
-          priv->available - (priv->available % packetizer->packet_size);
-      priv->mapped =
-          (guint8 *) gst_adapter_map (packetizer->adapter, priv->mapped_size);
+      /* Take everything out of the adapter. This is a zero-copy operation
+       * when the data is contained in a single upstream buffer, and allows
+       * creating sub-buffers of the packets (see
+       * mpegts_packetizer_get_packet_buffer()) */
+      priv->mapped_size = priv->available;
+      priv->mapped_buffer =
+          gst_adapter_take_buffer (packetizer->adapter, priv->mapped_size);
+      gst_buffer_map (priv->mapped_buffer, &priv->mapinfo, GST_MAP_READ);
+      priv->mapped = priv->mapinfo.data;
       priv->offset = 0;
     }
     packet->data_start = priv->mapped + priv->offset;
@@ -2666,8 +2713,7 @@ mpegts_packetizer_next_packet (MpegTSPacketizer2 * packetizer,
     priv->available -= i;
     if (G_UNLIKELY (priv->available < packetizer->packet_size)) {
       GST_DEBUG ("Flushing %d bytes out", priv->offset);
-      gst_adapter_flush (packetizer->adapter, priv->offset);
-      priv->mapped = NULL;
+      mpegts_packetizer_release_mapped (packetizer, TRUE);
     }
     continue;
   }
@@ -2688,10 +2734,8 @@ mpegts_packetizer_process_next_packet (MpegTSPacketizer2 * packetizer)
   if (ret != PACKET_NEED_MORE) {
     packetizer->priv->offset += packetizer->packet_size;
     packetizer->priv->available -= packetizer->packet_size;
-    if (G_UNLIKELY (packetizer->priv->available < packetizer->packet_size)) {
-      gst_adapter_flush (packetizer->adapter, packetizer->priv->offset);
-      packetizer->priv->mapped = NULL;
-    }
+    if (G_UNLIKELY (packetizer->priv->available < packetizer->packet_size))
+      mpegts_packetizer_release_mapped (packetizer, TRUE);
   }
   return ret;
 }
@@ -2705,10 +2749,28 @@ mpegts_packetizer_clear_packet (MpegTSPacketizer2 * packetizer,
   priv->offset += packetizer->packet_size;
   priv->available -= packetizer->packet_size;
 
-  if (G_UNLIKELY (priv->mapped && priv->available < packetizer->packet_size)) {
-    gst_adapter_flush (packetizer->adapter, priv->offset);
-    priv->mapped = NULL;
-  }
+  if (G_UNLIKELY (priv->mapped && priv->available < packetizer->packet_size))
+    mpegts_packetizer_release_mapped (packetizer, TRUE);
+}
+
+/* Returns the timestamp of the latest inputted buffer */
+GstClockTime
+mpegts_packetizer_get_current_time (MpegTSPacketizer2 * packetizer)
+{
+  return packetizer->priv->last_in_time;
+}
+
+GstBuffer *
+mpegts_packetizer_get_packet_buffer (MpegTSPacketizer2 * packetizer,
+    MpegTSPacketizerPacket * packet, gsize * offset)
+{
+  MpegTSPacketizerPrivate *priv = packetizer->priv;
+
+  g_return_val_if_fail (priv->mapped_buffer != NULL, NULL);
+
+  *offset = packet->data_start - priv->mapped;
+
+  return priv->mapped_buffer;
 }
 
 gboolean
@@ -3718,3 +3780,47 @@ mpegts_packetizer_set_reference_offset (MpegTSPacketizer2 * packetizer,
 
   packetizer->priv->refoffset = refoffset;
 }
+
+/* Retrieve the first and last PCR observations of @pcr_pid, used to
+ * save the result of the initial scan. Returns FALSE if those are not
+ * known yet */
+gboolean
+mpegts_packetizer_get_pcr_range (MpegTSPacketizer2 * packetizer,
+    guint16 pcr_pid, guint64 * first_pcr, guint64 * first_offset,
+    guint64 * last_pcr, guint64 * last_offset)
+{
+  MpegTSPCR *pcrtable = get_pcr_table (packetizer, pcr_pid);
+
+  if (pcrtable->first_pcr == -1 || pcrtable->last_pcr == -1)
+    return FALSE;
+
+  *first_pcr = pcrtable->first_pcr;
+  *first_offset = pcrtable->first_offset;
+  *last_pcr = pcrtable->last_pcr;
+  *last_offset = pcrtable->last_offset;
+
+  return TRUE;
+}
+
+/* Restore PCR observations saved with mpegts_packetizer_get_pcr_range()
+ * instead of scanning the stream */
+void
+mpegts_packetizer_set_pcr_range (MpegTSPacketizer2 * packetizer,
+    guint16 pcr_pid, guint64 first_pcr, guint64 first_offset,
+    guint64 last_pcr, guint64 last_offset)
+{
+  MpegTSPCR *pcrtable = get_pcr_table (packetizer, pcr_pid);
+
+  GST_DEBUG ("pcr_pid:0x%04x first PCR:%" G_GUINT64_FORMAT " offset:%"
+      G_GUINT64_FORMAT " last PCR:%" G_GUINT64_FORMAT " offset:%"
+      G_GUINT64_FORMAT, pcr_pid, first_pcr, first_offset, last_pcr,
+      last_offset);
+
+  pcrtable->first_pcr = first_pcr;
+  pcrtable->first_pcr_ts = PCRTIME_TO_GSTTIME (first_pcr);
+  pcrtable->first_offset = first_offset;
+  pcrtable->last_pcr = last_pcr;
+  pcrtable->last_pcr_ts = PCRTIME_TO_GSTTIME (last_pcr);
+  pcrtable->last_offset = last_offset;
+  packetizer->priv->nb_seen_offsets += 2;
+}
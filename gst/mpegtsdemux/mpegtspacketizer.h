@@ -38,6 +38,7 @@
 #define MPEGTS_MIN_PACKETSIZE MPEGTS_NORMAL_PACKETSIZE
 #define MPEGTS_MAX_PACKETSIZE MPEGTS_ATSC_PACKETSIZE
 
+#define MPEGTS_AFC_RANDOM_ACCESS_FLAG	0x40
 #define MPEGTS_AFC_PCR_FLAG	0x10
 #define MPEGTS_AFC_OPCR_FLAG	0x08
 
@@ -176,6 +177,11 @@ G_GNUC_INTERNAL MpegTSPacketizerPacketReturn
 mpegts_packetizer_process_next_packet(MpegTSPacketizer2 * packetizer);
 G_GNUC_INTERNAL void mpegts_packetizer_clear_packet (MpegTSPacketizer2 *packetizer,
 				     MpegTSPacketizerPacket *packet);
+/* Returns the buffer (transfer none) containing @packet, and the offset of
+ * packet->data_start within it. Only valid until the packet is cleared */
+G_GNUC_INTERNAL GstBuffer *
+mpegts_packetizer_get_packet_buffer (MpegTSPacketizer2 *packetizer,
+  MpegTSPacketizerPacket *packet, gsize *offset);
 G_GNUC_INTERNAL void mpegts_packetizer_remove_stream(MpegTSPacketizer2 *packetizer,
   gint16 pid);
 
@@ -210,9 +216,21 @@ mpegts_packetizer_ts_to_offset (MpegTSPacketizer2 * packetizer,
 G_GNUC_INTERNAL GstClockTime
 mpegts_packetizer_pts_to_ts (MpegTSPacketizer2 * packetizer,
 			     GstClockTime pts, guint16 pcr_pid);
+G_GNUC_INTERNAL GstClockTime
+mpegts_packetizer_get_current_time (MpegTSPacketizer2 * packetizer);
 G_GNUC_INTERNAL void
 mpegts_packetizer_set_reference_offset (MpegTSPacketizer2 * packetizer,
 					guint64 refoffset);
+G_GNUC_INTERNAL gboolean
+mpegts_packetizer_get_pcr_range (MpegTSPacketizer2 * packetizer,
+				 guint16 pcr_pid, guint64 * first_pcr,
+				 guint64 * first_offset, guint64 * last_pcr,
+				 guint64 * last_offset);
+G_GNUC_INTERNAL void
+mpegts_packetizer_set_pcr_range (MpegTSPacketizer2 * packetizer,
+				 guint16 pcr_pid, guint64 first_pcr,
+				 guint64 first_offset, guint64 last_pcr,
+				 guint64 last_offset);
 G_END_DECLS
 
 #endif /* GST_MPEGTS_PACKETIZER_H */
@@ -64,6 +64,14 @@ struct _MpegTSParsePad
 
   /* the return of the latest push */
   GstFlowReturn flow_return;
+
+  /* Packets queued for this pad while handling the current input buffer.
+   * Contiguous packets are coalesced in a run which is turned into a
+   * sub-buffer of the packetizer buffer once the run is interrupted */
+  GstBufferList *pending;
+  GstBuffer *run_buffer;
+  gsize run_offset;
+  gsize run_size;
 };
 
 static GstStaticPadTemplate src_template =
@@ -105,6 +113,8 @@ static void mpegts_parse_release_pad (GstElement * element, GstPad * pad);
 static gboolean mpegts_parse_src_pad_query (GstPad * pad, GstObject * parent,
     GstQuery * query);
 static gboolean push_event (MpegTSBase * base, GstEvent * event);
+static GstFlowReturn mpegts_parse_push_pending (MpegTSParse2 * parse);
+static void mpegts_parse_clear_pending (MpegTSParse2 * parse);
 
 #define mpegts_parse_parent_class parent_class
 G_DEFINE_TYPE (MpegTSParse2, mpegts_parse, GST_TYPE_MPEGTS_BASE);
@@ -186,6 +196,14 @@ push_event (MpegTSBase * base, GstEvent * event)
   MpegTSParse2 *parse = (MpegTSParse2 *) base;
   GList *tmp;
 
+  /* Packets queued before the event must be pushed out before it, unless
+   * we are flushing */
+  if (GST_EVENT_TYPE (event) == GST_EVENT_FLUSH_START
+      || GST_EVENT_TYPE (event) == GST_EVENT_FLUSH_STOP)
+    mpegts_parse_clear_pending (parse);
+  else
+    mpegts_parse_push_pending (parse);
+
   for (tmp = parse->srcpads; tmp; tmp = tmp->next) {
     GstPad *pad = (GstPad *) tmp->data;
     if (pad) {
@@ -216,14 +234,31 @@ mpegts_parse_create_tspad (MpegTSParse2 * parse, const gchar * pad_name)
   tspad->program = NULL;
   tspad->pushed = FALSE;
   tspad->flow_return = GST_FLOW_NOT_LINKED;
+  tspad->pending = NULL;
+  tspad->run_buffer = NULL;
   gst_pad_set_element_private (pad, tspad);
 
   return tspad;
 }
 
+static void
+mpegts_parse_tspad_clear_pending (MpegTSParsePad * tspad)
+{
+  if (tspad->run_buffer) {
+    gst_buffer_unref (tspad->run_buffer);
+    tspad->run_buffer = NULL;
+  }
+  if (tspad->pending) {
+    gst_buffer_list_unref (tspad->pending);
+    tspad->pending = NULL;
+  }
+}
+
 static void
 mpegts_parse_destroy_tspad (MpegTSParse2 * parse, MpegTSParsePad * tspad)
 {
+  mpegts_parse_tspad_clear_pending (tspad);
+
   /* free the wrapper */
   g_free (tspad);
 }
@@ -303,11 +338,73 @@ mpegts_parse_release_pad (GstElement * element, GstPad * pad)
   gst_element_remove_pad (element, pad);
 }
 
+/* Moves the current run of packets to the pending buffer list */
+static void
+mpegts_parse_tspad_close_run (MpegTSParsePad * tspad)
+{
+  if (tspad->run_buffer == NULL)
+    return;
+
+  if (tspad->pending == NULL)
+    tspad->pending = gst_buffer_list_new ();
+  gst_buffer_list_add (tspad->pending,
+      gst_buffer_copy_region (tspad->run_buffer, GST_BUFFER_COPY_MEMORY,
+          tspad->run_offset, tspad->run_size));
+
+  gst_buffer_unref (tspad->run_buffer);
+  tspad->run_buffer = NULL;
+}
+
+static void
+mpegts_parse_tspad_queue_packet (MpegTSParse2 * parse, MpegTSParsePad * tspad,
+    MpegTSPacketizerPacket * packet)
+{
+  GstBuffer *buffer;
+  gsize offset, size;
+
+  buffer =
+      mpegts_packetizer_get_packet_buffer (GST_MPEGTS_BASE (parse)->packetizer,
+      packet, &offset);
+  size = packet->data_end - packet->data_start;
+
+  /* Extend the current run if the packet directly follows it */
+  if (tspad->run_buffer == buffer
+      && tspad->run_offset + tspad->run_size == offset) {
+    tspad->run_size += size;
+    return;
+  }
+
+  mpegts_parse_tspad_close_run (tspad);
+
+  tspad->run_buffer = gst_buffer_ref (buffer);
+  tspad->run_offset = offset;
+  tspad->run_size = size;
+}
+
 static GstFlowReturn
+mpegts_parse_tspad_push_pending (MpegTSParse2 * parse, MpegTSParsePad * tspad)
+{
+  GstBufferList *list;
+
+  mpegts_parse_tspad_close_run (tspad);
+
+  /* Nothing was queued for this pad */
+  if (tspad->pending == NULL)
+    return GST_FLOW_OK;
+
+  list = tspad->pending;
+  tspad->pending = NULL;
+
+  GST_LOG_OBJECT (tspad->pad, "pushing %u buffers",
+      gst_buffer_list_length (list));
+
+  return gst_pad_push_list (tspad->pad, list);
+}
+
+static void
 mpegts_parse_tspad_push_section (MpegTSParse2 * parse, MpegTSParsePad * tspad,
     MpegTSPacketizerSection * section, MpegTSPacketizerPacket * packet)
 {
-  GstFlowReturn ret = GST_FLOW_OK;
   gboolean to_push = TRUE;
 
   if (tspad->program_number != -1) {
@@ -330,22 +427,14 @@ mpegts_parse_tspad_push_section (MpegTSParse2 * parse, MpegTSParsePad * tspad,
       "pushing section: %d program number: %d table_id: %d", to_push,
       tspad->program_number, section->table_id);
 
-  if (to_push) {
-    GstBuffer *buf =
-        gst_buffer_new_and_alloc (packet->data_end - packet->data_start);
-    gst_buffer_fill (buf, 0, packet->data_start,
-        packet->data_end - packet->data_start);
-    ret = gst_pad_push (tspad->pad, buf);
-  }
-
-  return ret;
+  if (to_push)
+    mpegts_parse_tspad_queue_packet (parse, tspad, packet);
 }
 
-static GstFlowReturn
+static void
 mpegts_parse_tspad_push (MpegTSParse2 * parse, MpegTSParsePad * tspad,
     MpegTSPacketizerPacket * packet)
 {
-  GstFlowReturn ret = GST_FLOW_OK;
   MpegTSBaseStream **pad_pids = NULL;
 
   if (tspad->program_number != -1) {
@@ -355,21 +444,25 @@ mpegts_parse_tspad_push (MpegTSParse2 * parse, MpegTSParsePad * tspad,
     } else {
       /* there's a program filter on the pad but the PMT for the program has not
        * been parsed yet, ignore the pad until we get a PMT */
-      goto out;
+      return;
     }
   }
 
-  if (pad_pids == NULL || pad_pids[packet->pid]) {
-    GstBuffer *buf =
-        gst_buffer_new_and_alloc (packet->data_end - packet->data_start);
-    gst_buffer_fill (buf, 0, packet->data_start,
-        packet->data_end - packet->data_start);
-    /* push if there's no filter or if the pid is in the filter */
-    ret = gst_pad_push (tspad->pad, buf);
-  }
+  /* push if there's no filter or if the pid is in the filter */
+  if (pad_pids == NULL || pad_pids[packet->pid])
+    mpegts_parse_tspad_queue_packet (parse, tspad, packet);
+}
 
-out:
-  return ret;
+static void
+mpegts_parse_clear_pending (MpegTSParse2 * parse)
+{
+  GList *tmp;
+
+  GST_OBJECT_LOCK (parse);
+  for (tmp = parse->srcpads; tmp; tmp = tmp->next)
+    mpegts_parse_tspad_clear_pending (gst_pad_get_element_private ((GstPad *)
+            tmp->data));
+  GST_OBJECT_UNLOCK (parse);
 }
 
 static void
@@ -381,11 +474,38 @@ pad_clear_for_push (GstPad * pad, MpegTSParse2 * parse)
   tspad->pushed = FALSE;
 }
 
+/* Packets are only queued on the request pads here, they are pushed out as
+ * buffer lists once the whole input buffer has been handled (or before an
+ * event is sent) by mpegts_parse_push_pending() */
 static GstFlowReturn
 mpegts_parse_push (MpegTSBase * base, MpegTSPacketizerPacket * packet,
     MpegTSPacketizerSection * section)
 {
   MpegTSParse2 *parse = (MpegTSParse2 *) base;
+  MpegTSParsePad *tspad;
+  GList *tmp;
+
+  /* Shortcut: If no request pads exist, just return */
+  if (parse->srcpads == NULL)
+    return GST_FLOW_OK;
+
+  GST_OBJECT_LOCK (parse);
+  for (tmp = parse->srcpads; tmp; tmp = tmp->next) {
+    tspad = gst_pad_get_element_private ((GstPad *) tmp->data);
+
+    if (section)
+      mpegts_parse_tspad_push_section (parse, tspad, section, packet);
+    else
+      mpegts_parse_tspad_push (parse, tspad, packet);
+  }
+  GST_OBJECT_UNLOCK (parse);
+
+  return GST_FLOW_OK;
+}
+
+static GstFlowReturn
+mpegts_parse_push_pending (MpegTSParse2 * parse)
+{
   guint32 pads_cookie;
   gboolean done = FALSE;
   GstPad *pad = NULL;
@@ -419,12 +539,7 @@ mpegts_parse_push (MpegTSBase * base, MpegTSPacketizerPacket * packet,
     tspad = gst_pad_get_element_private (pad);
 
     if (G_LIKELY (!tspad->pushed)) {
-      if (section) {
-        tspad->flow_return =
-            mpegts_parse_tspad_push_section (parse, tspad, section, packet);
-      } else {
-        tspad->flow_return = mpegts_parse_tspad_push (parse, tspad, packet);
-      }
+      tspad->flow_return = mpegts_parse_tspad_push_pending (parse, tspad);
       tspad->pushed = TRUE;
 
       if (G_UNLIKELY (tspad->flow_return != GST_FLOW_OK
@@ -463,6 +578,10 @@ mpegts_parse_push (MpegTSBase * base, MpegTSPacketizerPacket * packet,
     }
   }
 
+  /* Drop whatever couldn't be pushed because of an error */
+  if (G_UNLIKELY (ret != GST_FLOW_OK && ret != GST_FLOW_NOT_LINKED))
+    mpegts_parse_clear_pending (parse);
+
   return ret;
 }
 
@@ -470,6 +589,13 @@ static GstFlowReturn
 mpegts_parse_input_done (MpegTSBase * base, GstBuffer * buffer)
 {
   MpegTSParse2 *parse = GST_MPEGTS_PARSE (base);
+  GstFlowReturn ret;
+
+  ret = mpegts_parse_push_pending (parse);
+  if (G_UNLIKELY (ret != GST_FLOW_OK)) {
+    gst_buffer_unref (buffer);
+    return ret;
+  }
 
   return gst_pad_push (parse->srcpad, buffer);
 }
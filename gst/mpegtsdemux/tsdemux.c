@@ -35,6 +35,7 @@
 #include <string.h>
 
 #include <glib.h>
+#include <glib/gstdio.h>
 #include <gst/tag/tag.h>
 
 #include "mpegtsbase.h"
@@ -43,6 +44,8 @@
 #include "gstmpegdefs.h"
 #include "mpegtspacketizer.h"
 #include "pesparse.h"
+#include "tsindex.h"
+#include <gst/codecparsers/gstmpegvideoparser.h>
 
 /*
  * tsdemux
@@ -50,9 +53,12 @@
  * See TODO for explanations on improvements needed
  */
 
-/* latency in mseconds */
+/* latency in mseconds, used until the actual latency has been measured */
 #define TS_LATENCY 700
 
+/* extra latency in mseconds added to the measured latency */
+#define DEFAULT_LATENCY_MARGIN 100
+
 #define TABLE_ID_UNSET 0xFF
 
 #define PCR_WRAP_SIZE_128KBPS (((gint64)1490)*(1024*1024))
@@ -107,6 +113,14 @@ typedef enum
 
 typedef struct _TSDemuxStream TSDemuxStream;
 
+/* Payload of a TS packet, as a region of the input buffer holding it */
+typedef struct
+{
+  GstBuffer *buffer;
+  gsize offset;
+  guint size;
+} TSDemuxPayload;
+
 struct _TSDemuxStream
 {
   MpegTSBaseStream stream;
@@ -121,15 +135,18 @@ struct _TSDemuxStream
   /* Output data */
   PendingPacketState state;
 
-  /* Data to push (allocated) */
-  guint8 *data;
+  /* Payloads of the pending PES packet (TSDemuxPayload), referencing the
+   * input buffers until the output buffer is built */
+  GArray *payloads;
+  /* Whether PES packets can be pushed as several buffers, for the streams
+   * that are reframed by a parser downstream anyway */
+  gboolean split_pes;
 
   /* Size of data to push (if known) */
   guint expected_size;
 
   /* Size of currently queued data */
   guint current_size;
-  guint allocated_size;
 
   /* Current PTS/DTS for this stream */
   GstClockTime pts;
@@ -147,6 +164,11 @@ struct _TSDemuxStream
   /* Whether this stream needs to send a newsegment */
   gboolean need_newsegment;
 
+  /* Offset of the first packet of the current PES and whether that
+   * packet had the random_access_indicator set */
+  guint64 pes_offset;
+  gboolean random_access;
+
   GstTagList *taglist;
 };
 
@@ -217,6 +239,8 @@ enum
   ARG_0,
   PROP_PROGRAM_NUMBER,
   PROP_EMIT_STATS,
+  PROP_LATENCY_MARGIN,
+  PROP_INDEX_LOCATION,
   /* FILL ME */
 };
 
@@ -227,6 +251,7 @@ enum
 static void
 gst_ts_demux_program_started (MpegTSBase * base, MpegTSBaseProgram * program);
 static void gst_ts_demux_reset (MpegTSBase * base);
+static void gst_ts_demux_finalize (GObject * object);
 static GstFlowReturn
 gst_ts_demux_push (MpegTSBase * base, MpegTSPacketizerPacket * packet,
     MpegTSPacketizerSection * section);
@@ -237,6 +262,8 @@ gst_ts_demux_stream_added (MpegTSBase * base, MpegTSBaseStream * stream,
 static void
 gst_ts_demux_stream_removed (MpegTSBase * base, MpegTSBaseStream * stream);
 static GstFlowReturn gst_ts_demux_do_seek (MpegTSBase * base, GstEvent * event);
+static gboolean gst_ts_demux_load_index (MpegTSBase * base);
+static void gst_ts_demux_save_index (GstTSDemux * demux);
 static void gst_ts_demux_set_property (GObject * object, guint prop_id,
     const GValue * value, GParamSpec * pspec);
 static void gst_ts_demux_get_property (GObject * object, guint prop_id,
@@ -274,6 +301,7 @@ gst_ts_demux_class_init (GstTSDemuxClass * klass)
   gobject_class = G_OBJECT_CLASS (klass);
   gobject_class->set_property = gst_ts_demux_set_property;
   gobject_class->get_property = gst_ts_demux_get_property;
+  gobject_class->finalize = gst_ts_demux_finalize;
 
   g_object_class_install_property (gobject_class, PROP_PROGRAM_NUMBER,
       g_param_spec_int ("program-number", "Program number",
@@ -285,6 +313,19 @@ gst_ts_demux_class_init (GstTSDemuxClass * klass)
           "Emit messages for every pcr/opcr/pts/dts", FALSE,
           G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
+  g_object_class_install_property (gobject_class, PROP_LATENCY_MARGIN,
+      g_param_spec_uint ("latency-margin", "Latency margin",
+          "Extra latency (in ms) reported on top of the measured latency "
+          "for live streams", 0, G_MAXUINT, DEFAULT_LATENCY_MARGIN,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_INDEX_LOCATION,
+      g_param_spec_string ("index-location", "Index location",
+          "Location of the seek index file of the recording. It is used "
+          "instead of scanning the recording if it is up to date, and "
+          "written when done", NULL,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
   element_class = GST_ELEMENT_CLASS (klass);
   gst_element_class_add_pad_template (element_class,
       gst_static_pad_template_get (&video_template));
@@ -311,6 +352,7 @@ gst_ts_demux_class_init (GstTSDemuxClass * klass)
   ts_class->stream_removed = gst_ts_demux_stream_removed;
   ts_class->seek = GST_DEBUG_FUNCPTR (gst_ts_demux_do_seek);
   ts_class->flush = GST_DEBUG_FUNCPTR (gst_ts_demux_flush);
+  ts_class->load_index = GST_DEBUG_FUNCPTR (gst_ts_demux_load_index);
 }
 
 static void
@@ -331,16 +373,47 @@ gst_ts_demux_reset (MpegTSBase * base)
     gst_event_unref (demux->update_segment);
     demux->update_segment = NULL;
   }
+
+  GST_OBJECT_LOCK (demux);
+  demux->latency = GST_CLOCK_TIME_NONE;
+  demux->reported_latency = GST_CLOCK_TIME_NONE;
+  GST_OBJECT_UNLOCK (demux);
+
+  /* reset is called from the base class init before ours */
+  if (demux->index) {
+    gst_ts_demux_save_index (demux);
+    g_array_set_size (demux->index, 0);
+  }
+  demux->index_pid = -1;
+  demux->index_last_offset = -1;
+  demux->index_program_number = -1;
+  demux->index_file_size = -1;
+  demux->index_dirty = FALSE;
 }
 
 static void
 gst_ts_demux_init (GstTSDemux * demux)
 {
   GST_MPEGTS_BASE (demux)->stream_size = sizeof (TSDemuxStream);
+  demux->latency_margin = DEFAULT_LATENCY_MARGIN * GST_MSECOND;
+  demux->index = g_array_new (FALSE, FALSE, sizeof (TSIndexEntry));
+  demux->h264parser = gst_h264_nal_parser_new ();
 
   gst_ts_demux_reset ((MpegTSBase *) demux);
 }
 
+static void
+gst_ts_demux_finalize (GObject * object)
+{
+  GstTSDemux *demux = GST_TS_DEMUX (object);
+
+  g_array_free (demux->index, TRUE);
+  gst_h264_nal_parser_free (demux->h264parser);
+  g_free (demux->index_location);
+
+  G_OBJECT_CLASS (parent_class)->finalize (object);
+}
+
 
 static void
 gst_ts_demux_set_property (GObject * object, guint prop_id,
@@ -357,6 +430,17 @@ gst_ts_demux_set_property (GObject * object, guint prop_id,
     case PROP_EMIT_STATS:
       demux->emit_statistics = g_value_get_boolean (value);
       break;
+    case PROP_LATENCY_MARGIN:
+      GST_OBJECT_LOCK (demux);
+      demux->latency_margin = g_value_get_uint (value) * GST_MSECOND;
+      GST_OBJECT_UNLOCK (demux);
+      break;
+    case PROP_INDEX_LOCATION:
+      GST_OBJECT_LOCK (demux);
+      g_free (demux->index_location);
+      demux->index_location = g_value_dup_string (value);
+      GST_OBJECT_UNLOCK (demux);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
   }
@@ -375,6 +459,16 @@ gst_ts_demux_get_property (GObject * object, guint prop_id,
     case PROP_EMIT_STATS:
       g_value_set_boolean (value, demux->emit_statistics);
       break;
+    case PROP_LATENCY_MARGIN:
+      GST_OBJECT_LOCK (demux);
+      g_value_set_uint (value, demux->latency_margin / GST_MSECOND);
+      GST_OBJECT_UNLOCK (demux);
+      break;
+    case PROP_INDEX_LOCATION:
+      GST_OBJECT_LOCK (demux);
+      g_value_set_string (value, demux->index_location);
+      GST_OBJECT_UNLOCK (demux);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
   }
@@ -424,7 +518,7 @@ gst_ts_demux_srcpad_query (GstPad * pad, GstObject * parent, GstQuery * query)
       GST_DEBUG ("query latency");
       res = gst_pad_peer_query (base->sinkpad, query);
       if (res && base->upstream_live) {
-        GstClockTime min_lat, max_lat;
+        GstClockTime min_lat, max_lat, latency;
         gboolean live;
 
         /* According to H.222.0
@@ -432,13 +526,25 @@ gst_ts_demux_srcpad_query (GstPad * pad, GstObject * parent, GstQuery * query)
            and D.0.2 (Audio and video presentation synchronization)
 
            We can end up with an interval of up to 700ms between valid
-           PCR/SCR. We therefore allow a latency of 700ms for that.
+           PCR/SCR. We therefore allow a latency of 700ms for that until
+           we have measured the actual latency of the stream.
          */
+        GST_OBJECT_LOCK (demux);
+        if (GST_CLOCK_TIME_IS_VALID (demux->latency))
+          latency = demux->latency + demux->latency_margin;
+        else
+          latency = TS_LATENCY * GST_MSECOND;
+        demux->reported_latency = latency;
+        GST_OBJECT_UNLOCK (demux);
+
+        GST_DEBUG_OBJECT (demux, "Reporting latency of %" GST_TIME_FORMAT,
+            GST_TIME_ARGS (latency));
+
         gst_query_parse_latency (query, &live, &min_lat, &max_lat);
         if (min_lat != -1)
-          min_lat += 700 * GST_MSECOND;
+          min_lat += latency;
         if (max_lat != -1)
-          max_lat += 700 * GST_MSECOND;
+          max_lat += latency;
         gst_query_set_latency (query, live, min_lat, max_lat);
       }
       break;
@@ -473,6 +579,167 @@ gst_ts_demux_srcpad_query (GstPad * pad, GstObject * parent, GstQuery * query)
 
 }
 
+/* Identify the upstream recording by its size and, for local files, its
+ * modification time */
+static gboolean
+gst_ts_demux_get_upstream_identity (GstTSDemux * demux, guint64 * size,
+    guint64 * mtime)
+{
+  MpegTSBase *base = (MpegTSBase *) demux;
+  GstQuery *query;
+  gchar *uri = NULL, *filename = NULL;
+  GStatBuf st;
+  gint64 tmpval;
+
+  if (!gst_pad_peer_query_duration (base->sinkpad, GST_FORMAT_BYTES, &tmpval)
+      || tmpval <= 0)
+    return FALSE;
+  *size = tmpval;
+  *mtime = 0;
+
+  query = gst_query_new_uri ();
+  if (gst_pad_peer_query (base->sinkpad, query))
+    gst_query_parse_uri (query, &uri);
+  gst_query_unref (query);
+
+  if (uri && gst_uri_has_protocol (uri, "file"))
+    filename = g_filename_from_uri (uri, NULL, NULL);
+  if (filename && g_stat (filename, &st) == 0)
+    *mtime = st.st_mtime;
+
+  g_free (filename);
+  g_free (uri);
+
+  return TRUE;
+}
+
+/* Restore the result of the initial scan and the keyframe index from the
+ * index file, if there is an up to date one */
+static gboolean
+gst_ts_demux_load_index (MpegTSBase * base)
+{
+  GstTSDemux *demux = GST_TS_DEMUX_CAST (base);
+  TSIndexFile index;
+  gchar *location;
+  guint64 size, mtime;
+  gboolean res = FALSE;
+
+  GST_OBJECT_LOCK (demux);
+  location = g_strdup (demux->index_location);
+  GST_OBJECT_UNLOCK (demux);
+
+  if (location == NULL)
+    return FALSE;
+
+  if (!gst_ts_demux_get_upstream_identity (demux, &size, &mtime)) {
+    GST_DEBUG_OBJECT (demux, "Couldn't identify upstream, not using index");
+    goto done;
+  }
+  demux->index_file_size = size;
+  demux->index_file_mtime = mtime;
+  /* Written back once we are done, unless what we load is up to date */
+  demux->index_dirty = TRUE;
+
+  index.entries = demux->index;
+  if (!ts_index_file_load (location, &index))
+    goto done;
+
+  if (index.file_size != size || index.file_mtime != mtime) {
+    GST_DEBUG_OBJECT (demux, "Index %s is out of date", location);
+    goto done;
+  }
+
+  base->seek_offset = base->sync_offset = index.sync_offset;
+  base->packetsize = index.packet_size;
+  mpegts_packetizer_set_pcr_range (base->packetizer, index.pcr_pid,
+      index.first_pcr, index.first_offset, index.last_pcr, index.last_offset);
+
+  demux->index_program_number = index.program_number;
+  demux->index_pcr_pid = index.pcr_pid;
+  demux->index_pid = index.index_pid;
+  demux->index_dirty = FALSE;
+
+  GST_INFO_OBJECT (demux, "Using index %s with %u keyframes", location,
+      demux->index->len);
+  res = TRUE;
+
+done:
+  if (!res)
+    g_array_set_size (demux->index, 0);
+  g_free (location);
+
+  return res;
+}
+
+static void
+gst_ts_demux_save_index (GstTSDemux * demux)
+{
+  MpegTSBase *base = (MpegTSBase *) demux;
+  TSIndexFile index;
+  gchar *location;
+
+  if (!demux->index_dirty || demux->index_file_size == -1
+      || demux->index_program_number == -1)
+    return;
+
+  if (!mpegts_packetizer_get_pcr_range (base->packetizer,
+          demux->index_pcr_pid, &index.first_pcr, &index.first_offset,
+          &index.last_pcr, &index.last_offset))
+    return;
+
+  index.file_size = demux->index_file_size;
+  index.file_mtime = demux->index_file_mtime;
+  index.sync_offset = base->sync_offset;
+  index.packet_size = base->packetsize;
+  index.program_number = demux->index_program_number;
+  index.pcr_pid = demux->index_pcr_pid;
+  index.index_pid = demux->index_pid;
+  index.entries = demux->index;
+
+  GST_OBJECT_LOCK (demux);
+  location = g_strdup (demux->index_location);
+  GST_OBJECT_UNLOCK (demux);
+
+  if (location && ts_index_file_save (location, &index))
+    demux->index_dirty = FALSE;
+  g_free (location);
+}
+
+/* Returns the offset of the last indexed keyframe at or before @ts, or -1
+ * if the index doesn't cover @ts. An entry is only trusted if the entry
+ * following it was seen contiguously, else there could be a keyframe in
+ * between that we never saw. */
+static guint64
+gst_ts_demux_index_lookup (GstTSDemux * demux, GstClockTime ts)
+{
+  TSIndexEntry *entries = (TSIndexEntry *) demux->index->data;
+  guint len = demux->index->len;
+  guint lo, hi, mid;
+
+  if (len < 2 || entries[0].ts > ts)
+    return -1;
+
+  /* entries[lo].ts <= ts < entries[hi].ts */
+  lo = 0;
+  hi = len;
+  while (hi - lo > 1) {
+    mid = (lo + hi) / 2;
+    if (entries[mid].ts <= ts)
+      lo = mid;
+    else
+      hi = mid;
+  }
+
+  if (hi == len || !entries[hi].contiguous)
+    return -1;
+
+  GST_DEBUG_OBJECT (demux, "Found keyframe %" GST_TIME_FORMAT " at offset %"
+      G_GUINT64_FORMAT " for %" GST_TIME_FORMAT,
+      GST_TIME_ARGS (entries[lo].ts), entries[lo].offset, GST_TIME_ARGS (ts));
+
+  return entries[lo].offset;
+}
+
 static GstFlowReturn
 gst_ts_demux_do_seek (MpegTSBase * base, GstEvent * event)
 {
@@ -521,10 +788,13 @@ gst_ts_demux_do_seek (MpegTSBase * base, GstEvent * event)
   GST_DEBUG ("seeksegment after set_seek " SEGMENT_FORMAT,
       SEGMENT_ARGS (seeksegment));
 
-  /* Convert start/stop to offset */
-  start_offset =
-      mpegts_packetizer_ts_to_offset (base->packetizer, MAX (0,
-          start - SEEK_TIMESTAMP_OFFSET), demux->program->pcr_pid);
+  /* Convert start/stop to offset. Use the keyframe index if it covers the
+   * requested position, else interpolate from the PCR observations */
+  start_offset = gst_ts_demux_index_lookup (demux, MAX (0, start));
+  if (start_offset == -1)
+    start_offset =
+        mpegts_packetizer_ts_to_offset (base->packetizer, MAX (0,
+            start - SEEK_TIMESTAMP_OFFSET), demux->program->pcr_pid);
 
   if (G_UNLIKELY (start_offset == -1)) {
     GST_WARNING ("Couldn't convert start position to an offset");
@@ -533,6 +803,7 @@ gst_ts_demux_do_seek (MpegTSBase * base, GstEvent * event)
 
   /* record offset */
   base->seek_offset = start_offset;
+  demux->index_last_offset = -1;
   res = GST_FLOW_OK;
 
   /* commit the new segment */
@@ -582,6 +853,9 @@ push_event (MpegTSBase * base, GstEvent * event)
     return FALSE;
   }
 
+  if (GST_EVENT_TYPE (event) == GST_EVENT_EOS)
+    gst_ts_demux_save_index (demux);
+
   for (tmp = demux->program->stream_list; tmp; tmp = tmp->next) {
     TSDemuxStream *stream = (TSDemuxStream *) tmp->data;
     if (stream->pad) {
@@ -694,6 +968,7 @@ create_pad_for_stream (MpegTSBase * base, MpegTSBaseStream * bstream,
           "mpegversion", G_TYPE_INT,
           bstream->stream_type == ST_VIDEO_MPEG1 ? 1 : 2, "systemstream",
           G_TYPE_BOOLEAN, FALSE, NULL);
+      stream->split_pes = TRUE;
 
       break;
     case ST_AUDIO_MPEG1:
@@ -776,6 +1051,7 @@ create_pad_for_stream (MpegTSBase * base, MpegTSBaseStream * bstream,
         caps = gst_caps_new_simple ("video/x-h264",
             "stream-format", G_TYPE_STRING, "byte-stream",
             "alignment", G_TYPE_STRING, "nal", NULL);
+        stream->split_pes = TRUE;
       }
       break;
     case ST_HDV_AUX_V:
@@ -819,6 +1095,7 @@ create_pad_for_stream (MpegTSBase * base, MpegTSBaseStream * bstream,
       caps = gst_caps_new_simple ("video/mpeg",
           "mpegversion", G_TYPE_INT, 4,
           "systemstream", G_TYPE_BOOLEAN, FALSE, NULL);
+      stream->split_pes = TRUE;
       break;
     case ST_VIDEO_H264:
       template = gst_static_pad_template_get (&video_template);
@@ -826,6 +1103,7 @@ create_pad_for_stream (MpegTSBase * base, MpegTSBaseStream * bstream,
       caps = gst_caps_new_simple ("video/x-h264",
           "stream-format", G_TYPE_STRING, "byte-stream",
           "alignment", G_TYPE_STRING, "nal", NULL);
+      stream->split_pes = TRUE;
       break;
     case ST_VIDEO_DIRAC:
       desc =
@@ -1008,6 +1286,8 @@ gst_ts_demux_stream_added (MpegTSBase * base, MpegTSBaseStream * bstream,
     stream->fixed_dts = 0;
     stream->nb_pts_rollover = 0;
     stream->nb_dts_rollover = 0;
+    stream->pes_offset = -1;
+    stream->random_access = FALSE;
   }
   stream->flow_return = GST_FLOW_OK;
 }
@@ -1033,6 +1313,10 @@ gst_ts_demux_stream_removed (MpegTSBase * base, MpegTSBaseStream * bstream)
     stream->pad = NULL;
   }
   gst_ts_demux_stream_flush (stream);
+  if (stream->payloads) {
+    g_array_free (stream->payloads, TRUE);
+    stream->payloads = NULL;
+  }
   stream->flow_return = GST_FLOW_NOT_LINKED;
 }
 
@@ -1066,6 +1350,21 @@ activate_pad_for_stream (GstTSDemux * tsdemux, TSDemuxStream * stream)
         ((MpegTSBaseStream *) stream)->stream_type);
 }
 
+static void
+gst_ts_demux_stream_clear_payloads (TSDemuxStream * stream)
+{
+  guint i;
+
+  if (stream->payloads == NULL)
+    return;
+
+  for (i = 0; i < stream->payloads->len; i++)
+    gst_buffer_unref (g_array_index (stream->payloads, TSDemuxPayload,
+            i).buffer);
+  g_array_set_size (stream->payloads, 0);
+  stream->current_size = 0;
+}
+
 static void
 gst_ts_demux_stream_flush (TSDemuxStream * stream)
 {
@@ -1073,12 +1372,9 @@ gst_ts_demux_stream_flush (TSDemuxStream * stream)
 
   GST_DEBUG ("flushing stream %p", stream);
 
-  if (stream->data)
-    g_free (stream->data);
-  stream->data = NULL;
+  gst_ts_demux_stream_clear_payloads (stream);
   stream->state = PENDING_PACKET_EMPTY;
   stream->expected_size = 0;
-  stream->allocated_size = 0;
   stream->current_size = 0;
   stream->need_newsegment = TRUE;
   stream->pts = GST_CLOCK_TIME_NONE;
@@ -1089,6 +1385,8 @@ gst_ts_demux_stream_flush (TSDemuxStream * stream)
   stream->fixed_dts = 0;
   stream->nb_pts_rollover = 0;
   stream->nb_dts_rollover = 0;
+  stream->pes_offset = -1;
+  stream->random_access = FALSE;
 }
 
 static void
@@ -1110,6 +1408,15 @@ gst_ts_demux_program_started (MpegTSBase * base, MpegTSBaseProgram * program)
       demux->program_number == program->program_number) {
 
     GST_LOG ("program %d started", program->program_number);
+    /* The index only applies to the program it was built for */
+    if (demux->program != program && (demux->program != NULL
+            || demux->index_program_number != program->program_number)) {
+      g_array_set_size (demux->index, 0);
+      demux->index_pid = -1;
+      demux->index_last_offset = -1;
+    }
+    demux->index_program_number = program->program_number;
+    demux->index_pcr_pid = program->pcr_pid;
     demux->program_number = program->program_number;
     demux->program = program;
 
@@ -1234,9 +1541,145 @@ gst_ts_demux_record_dts (GstTSDemux * demux, TSDemuxStream * stream,
   }
 }
 
+/* Queues the payload without copying it, by referencing the region of the
+ * input buffer containing it */
+static void
+gst_ts_demux_stream_add_payload (GstTSDemux * demux, TSDemuxStream * stream,
+    MpegTSPacketizerPacket * packet, guint8 * data, guint size)
+{
+  TSDemuxPayload payload;
+  GstBuffer *buffer;
+  gsize offset;
+
+  if (G_UNLIKELY (size == 0))
+    return;
+
+  buffer = mpegts_packetizer_get_packet_buffer (MPEG_TS_BASE_PACKETIZER (demux),
+      packet, &offset);
+
+  if (G_UNLIKELY (stream->payloads == NULL))
+    stream->payloads = g_array_sized_new (FALSE, FALSE,
+        sizeof (TSDemuxPayload), 64);
+
+  payload.buffer = gst_buffer_ref (buffer);
+  payload.offset = offset + (data - packet->data_start);
+  payload.size = size;
+  g_array_append_val (stream->payloads, payload);
+  stream->current_size += size;
+}
+
+/* Returns a buffer sharing the regions of the input buffers containing
+ * @n_payloads payloads of the pending PES packet, from payload @first */
+static GstBuffer *
+gst_ts_demux_stream_share_payloads (TSDemuxStream * stream, guint first,
+    guint n_payloads)
+{
+  TSDemuxPayload *payload;
+  GstBuffer *buffer;
+  guint i;
+
+  if (n_payloads == 1) {
+    payload = &g_array_index (stream->payloads, TSDemuxPayload, first);
+    return gst_buffer_copy_region (payload->buffer, GST_BUFFER_COPY_MEMORY,
+        payload->offset, payload->size);
+  }
+
+  buffer = gst_buffer_new ();
+  for (i = first; i < first + n_payloads; i++) {
+    payload = &g_array_index (stream->payloads, TSDemuxPayload, i);
+    gst_buffer_copy_into (buffer, payload->buffer, GST_BUFFER_COPY_MEMORY,
+        payload->offset, payload->size);
+  }
+
+  return buffer;
+}
+
+/* Builds the output buffer of the pending PES packet. The payloads are
+ * separated by TS headers in the input, so the output buffer shares one
+ * region of the input buffers per payload and consumers needing contiguous
+ * data merge them when mapping. A buffer can only hold a limited number of
+ * memories and appending past it merges them all again, so the payloads of
+ * longer PES packets are copied once into a buffer of the final size
+ * instead, see gst_ts_demux_stream_build_buffer_list() for the streams
+ * where this can be avoided */
+static GstBuffer *
+gst_ts_demux_stream_build_buffer (TSDemuxStream * stream)
+{
+  TSDemuxPayload *payload;
+  GstBuffer *buffer, *mapped = NULL;
+  GstMapInfo map, inmap;
+  guint8 *dest;
+  guint i, n_payloads;
+
+  n_payloads = stream->payloads ? stream->payloads->len : 0;
+  if (n_payloads == 0)
+    return gst_buffer_new ();
+
+  if (n_payloads <= gst_buffer_get_max_memory ())
+    return gst_ts_demux_stream_share_payloads (stream, 0, n_payloads);
+
+  GST_LOG ("copying %u payloads of %u bytes", n_payloads,
+      stream->current_size);
+
+  buffer = gst_buffer_new_allocate (NULL, stream->current_size, NULL);
+  gst_buffer_map (buffer, &map, GST_MAP_WRITE);
+  dest = map.data;
+
+  /* Consecutive payloads usually come from the same input buffer, only map
+   * it once */
+  for (i = 0; i < n_payloads; i++) {
+    payload = &g_array_index (stream->payloads, TSDemuxPayload, i);
+    if (payload->buffer != mapped) {
+      if (mapped)
+        gst_buffer_unmap (mapped, &inmap);
+      mapped = payload->buffer;
+      gst_buffer_map (mapped, &inmap, GST_MAP_READ);
+    }
+    memcpy (dest, inmap.data + payload->offset, payload->size);
+    dest += payload->size;
+  }
+  if (mapped)
+    gst_buffer_unmap (mapped, &inmap);
+
+  gst_buffer_unmap (buffer, &map);
+
+  return buffer;
+}
+
+/* Builds the pending PES packet of a stream with split_pes set as a list of
+ * buffers sharing the regions of the input buffers, each holding as many
+ * payloads as a buffer can hold memories. Only the first buffer will carry
+ * the timestamps of the PES packet, the parser downstream reassembles the
+ * frames. Returns NULL if the PES packet fits into a single buffer. */
+static GstBufferList *
+gst_ts_demux_stream_build_buffer_list (TSDemuxStream * stream)
+{
+  GstBufferList *list;
+  guint i, n, n_payloads, max_memory;
+
+  n_payloads = stream->payloads ? stream->payloads->len : 0;
+  max_memory = gst_buffer_get_max_memory ();
+  if (!stream->split_pes || n_payloads <= max_memory)
+    return NULL;
+
+  GST_LOG ("sharing %u payloads of %u bytes", n_payloads,
+      stream->current_size);
+
+  list = gst_buffer_list_sized_new ((n_payloads + max_memory - 1) /
+      max_memory);
+  for (i = 0; i < n_payloads; i += n) {
+    n = MIN (n_payloads - i, max_memory);
+    gst_buffer_list_add (list,
+        gst_ts_demux_stream_share_payloads (stream, i, n));
+  }
+
+  return list;
+}
+
 static void
 gst_ts_demux_parse_pes_header (GstTSDemux * demux, TSDemuxStream * stream,
-    guint8 * data, guint32 length, guint64 bufferoffset)
+    MpegTSPacketizerPacket * packet, guint8 * data, guint32 length,
+    guint64 bufferoffset)
 {
   MpegTSBase *base = (MpegTSBase *) demux;
   PESHeader header;
@@ -1277,15 +1720,9 @@ gst_ts_demux_parse_pes_header (GstTSDemux * demux, TSDemuxStream * stream,
   data += header.header_size;
   length -= header.header_size;
 
-  /* Create the output buffer */
-  if (stream->expected_size)
-    stream->allocated_size = stream->expected_size;
-  else
-    stream->allocated_size = 8192;
-  g_assert (stream->data == NULL);
-  stream->data = g_malloc (stream->allocated_size);
-  memcpy (stream->data, data, length);
-  stream->current_size = length;
+  /* Start queueing the payloads */
+  g_assert (stream->current_size == 0);
+  gst_ts_demux_stream_add_payload (demux, stream, packet, data, length);
 
   stream->state = PENDING_PACKET_BUFFER;
 
@@ -1327,29 +1764,25 @@ gst_ts_demux_queue_data (GstTSDemux * demux, TSDemuxStream * stream,
     {
       GST_LOG ("HEADER: Parsing PES header");
 
+      stream->pes_offset = packet->offset;
+      stream->random_access = (packet->adaptation_field_control & 0x02) &&
+          (packet->afc_flags & MPEGTS_AFC_RANDOM_ACCESS_FLAG);
+
       /* parse the header */
-      gst_ts_demux_parse_pes_header (demux, stream, data, size, packet->offset);
+      gst_ts_demux_parse_pes_header (demux, stream, packet, data, size,
+          packet->offset);
       break;
     }
     case PENDING_PACKET_BUFFER:
     {
       GST_LOG ("BUFFER: appending data");
-      if (G_UNLIKELY (stream->current_size + size > stream->allocated_size)) {
-        GST_LOG ("resizing buffer");
-        stream->allocated_size = stream->allocated_size * 2;
-        stream->data = g_realloc (stream->data, stream->allocated_size);
-      }
-      memcpy (stream->data + stream->current_size, data, size);
-      stream->current_size += size;
+      gst_ts_demux_stream_add_payload (demux, stream, packet, data, size);
       break;
     }
     case PENDING_PACKET_DISCONT:
     {
       GST_LOG ("DISCONT: not storing/pushing");
-      if (G_UNLIKELY (stream->data)) {
-        g_free (stream->data);
-        stream->data = NULL;
-      }
+      gst_ts_demux_stream_clear_payloads (stream);
       break;
     }
     default:
@@ -1452,23 +1885,157 @@ push_new_segment:
   stream->need_newsegment = FALSE;
 }
 
+/* For live streams, the latency introduced by the demuxer is the difference
+ * between the timestamp of the buffer currently being inputted and the
+ * timestamp of the buffer we are pushing out.
+ * A latency message is posted when we didn't measure the latency before
+ * (we were reporting the default latency) or when the reported latency
+ * isn't sufficient anymore. */
+static void
+gst_ts_demux_update_latency (GstTSDemux * demux, GstBuffer * buffer)
+{
+  MpegTSPacketizer2 *packetizer = MPEG_TS_BASE_PACKETIZER (demux);
+  GstClockTime in_time, out_time, latency;
+  gboolean post = FALSE;
+
+  in_time = mpegts_packetizer_get_current_time (packetizer);
+  out_time = GST_BUFFER_DTS (buffer);
+  if (!GST_CLOCK_TIME_IS_VALID (out_time))
+    out_time = GST_BUFFER_PTS (buffer);
+  if (!GST_CLOCK_TIME_IS_VALID (in_time) || !GST_CLOCK_TIME_IS_VALID (out_time))
+    return;
+
+  latency = in_time > out_time ? in_time - out_time : 0;
+
+  GST_OBJECT_LOCK (demux);
+  if (!GST_CLOCK_TIME_IS_VALID (demux->latency) || latency > demux->latency) {
+    if (!GST_CLOCK_TIME_IS_VALID (demux->latency))
+      post = TRUE;
+    demux->latency = latency;
+    if (GST_CLOCK_TIME_IS_VALID (demux->reported_latency) &&
+        latency > demux->reported_latency)
+      post = TRUE;
+  }
+  GST_OBJECT_UNLOCK (demux);
+
+  if (post) {
+    GST_DEBUG_OBJECT (demux, "Measured latency %" GST_TIME_FORMAT
+        ", posting latency message", GST_TIME_ARGS (latency));
+    gst_element_post_message (GST_ELEMENT_CAST (demux),
+        gst_message_new_latency (GST_OBJECT_CAST (demux)));
+  }
+}
+
+/* Check whether the pending PES starts with a keyframe */
+static gboolean
+gst_ts_demux_is_keyframe (GstTSDemux * demux, TSDemuxStream * stream,
+    const guint8 * data, gsize size)
+{
+  guint offset = 0;
+
+  switch (stream->stream.stream_type) {
+    case ST_VIDEO_H264:
+    {
+      GstH264NalUnit nalu;
+
+      if (stream->random_access)
+        return TRUE;
+
+      /* Look for an IDR slice before the first non-IDR slice */
+      while (gst_h264_parser_identify_nalu_unchecked (demux->h264parser, data,
+              offset, size, &nalu) == GST_H264_PARSER_OK) {
+        if (nalu.type == GST_H264_NAL_SLICE_IDR)
+          return TRUE;
+        if (nalu.type >= GST_H264_NAL_SLICE
+            && nalu.type < GST_H264_NAL_SLICE_IDR)
+          break;
+        offset = nalu.offset + 1;
+      }
+      return FALSE;
+    }
+    case ST_VIDEO_MPEG1:
+    case ST_VIDEO_MPEG2:
+    {
+      GstMpegVideoPacket packet;
+      GstMpegVideoPictureHdr hdr;
+
+      if (stream->random_access)
+        return TRUE;
+
+      /* The first picture header tells us the type of the frame */
+      while (gst_mpeg_video_parse (&packet, data, size, offset)) {
+        if (packet.type == GST_MPEG_VIDEO_PACKET_PICTURE)
+          return gst_mpeg_video_parse_picture_header (&hdr, data, size,
+              packet.offset) && hdr.pic_type == GST_MPEG_VIDEO_PICTURE_TYPE_I;
+        offset = packet.offset;
+      }
+      return FALSE;
+    }
+    case ST_VIDEO_MPEG4:
+    case ST_VIDEO_DIRAC:
+      return stream->random_access;
+    default:
+      return FALSE;
+  }
+}
+
+/* Record a keyframe in the seek index. The index is kept sorted by
+ * offset and only built in pull mode, where timestamps and offsets
+ * are stable across seeks. */
+static void
+gst_ts_demux_index_add (GstTSDemux * demux, GstClockTime ts, guint64 offset)
+{
+  TSIndexEntry *entries = (TSIndexEntry *) demux->index->data;
+  guint len = demux->index->len;
+  guint lo = 0, hi = len, mid;
+  gboolean contiguous;
+
+  while (lo < hi) {
+    mid = (lo + hi) / 2;
+    if (entries[mid].offset < offset)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  /* Contiguous if the previous keyframe we saw since the last seek is
+   * the one right before this entry */
+  contiguous = lo > 0 && entries[lo - 1].offset == demux->index_last_offset;
+
+  if (lo < len && entries[lo].offset == offset) {
+    if (contiguous && !entries[lo].contiguous) {
+      entries[lo].contiguous = TRUE;
+      demux->index_dirty = TRUE;
+    }
+  } else {
+    TSIndexEntry entry;
+
+    GST_LOG_OBJECT (demux, "Adding keyframe %" GST_TIME_FORMAT " at offset %"
+        G_GUINT64_FORMAT " (contiguous:%d)", GST_TIME_ARGS (ts), offset,
+        contiguous);
+    entry.ts = ts;
+    entry.offset = offset;
+    entry.contiguous = contiguous;
+    g_array_insert_val (demux->index, lo, entry);
+    demux->index_dirty = TRUE;
+  }
+
+  demux->index_last_offset = offset;
+}
+
 static GstFlowReturn
 gst_ts_demux_push_pending_data (GstTSDemux * demux, TSDemuxStream * stream)
 {
   GstFlowReturn res = GST_FLOW_OK;
   MpegTSBaseStream *bs = (MpegTSBaseStream *) stream;
   GstBuffer *buffer = NULL;
+  GstBufferList *list;
   MpegTSPacketizer2 *packetizer = MPEG_TS_BASE_PACKETIZER (demux);
 
   GST_DEBUG_OBJECT (stream->pad,
       "stream:%p, pid:0x%04x stream_type:%d state:%d", stream, bs->pid,
       bs->stream_type, stream->state);
 
-  if (G_UNLIKELY (stream->data == NULL)) {
-    GST_LOG ("stream->data == NULL");
-    goto beach;
-  }
-
   if (G_UNLIKELY (stream->state == PENDING_PACKET_EMPTY)) {
     GST_LOG ("EMPTY: returning");
     goto beach;
@@ -1482,15 +2049,19 @@ gst_ts_demux_push_pending_data (GstTSDemux * demux, TSDemuxStream * stream)
   if (G_UNLIKELY (!stream->active))
     activate_pad_for_stream (demux, stream);
 
-  if (G_UNLIKELY (stream->pad == NULL)) {
-    g_free (stream->data);
+  if (G_UNLIKELY (stream->pad == NULL))
     goto beach;
-  }
 
   if (G_UNLIKELY (stream->need_newsegment))
     calculate_and_push_newsegment (demux, stream);
 
-  buffer = gst_buffer_new_wrapped (stream->data, stream->current_size);
+  /* The timestamps go on the first buffer of the list, which isn't shared
+   * with anything else yet */
+  list = gst_ts_demux_stream_build_buffer_list (stream);
+  if (list)
+    buffer = gst_buffer_list_get (list, 0);
+  else
+    buffer = gst_ts_demux_stream_build_buffer (stream);
 
   GST_DEBUG_OBJECT (stream->pad, "stream->pts %" GST_TIME_FORMAT,
       GST_TIME_ARGS (stream->pts));
@@ -1508,7 +2079,33 @@ gst_ts_demux_push_pending_data (GstTSDemux * demux, TSDemuxStream * stream)
       GST_TIME_ARGS (GST_BUFFER_PTS (buffer)),
       GST_TIME_ARGS (GST_BUFFER_DTS (buffer)));
 
-  res = gst_pad_push (stream->pad, buffer);
+  if (MPEG_TS_BASE_PACKETIZER (demux)->calculate_skew
+      && GST_MPEGTS_BASE (demux)->upstream_live)
+    gst_ts_demux_update_latency (demux, buffer);
+
+  if (GST_MPEGTS_BASE (demux)->mode != BASE_MODE_PUSHING
+      && packetizer->calculate_offset && GST_BUFFER_PTS_IS_VALID (buffer)
+      && stream->pes_offset != -1 && (demux->index_pid == -1
+          || demux->index_pid == bs->pid)) {
+    GstMapInfo map;
+    gboolean keyframe;
+
+    /* Split PES packets are only checked in their first buffer */
+    gst_buffer_map (buffer, &map, GST_MAP_READ);
+    keyframe = gst_ts_demux_is_keyframe (demux, stream, map.data, map.size);
+    gst_buffer_unmap (buffer, &map);
+
+    if (keyframe) {
+      demux->index_pid = bs->pid;
+      gst_ts_demux_index_add (demux, GST_BUFFER_PTS (buffer),
+          stream->pes_offset);
+    }
+  }
+
+  if (list)
+    res = gst_pad_push_list (stream->pad, list);
+  else
+    res = gst_pad_push (stream->pad, buffer);
   GST_DEBUG_OBJECT (stream->pad, "Returned %s", gst_flow_get_name (res));
   res = tsdemux_combine_flows (demux, stream, res);
   GST_DEBUG_OBJECT (stream->pad, "combined %s", gst_flow_get_name (res));
@@ -1517,7 +2114,7 @@ beach:
   /* Reset everything */
   GST_LOG ("Resetting to EMPTY, returning %s", gst_flow_get_name (res));
   stream->state = PENDING_PACKET_EMPTY;
-  stream->data = NULL;
+  gst_ts_demux_stream_clear_payloads (stream);
   stream->expected_size = 0;
   stream->current_size = 0;
 
@@ -1593,6 +2190,7 @@ gst_ts_demux_plugin_init (GstPlugin * plugin)
   GST_DEBUG_CATEGORY_INIT (ts_demux_debug, "tsdemux", 0,
       "MPEG transport stream demuxer");
   init_pes_parser ();
+  init_ts_index ();
 
   return gst_element_register (plugin, "tsdemux",
       GST_RANK_PRIMARY, GST_TYPE_TS_DEMUX);
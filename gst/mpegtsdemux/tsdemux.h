@@ -30,6 +30,7 @@
 #include <gst/gst.h>
 #include <gst/base/gstbytereader.h>
 #include "mpegtsbase.h"
+#include <gst/codecparsers/gsth264parser.h>
 #include "mpegtspacketizer.h"
 
 G_BEGIN_DECLS
@@ -73,6 +74,29 @@ struct _GstTSDemux
 
   /* Full stream duration */
   GstClockTime duration;
+
+  /* Live latency handling (protected by OBJECT_LOCK).
+   * latency is the biggest observed difference between the input time
+   * and the timestamp of outgoing buffers */
+  GstClockTime latency_margin;
+  GstClockTime latency;
+  GstClockTime reported_latency;
+
+  /* Keyframe index used for seeking in pull mode. Sorted array of
+   * TSIndexEntry, built while playing or loaded from index_location */
+  GArray *index;
+  gint index_pid;
+  guint64 index_last_offset;
+  GstH264NalParser *h264parser;
+
+  /* Index file (location protected by OBJECT_LOCK) */
+  gchar *index_location;
+  gint index_program_number;
+  guint16 index_pcr_pid;
+  guint64 index_file_size;
+  guint64 index_file_mtime;
+  /* TRUE if the index file needs to be (re)written */
+  gboolean index_dirty;
 };
 
 struct _GstTSDemuxClass
@@ -0,0 +1,201 @@
+/*
+ * tsindex.c : MPEG-TS seek index and index files
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <glib.h>
+#include <gst/base/gstbytereader.h>
+#include <gst/base/gstbytewriter.h>
+
+#include "tsindex.h"
+
+GST_DEBUG_CATEGORY_STATIC (ts_index_debug);
+#define GST_CAT_DEFAULT ts_index_debug
+
+/* Index file layout, all values little-endian:
+ *
+ * header (80 bytes)
+ *   0  magic "TSIX"
+ *   4  version                  u32
+ *   8  recording size           u64
+ *  16  recording mtime          u64
+ *  24  sync offset              u64
+ *  32  packet size              u16
+ *  34  PCR PID                  u16
+ *  36  indexed PID (0xffff: -)  u16
+ *  38  reserved                 u16
+ *  40  program number           u32
+ *  44  number of entries        u32
+ *  48  first PCR                u64
+ *  56  first PCR offset         u64
+ *  64  last PCR                 u64
+ *  72  last PCR offset          u64
+ *
+ * followed by the entries (24 bytes each)
+ *   0  timestamp                u64
+ *   8  offset                   u64
+ *  16  flags                    u32
+ *  20  reserved                 u32
+ */
+#define TS_INDEX_MAGIC GST_MAKE_FOURCC ('T', 'S', 'I', 'X')
+#define TS_INDEX_VERSION 1
+#define TS_INDEX_HEADER_SIZE 80
+#define TS_INDEX_ENTRY_SIZE 24
+
+#define TS_INDEX_FLAG_CONTIGUOUS (1 << 0)
+
+gboolean
+ts_index_file_load (const gchar * location, TSIndexFile * index)
+{
+  GMappedFile *mapped;
+  GError *err = NULL;
+  GstByteReader br;
+  guint32 magic, version, program_number, n_entries, flags;
+  guint16 index_pid;
+  TSIndexEntry entry;
+  guint i;
+
+  mapped = g_mapped_file_new (location, FALSE, &err);
+  if (mapped == NULL)
+    goto open_failed;
+
+  gst_byte_reader_init (&br, (const guint8 *) g_mapped_file_get_contents
+      (mapped), g_mapped_file_get_length (mapped));
+
+  if (gst_byte_reader_get_remaining (&br) < TS_INDEX_HEADER_SIZE)
+    goto invalid;
+
+  magic = gst_byte_reader_get_uint32_le_unchecked (&br);
+  version = gst_byte_reader_get_uint32_le_unchecked (&br);
+  if (magic != TS_INDEX_MAGIC || version != TS_INDEX_VERSION)
+    goto invalid;
+
+  index->file_size = gst_byte_reader_get_uint64_le_unchecked (&br);
+  index->file_mtime = gst_byte_reader_get_uint64_le_unchecked (&br);
+  index->sync_offset = gst_byte_reader_get_uint64_le_unchecked (&br);
+  index->packet_size = gst_byte_reader_get_uint16_le_unchecked (&br);
+  index->pcr_pid = gst_byte_reader_get_uint16_le_unchecked (&br);
+  index_pid = gst_byte_reader_get_uint16_le_unchecked (&br);
+  gst_byte_reader_skip_unchecked (&br, 2);
+  program_number = gst_byte_reader_get_uint32_le_unchecked (&br);
+  n_entries = gst_byte_reader_get_uint32_le_unchecked (&br);
+  index->first_pcr = gst_byte_reader_get_uint64_le_unchecked (&br);
+  index->first_offset = gst_byte_reader_get_uint64_le_unchecked (&br);
+  index->last_pcr = gst_byte_reader_get_uint64_le_unchecked (&br);
+  index->last_offset = gst_byte_reader_get_uint64_le_unchecked (&br);
+
+  index->index_pid = index_pid == 0xffff ? -1 : index_pid;
+  index->program_number = program_number;
+
+  if (gst_byte_reader_get_remaining (&br) / TS_INDEX_ENTRY_SIZE < n_entries)
+    goto invalid;
+
+  g_array_set_size (index->entries, 0);
+  for (i = 0; i < n_entries; i++) {
+    entry.ts = gst_byte_reader_get_uint64_le_unchecked (&br);
+    entry.offset = gst_byte_reader_get_uint64_le_unchecked (&br);
+    flags = gst_byte_reader_get_uint32_le_unchecked (&br);
+    gst_byte_reader_skip_unchecked (&br, 4);
+    entry.contiguous = (flags & TS_INDEX_FLAG_CONTIGUOUS) != 0;
+    g_array_append_val (index->entries, entry);
+  }
+
+  GST_DEBUG ("Loaded %u entries from %s", n_entries, location);
+
+  g_mapped_file_unref (mapped);
+  return TRUE;
+
+open_failed:
+  {
+    GST_DEBUG ("Couldn't open index file %s: %s", location, err->message);
+    g_error_free (err);
+    return FALSE;
+  }
+invalid:
+  {
+    GST_WARNING ("Invalid index file %s", location);
+    g_mapped_file_unref (mapped);
+    return FALSE;
+  }
+}
+
+gboolean
+ts_index_file_save (const gchar * location, const TSIndexFile * index)
+{
+  GstByteWriter bw;
+  GError *err = NULL;
+  TSIndexEntry *entry;
+  guint i, n_entries, size;
+  guint8 *data;
+  gboolean res;
+
+  n_entries = index->entries->len;
+  size = TS_INDEX_HEADER_SIZE + n_entries * TS_INDEX_ENTRY_SIZE;
+  gst_byte_writer_init_with_size (&bw, size, TRUE);
+
+  gst_byte_writer_put_uint32_le_unchecked (&bw, TS_INDEX_MAGIC);
+  gst_byte_writer_put_uint32_le_unchecked (&bw, TS_INDEX_VERSION);
+  gst_byte_writer_put_uint64_le_unchecked (&bw, index->file_size);
+  gst_byte_writer_put_uint64_le_unchecked (&bw, index->file_mtime);
+  gst_byte_writer_put_uint64_le_unchecked (&bw, index->sync_offset);
+  gst_byte_writer_put_uint16_le_unchecked (&bw, index->packet_size);
+  gst_byte_writer_put_uint16_le_unchecked (&bw, index->pcr_pid);
+  gst_byte_writer_put_uint16_le_unchecked (&bw,
+      index->index_pid == -1 ? 0xffff : index->index_pid);
+  gst_byte_writer_put_uint16_le_unchecked (&bw, 0);
+  gst_byte_writer_put_uint32_le_unchecked (&bw, index->program_number);
+  gst_byte_writer_put_uint32_le_unchecked (&bw, n_entries);
+  gst_byte_writer_put_uint64_le_unchecked (&bw, index->first_pcr);
+  gst_byte_writer_put_uint64_le_unchecked (&bw, index->first_offset);
+  gst_byte_writer_put_uint64_le_unchecked (&bw, index->last_pcr);
+  gst_byte_writer_put_uint64_le_unchecked (&bw, index->last_offset);
+
+  for (i = 0; i < n_entries; i++) {
+    entry = &g_array_index (index->entries, TSIndexEntry, i);
+    gst_byte_writer_put_uint64_le_unchecked (&bw, entry->ts);
+    gst_byte_writer_put_uint64_le_unchecked (&bw, entry->offset);
+    gst_byte_writer_put_uint32_le_unchecked (&bw,
+        entry->contiguous ? TS_INDEX_FLAG_CONTIGUOUS : 0);
+    gst_byte_writer_put_uint32_le_unchecked (&bw, 0);
+  }
+
+  /* Written to a temporary file and renamed, so readers never see a
+   * partial index */
+  data = gst_byte_writer_reset_and_get_data (&bw);
+  res = g_file_set_contents (location, (const gchar *) data, size, &err);
+  g_free (data);
+
+  if (!res) {
+    GST_WARNING ("Couldn't write index file %s: %s", location, err->message);
+    g_error_free (err);
+  } else {
+    GST_DEBUG ("Wrote %u entries to %s", n_entries, location);
+  }
+
+  return res;
+}
+
+void
+init_ts_index (void)
+{
+  GST_DEBUG_CATEGORY_INIT (ts_index_debug, "tsindex", 0,
+      "MPEG-TS index files");
+}
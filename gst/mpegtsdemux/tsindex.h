@@ -0,0 +1,73 @@
+/*
+ * tsindex.h : MPEG-TS seek index and index files
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __TS_INDEX_H__
+#define __TS_INDEX_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+/* Keyframe entry of the seek index */
+typedef struct
+{
+  /* Timestamp (as pushed downstream) and offset of the keyframe */
+  GstClockTime ts;
+  guint64 offset;
+  /* TRUE if there is no other keyframe between the previous entry
+   * and this one */
+  gboolean contiguous;
+} TSIndexEntry;
+
+/* Everything needed to start a recording without scanning it, as stored
+ * in an index file */
+typedef struct
+{
+  /* Identity of the recording the index was built from */
+  guint64 file_size;
+  guint64 file_mtime;
+
+  /* Initial sync point and packet size */
+  guint64 sync_offset;
+  guint16 packet_size;
+
+  /* Program and PIDs */
+  gint program_number;
+  guint16 pcr_pid;
+  gint index_pid;
+
+  /* PCR observations of pcr_pid */
+  guint64 first_pcr;
+  guint64 first_offset;
+  guint64 last_pcr;
+  guint64 last_offset;
+
+  /* Array of TSIndexEntry, sorted by offset */
+  GArray *entries;
+} TSIndexFile;
+
+G_GNUC_INTERNAL gboolean ts_index_file_load (const gchar * location,
+    TSIndexFile * index);
+G_GNUC_INTERNAL gboolean ts_index_file_save (const gchar * location,
+    const TSIndexFile * index);
+
+G_GNUC_INTERNAL void init_ts_index (void);
+
+G_END_DECLS
+#endif /* __TS_INDEX_H__ */
@@ -115,6 +115,11 @@ enum
 #define MPEGTSMUX_DEFAULT_ALIGNMENT    -1
 #define MPEGTSMUX_DEFAULT_M2TS         FALSE
 
+/* number of packets in an output block when alignment is 0 (auto) */
+#define MPEGTSMUX_DEFAULT_BLOCK_PACKETS 32
+/* number of recycled output blocks kept around */
+#define MPEGTSMUX_MIN_BLOCKS            4
+
 static GstStaticPadTemplate mpegtsmux_sink_factory =
     GST_STATIC_PAD_TEMPLATE ("sink_%d",
     GST_PAD_SINK,
@@ -158,6 +163,9 @@ static gboolean new_packet_cb (GstBuffer * buf, void *user_data,
 static void release_buffer_cb (guint8 * data, void *user_data);
 static GstFlowReturn mpegtsmux_collect_packet (MpegTsMux * mux,
     GstBuffer * buf);
+static gboolean mpegtsmux_acquire_block (MpegTsMux * mux);
+static GstFlowReturn mpegtsmux_push_block (MpegTsMux * mux);
+static void mpegtsmux_release_block (MpegTsMux * mux);
 static GstFlowReturn mpegtsmux_push_packets (MpegTsMux * mux, gboolean force);
 static gboolean new_packet_m2ts (MpegTsMux * mux, GstBuffer * buf,
     gint64 new_pcr);
@@ -386,7 +394,12 @@ mpegtsmux_reset (MpegTsMux * mux, gboolean alloc)
     mux->streamheader = NULL;
   }
   gst_event_replace (&mux->force_key_unit_event, NULL);
-  gst_buffer_replace (&mux->out_buffer, NULL);
+  mpegtsmux_release_block (mux);
+  if (mux->out_pool) {
+    gst_buffer_pool_set_active (mux->out_pool, FALSE);
+    gst_object_unref (mux->out_pool);
+    mux->out_pool = NULL;
+  }
 
   GST_COLLECT_PADS_STREAM_LOCK (mux->collect);
   for (walk = mux->collect->data; walk != NULL; walk = g_slist_next (walk))
@@ -1159,26 +1172,36 @@ mpegtsmux_collected (GstCollectPads * pads, GstCollectData * data,
 
     mux->is_delta = delta;
     mux->last_size = stream_data->map_info.size;
+    mux->last_flow_ret = GST_FLOW_OK;
     while (tsmux_stream_bytes_in_buffer (best->stream) > 0) {
       if (!tsmux_write_stream_packet (mux->tsmux, best->stream)) {
+        /* Pushing a full block downstream failed */
+        if (mux->last_flow_ret != GST_FLOW_OK) {
+          GST_DEBUG_OBJECT (mux, "Failed to push block: %s",
+              gst_flow_get_name (mux->last_flow_ret));
+          goto write_fail;
+        }
         /* Failed writing data for some reason. Set appropriate error */
         GST_DEBUG_OBJECT (mux, "Failed to write data packet");
         GST_ELEMENT_ERROR (mux, STREAM, MUX,
             ("Failed writing output data to stream %04x", best->stream->id),
             (NULL));
+        mux->last_flow_ret = GST_FLOW_ERROR;
         goto write_fail;
       }
     }
     /* flush packet cache */
-    mpegtsmux_push_packets (mux, FALSE);
+    ret = mpegtsmux_push_packets (mux, FALSE);
   } else {
     /* EOS */
     /* drain some possibly cached data */
     new_packet_m2ts (mux, NULL, -1);
-    mpegtsmux_push_packets (mux, TRUE);
+    ret = mpegtsmux_push_packets (mux, TRUE);
     gst_pad_push_event (mux->srcpad, gst_event_new_eos ());
   }
 
+  mux->last_flow_ret = ret;
+
   return ret;
 
   /* ERRORS */
@@ -1287,7 +1310,15 @@ new_packet_common_init (MpegTsMux * mux, GstBuffer * buf, guint8 * data,
         hbuf = gst_buffer_new_and_alloc (len);
         gst_buffer_fill (hbuf, 0, data, len);
       } else {
-        hbuf = gst_buffer_copy (buf);
+        GstMapInfo map;
+
+        /* @buf might point into a recycled output block, make sure the
+         * header has its own copy of the data */
+        hbuf = gst_buffer_new_and_alloc (gst_buffer_get_size (buf));
+        gst_buffer_map (hbuf, &map, GST_MAP_WRITE);
+        gst_buffer_extract (buf, 0, map.data, map.size);
+        gst_buffer_unmap (hbuf, &map);
+        gst_buffer_copy_into (hbuf, buf, GST_BUFFER_COPY_METADATA, 0, -1);
       }
       mux->streamheader = g_list_append (mux->streamheader, hbuf);
     } else if (mux->streamheader) {
@@ -1307,6 +1338,34 @@ new_packet_common_init (MpegTsMux * mux, GstBuffer * buf, guint8 * data,
   }
 }
 
+/* Writes @count null packets of @packet_size bytes at @data. For m2ts packets,
+ * @header is the 4 bytes timestamp header of the last real packet */
+static void
+mpegtsmux_write_null_packets (guint8 * data, gint count, gint packet_size,
+    guint32 header)
+{
+  for (; count > 0; count--) {
+    gint offset;
+
+    if (packet_size > NORMAL_TS_PACKET_LENGTH) {
+      GST_WRITE_UINT32_BE (data, header);
+      /* simply increase header a bit and never mind too much */
+      header++;
+      offset = 4;
+    } else {
+      offset = 0;
+    }
+    GST_WRITE_UINT8 (data + offset, TSMUX_SYNC_BYTE);
+    /* null packet PID */
+    GST_WRITE_UINT16_BE (data + offset + 1, 0x1FFF);
+    /* no adaptation field exists | continuity counter undefined */
+    GST_WRITE_UINT8 (data + offset + 3, 0x10);
+    /* payload */
+    memset (data + offset + 4, 0, NORMAL_TS_PACKET_LENGTH - 4);
+    data += packet_size;
+  }
+}
+
 static GstFlowReturn
 mpegtsmux_push_packets (MpegTsMux * mux, gboolean force)
 {
@@ -1316,16 +1375,33 @@ mpegtsmux_push_packets (MpegTsMux * mux, gboolean force)
   GstFlowReturn ret = GST_FLOW_OK;
   GstClockTime ts;
 
-  if (mux->m2ts_mode) {
-    packet_size = M2TS_PACKET_LENGTH;
-    if (align < 0)
-      align = 32;
-  } else {
-    packet_size = NORMAL_TS_PACKET_LENGTH;
-    if (align < 0)
-      align = 0;
+  /* Packets were directly written in the output block, full blocks are
+   * pushed as soon as they are complete */
+  if (!mux->m2ts_mode) {
+    if (mux->out_buffer == NULL)
+      return GST_FLOW_OK;
+
+    if (align <= 0) {
+      /* push all available packets */
+      return mpegtsmux_push_block (mux);
+    } else if (force) {
+      gint dummy = (mux->out_block_size - mux->out_offset) /
+          NORMAL_TS_PACKET_LENGTH;
+
+      GST_LOG_OBJECT (mux, "adding %d null packets", dummy);
+      mpegtsmux_write_null_packets (mux->out_map.data + mux->out_offset,
+          dummy, NORMAL_TS_PACKET_LENGTH, 0);
+      mux->out_offset = mux->out_block_size;
+
+      return mpegtsmux_push_block (mux);
+    }
+    return GST_FLOW_OK;
   }
 
+  packet_size = M2TS_PACKET_LENGTH;
+  if (align < 0)
+    align = 32;
+
   av = gst_adapter_available (mux->out_adapter);
   GST_LOG_OBJECT (mux, "align %d, av %d", align, av);
 
@@ -1368,26 +1444,7 @@ mpegtsmux_push_packets (MpegTsMux * mux, gboolean force)
     dummy = (map.size - av) / packet_size;
     GST_LOG_OBJECT (mux, "adding %d null packets", dummy);
 
-    for (; dummy > 0; dummy--) {
-      gint offset;
-
-      if (packet_size > NORMAL_TS_PACKET_LENGTH) {
-        GST_WRITE_UINT32_BE (data, header);
-        /* simply increase header a bit and never mind too much */
-        header++;
-        offset = 4;
-      } else {
-        offset = 0;
-      }
-      GST_WRITE_UINT8 (data + offset, TSMUX_SYNC_BYTE);
-      /* null packet PID */
-      GST_WRITE_UINT16_BE (data + offset + 1, 0x1FFF);
-      /* no adaptation field exists | continuity counter undefined */
-      GST_WRITE_UINT8 (data + offset + 3, 0x10);
-      /* payload */
-      memset (data + offset + 4, 0, NORMAL_TS_PACKET_LENGTH - 4);
-      data += packet_size;
-    }
+    mpegtsmux_write_null_packets (data, dummy, packet_size, header);
 
     gst_buffer_unmap (buf, &map);
 
@@ -1532,11 +1589,36 @@ new_packet_cb (GstBuffer * buf, void *user_data, gint64 new_pcr)
   mux->spn_count++;
 #endif
 
-  if (mux->m2ts_mode) {
-    offset = 4;
-    gst_buffer_set_size (buf, NORMAL_TS_PACKET_LENGTH + offset);
+  if (!mux->m2ts_mode) {
+    /* @buf wraps the next packet of the output block, the data is already
+     * in place */
+    gst_buffer_map (buf, &map, GST_MAP_READ);
+    g_assert (map.data == mux->out_map.data + mux->out_offset);
+
+    if (mux->out_offset == 0)
+      GST_BUFFER_PTS (mux->out_buffer) = mux->last_ts;
+    GST_BUFFER_PTS (buf) = mux->last_ts;
+    /* do common init (flags and streamheaders) */
+    new_packet_common_init (mux, buf, map.data, map.size);
+    if (!GST_BUFFER_FLAG_IS_SET (buf, GST_BUFFER_FLAG_DELTA_UNIT))
+      mux->out_delta = FALSE;
+
+    gst_buffer_unmap (buf, &map);
+    gst_buffer_unref (buf);
+
+    mux->out_offset += NORMAL_TS_PACKET_LENGTH;
+    if (mux->out_offset + NORMAL_TS_PACKET_LENGTH > mux->out_block_size) {
+      mux->last_flow_ret = mpegtsmux_push_block (mux);
+      if (mux->last_flow_ret != GST_FLOW_OK)
+        return FALSE;
+    }
+
+    return TRUE;
   }
 
+  offset = 4;
+  gst_buffer_set_size (buf, NORMAL_TS_PACKET_LENGTH + offset);
+
   gst_buffer_map (buf, &map, GST_MAP_READWRITE);
 
   if (offset) {
@@ -1559,6 +1641,103 @@ new_packet_cb (GstBuffer * buf, void *user_data, gint64 new_pcr)
   return TRUE;
 }
 
+/* Gets a new output block from the pool and maps it for writing. The pool
+ * is (re)configured for blocks of alignment packets */
+static gboolean
+mpegtsmux_acquire_block (MpegTsMux * mux)
+{
+  guint block_size;
+
+  if (mux->alignment > 0)
+    block_size = mux->alignment * NORMAL_TS_PACKET_LENGTH;
+  else
+    block_size = MPEGTSMUX_DEFAULT_BLOCK_PACKETS * NORMAL_TS_PACKET_LENGTH;
+
+  if (mux->out_pool && mux->out_block_size != block_size) {
+    gst_buffer_pool_set_active (mux->out_pool, FALSE);
+    gst_object_unref (mux->out_pool);
+    mux->out_pool = NULL;
+  }
+
+  if (mux->out_pool == NULL) {
+    GstStructure *config;
+
+    GST_DEBUG_OBJECT (mux, "creating pool of %u bytes blocks", block_size);
+    mux->out_pool = gst_buffer_pool_new ();
+    config = gst_buffer_pool_get_config (mux->out_pool);
+    gst_buffer_pool_config_set_params (config, NULL, block_size,
+        MPEGTSMUX_MIN_BLOCKS, 0);
+    if (!gst_buffer_pool_set_config (mux->out_pool, config)
+        || !gst_buffer_pool_set_active (mux->out_pool, TRUE))
+      goto pool_failed;
+    mux->out_block_size = block_size;
+  }
+
+  if (gst_buffer_pool_acquire_buffer (mux->out_pool, &mux->out_buffer,
+          NULL) != GST_FLOW_OK)
+    goto pool_failed;
+
+  /* a previous user might have shrunk it */
+  gst_buffer_set_size (mux->out_buffer, block_size);
+  gst_buffer_map (mux->out_buffer, &mux->out_map, GST_MAP_WRITE);
+  mux->out_offset = 0;
+  mux->out_delta = TRUE;
+
+  return TRUE;
+
+pool_failed:
+  {
+    GST_ERROR_OBJECT (mux, "failed to get an output block");
+    if (mux->out_pool) {
+      gst_buffer_pool_set_active (mux->out_pool, FALSE);
+      gst_object_unref (mux->out_pool);
+      mux->out_pool = NULL;
+    }
+    return FALSE;
+  }
+}
+
+/* Drops the current output block without pushing it */
+static void
+mpegtsmux_release_block (MpegTsMux * mux)
+{
+  if (mux->out_buffer == NULL)
+    return;
+
+  gst_buffer_unmap (mux->out_buffer, &mux->out_map);
+  gst_buffer_unref (mux->out_buffer);
+  mux->out_buffer = NULL;
+  mux->out_offset = 0;
+}
+
+/* Pushes the packets written so far in the output block downstream */
+static GstFlowReturn
+mpegtsmux_push_block (MpegTsMux * mux)
+{
+  GstBuffer *buf = mux->out_buffer;
+
+  if (buf == NULL)
+    return GST_FLOW_OK;
+
+  gst_buffer_unmap (buf, &mux->out_map);
+  mux->out_buffer = NULL;
+
+  if (mux->out_offset == 0) {
+    gst_buffer_unref (buf);
+    return GST_FLOW_OK;
+  }
+
+  gst_buffer_set_size (buf, mux->out_offset);
+  if (mux->out_delta)
+    GST_BUFFER_FLAG_SET (buf, GST_BUFFER_FLAG_DELTA_UNIT);
+  mux->out_offset = 0;
+
+  GST_LOG_OBJECT (mux, "pushing block of %" G_GSIZE_FORMAT " bytes",
+      gst_buffer_get_size (buf));
+
+  return gst_pad_push (mux->srcpad, buf);
+}
+
 /* called when TsMux needs new packet to write into */
 static void
 alloc_packet_cb (GstBuffer ** _buf, void *user_data)
@@ -1567,6 +1746,20 @@ alloc_packet_cb (GstBuffer ** _buf, void *user_data)
   GstBuffer *buf;
   gint offset = 0;
 
+  if (!mux->m2ts_mode) {
+    /* Hand out a lightweight buffer wrapping the next packet of the output
+     * block so that tsmux writes in it directly */
+    if (mux->out_buffer == NULL && !mpegtsmux_acquire_block (mux)) {
+      *_buf = NULL;
+      return;
+    }
+
+    *_buf = gst_buffer_new_wrapped_full (0,
+        mux->out_map.data + mux->out_offset, NORMAL_TS_PACKET_LENGTH, 0,
+        NORMAL_TS_PACKET_LENGTH, NULL, NULL);
+    return;
+  }
+
   if (mux->m2ts_mode == TRUE)
     offset = 4;
 
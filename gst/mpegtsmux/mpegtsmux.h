@@ -166,6 +166,12 @@ struct MpegTsMux {
   gint out_offset;
   gint last_size;
 
+  /* recycled output blocks packets are directly written in (non-m2ts) */
+  GstBufferPool *out_pool;
+  guint out_block_size;
+  GstMapInfo out_map;
+  gboolean out_delta;
+
 #if 0
   /* SPN/PTS index handling */
   GstIndex *element_index;
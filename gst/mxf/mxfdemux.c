@@ -31,7 +31,8 @@
  */
 
 /* TODO:
- *   - Seeking support: Use IndexTableSegments
+ *   - Seeking support: In push mode IndexTableSegments can only be used for
+ *     partitions that were already seen
  *   - Handle timecode tracks correctly (where is this documented?)
  *   - Handle drop-frame field of timecode tracks
  *   - Handle Generic container system items
@@ -257,17 +258,18 @@ gst_mxf_demux_reset (GstMXFDemux * demux)
     demux->random_index_pack = NULL;
   }
 
-  if (demux->pending_index_table_segments) {
+  if (demux->index_table_segments) {
     GList *l;
 
-    for (l = demux->pending_index_table_segments; l; l = l->next) {
+    for (l = demux->index_table_segments; l; l = l->next) {
       MXFIndexTableSegment *s = l->data;
       mxf_index_table_segment_reset (s);
       g_free (s);
     }
-    g_list_free (demux->pending_index_table_segments);
-    demux->pending_index_table_segments = NULL;
+    g_list_free (demux->index_table_segments);
+    demux->index_table_segments = NULL;
   }
+  demux->pulled_index_table_segments = FALSE;
 
   gst_mxf_demux_reset_mxf_state (demux);
   gst_mxf_demux_reset_metadata (demux);
@@ -724,6 +726,7 @@ gst_mxf_demux_update_essence_tracks (GstMXFDemux * demux)
         GstMXFDemuxEssenceTrack tmp;
 
         memset (&tmp, 0, sizeof (tmp));
+        tmp.index_element = -1;
         tmp.body_sid = edata->body_sid;
         tmp.track_number = track->parent.track_number;
         tmp.track_id = track->parent.track_id;
@@ -1899,11 +1902,23 @@ gst_mxf_demux_handle_random_index_pack (GstMXFDemux * demux, const MXFUL * key,
   return GST_FLOW_OK;
 }
 
+static gint
+gst_mxf_demux_index_table_segment_compare (MXFIndexTableSegment * a,
+    MXFIndexTableSegment * b)
+{
+  if (a->body_sid != b->body_sid)
+    return (a->body_sid < b->body_sid) ? -1 : 1;
+  if (a->index_start_position != b->index_start_position)
+    return (a->index_start_position < b->index_start_position) ? -1 : 1;
+  return 0;
+}
+
 static GstFlowReturn
 gst_mxf_demux_handle_index_table_segment (GstMXFDemux * demux,
     const MXFUL * key, GstBuffer * buffer)
 {
   MXFIndexTableSegment *segment;
+  GList *l;
 
   GST_DEBUG_OBJECT (demux,
       "Handling index table segment of size %u at offset %"
@@ -1920,24 +1935,38 @@ gst_mxf_demux_handle_index_table_segment (GstMXFDemux * demux,
           GST_BUFFER_SIZE (buffer))) {
 
     GST_ERROR_OBJECT (demux, "Parsing index table segment failed");
+    mxf_index_table_segment_reset (segment);
+    g_free (segment);
     return GST_FLOW_ERROR;
   }
 
-  demux->pending_index_table_segments =
-      g_list_prepend (demux->pending_index_table_segments, segment);
+  /* The same segments are usually repeated in the header and footer
+   * partitions */
+  for (l = demux->index_table_segments; l; l = l->next) {
+    if (gst_mxf_demux_index_table_segment_compare (l->data, segment) == 0) {
+      GST_DEBUG_OBJECT (demux, "Index table segment already known");
+      mxf_index_table_segment_reset (segment);
+      g_free (segment);
+      return GST_FLOW_OK;
+    }
+  }
+
+  demux->index_table_segments =
+      g_list_insert_sorted (demux->index_table_segments, segment,
+      (GCompareFunc) gst_mxf_demux_index_table_segment_compare);
 
 
   return GST_FLOW_OK;
 }
 
+/* Reads the key and the length of the KLV packet at @offset without
+ * pulling its value, which starts @data_offset bytes into the packet */
 static GstFlowReturn
-gst_mxf_demux_pull_klv_packet (GstMXFDemux * demux, guint64 offset, MXFUL * key,
-    GstBuffer ** outbuf, guint * read)
+gst_mxf_demux_peek_klv_packet (GstMXFDemux * demux, guint64 offset,
+    MXFUL * key, guint * data_offset, guint64 * length)
 {
   GstBuffer *buffer = NULL;
   const guint8 *data;
-  guint64 data_offset = 0;
-  guint64 length;
   GstFlowReturn ret = GST_FLOW_OK;
 
   memset (key, 0, sizeof (MXFUL));
@@ -1953,12 +1982,12 @@ gst_mxf_demux_pull_klv_packet (GstMXFDemux * demux, guint64 offset, MXFUL * key,
 
   /* Decode BER encoded packet length */
   if ((data[16] & 0x80) == 0) {
-    length = data[16];
-    data_offset = 17;
+    *length = data[16];
+    *data_offset = 17;
   } else {
     guint slen = data[16] & 0x7f;
 
-    data_offset = 16 + 1 + slen;
+    *data_offset = 16 + 1 + slen;
 
     gst_buffer_unref (buffer);
     buffer = NULL;
@@ -1976,16 +2005,33 @@ gst_mxf_demux_pull_klv_packet (GstMXFDemux * demux, guint64 offset, MXFUL * key,
       goto beach;
     data = GST_BUFFER_DATA (buffer);
 
-    length = 0;
+    *length = 0;
     while (slen) {
-      length = (length << 8) | *data;
+      *length = (*length << 8) | *data;
       data++;
       slen--;
     }
   }
 
-  gst_buffer_unref (buffer);
-  buffer = NULL;
+beach:
+  if (buffer)
+    gst_buffer_unref (buffer);
+
+  return ret;
+}
+
+static GstFlowReturn
+gst_mxf_demux_pull_klv_packet (GstMXFDemux * demux, guint64 offset, MXFUL * key,
+    GstBuffer ** outbuf, guint * read)
+{
+  GstBuffer *buffer = NULL;
+  guint data_offset = 0;
+  guint64 length;
+  GstFlowReturn ret = GST_FLOW_OK;
+
+  if ((ret = gst_mxf_demux_peek_klv_packet (demux, offset, key, &data_offset,
+              &length)) != GST_FLOW_OK)
+    goto beach;
 
   /* GStreamer's buffer sizes are stored in a guint so we
    * limit ourself to G_MAXUINT large buffers */
@@ -2378,6 +2424,472 @@ gst_mxf_demux_set_partition_for_offset (GstMXFDemux * demux, guint64 offset)
   }
 }
 
+/* Partitions only known from the random index pack have nothing but their
+ * offset and body SID, this pulls and parses their partition pack */
+static gboolean
+gst_mxf_demux_parse_partition_pack (GstMXFDemux * demux,
+    GstMXFDemuxPartition * p)
+{
+  guint64 old_offset = demux->offset;
+  GstMXFDemuxPartition *old_partition = demux->current_partition;
+  GstBuffer *buffer = NULL;
+  GstFlowReturn ret;
+  MXFUL key;
+
+  if (p->partition.major_version != 0)
+    return TRUE;
+
+  if (!demux->random_access)
+    return FALSE;
+
+  demux->offset = demux->run_in + p->partition.this_partition;
+  ret = gst_mxf_demux_pull_klv_packet (demux, demux->offset, &key, &buffer,
+      NULL);
+  if (ret == GST_FLOW_OK) {
+    if (mxf_is_partition_pack (&key))
+      ret = gst_mxf_demux_handle_partition_pack (demux, &key, buffer);
+    else
+      ret = GST_FLOW_ERROR;
+    gst_buffer_unref (buffer);
+  }
+
+  demux->offset = old_offset;
+  demux->current_partition = old_partition;
+
+  return (ret == GST_FLOW_OK && p->partition.major_version != 0);
+}
+
+static gboolean
+gst_mxf_demux_is_essence (const MXFUL * key)
+{
+  return mxf_is_generic_container_system_item (key) ||
+      mxf_is_generic_container_essence_element (key) ||
+      mxf_is_avid_essence_container_essence_element (key);
+}
+
+/* Returns the offset of the first essence KLV packet of partition @p,
+ * relative to the partition, or 0 if it is unknown */
+static guint64
+gst_mxf_demux_get_essence_container_offset (GstMXFDemux * demux,
+    GstMXFDemuxPartition * p)
+{
+  guint64 start, offset, length;
+  guint data_offset, i;
+  MXFUL key;
+
+  if (p->essence_container_offset != 0 || !demux->random_access)
+    return p->essence_container_offset;
+
+  start = demux->run_in + p->partition.this_partition;
+  if (gst_mxf_demux_peek_klv_packet (demux, start, &key, &data_offset,
+          &length) != GST_FLOW_OK || !mxf_is_partition_pack (&key))
+    return 0;
+  start += data_offset + length;
+
+  /* First skip the header metadata and index table segments as counted in
+   * the partition pack, and if that doesn't end up at the essence walk
+   * over everything that comes after the partition pack */
+  offset = start + p->partition.header_byte_count +
+      p->partition.index_byte_count;
+  if (offset != start && (gst_mxf_demux_peek_klv_packet (demux, offset, &key,
+              &data_offset, &length) != GST_FLOW_OK ||
+          (!gst_mxf_demux_is_essence (&key) && !mxf_is_fill (&key))))
+    offset = start;
+
+  for (i = 0; i < 1024; i++) {
+    if (gst_mxf_demux_peek_klv_packet (demux, offset, &key, &data_offset,
+            &length) != GST_FLOW_OK)
+      return 0;
+
+    if (gst_mxf_demux_is_essence (&key))
+      break;
+
+    if (mxf_is_partition_pack (&key) || mxf_is_random_index_pack (&key))
+      return 0;
+
+    offset += data_offset + length;
+  }
+
+  if (!gst_mxf_demux_is_essence (&key))
+    return 0;
+
+  p->essence_container_offset =
+      offset - demux->run_in - p->partition.this_partition;
+
+  GST_DEBUG_OBJECT (demux, "Essence of partition at %" G_GUINT64_FORMAT
+      " starts at offset %" G_GUINT64_FORMAT, p->partition.this_partition,
+      p->essence_container_offset);
+
+  return p->essence_container_offset;
+}
+
+/* Returns the offset in the file of @stream_offset in the essence container
+ * @body_sid, or -1 if it is unknown */
+static guint64
+gst_mxf_demux_find_stream_offset (GstMXFDemux * demux, guint32 body_sid,
+    guint64 stream_offset)
+{
+  GPtrArray *partitions = g_ptr_array_new ();
+  GstMXFDemuxPartition *p;
+  guint64 essence_offset, offset = -1;
+  guint lo, hi;
+  GList *l;
+
+  for (l = demux->partitions; l; l = l->next) {
+    p = l->data;
+
+    if (p->partition.body_sid == body_sid)
+      g_ptr_array_add (partitions, p);
+  }
+
+  /* The body offsets grow with the partitions, only the partition packs
+   * looked at by the bisection have to be parsed */
+  lo = 0;
+  hi = partitions->len;
+  while (lo < hi) {
+    guint mid = (lo + hi) / 2;
+
+    p = g_ptr_array_index (partitions, mid);
+    if (!gst_mxf_demux_parse_partition_pack (demux, p))
+      goto out;
+
+    if (p->partition.body_offset <= stream_offset)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  if (lo == 0)
+    goto out;
+
+  p = g_ptr_array_index (partitions, lo - 1);
+  essence_offset = gst_mxf_demux_get_essence_container_offset (demux, p);
+  if (essence_offset == 0)
+    goto out;
+
+  offset = p->partition.this_partition + essence_offset +
+      (stream_offset - p->partition.body_offset);
+
+  /* Must not be after the end of the partition */
+  l = g_list_find (demux->partitions, p);
+  if (l->next && offset >=
+      ((GstMXFDemuxPartition *) l->next->data)->partition.this_partition)
+    offset = -1;
+
+out:
+  g_ptr_array_free (partitions, TRUE);
+
+  return offset;
+}
+
+/* Returns the stream offset of edit unit @position of the essence container
+ * @body_sid, or -1 if no index table segment covers it. @entry is set to
+ * NULL for segments with a constant edit unit size */
+static guint64
+gst_mxf_demux_find_edit_unit (GstMXFDemux * demux, guint32 body_sid,
+    gint64 position, MXFIndexTableSegment ** segment, MXFIndexEntry ** entry)
+{
+  guint64 cbe_offset = 0;
+  GList *l;
+
+  for (l = demux->index_table_segments; l; l = l->next) {
+    MXFIndexTableSegment *s = l->data;
+    gint64 i = position - s->index_start_position;
+
+    if (s->body_sid != body_sid)
+      continue;
+
+    if (i < 0)
+      break;
+
+    if (s->edit_unit_byte_count) {
+      if (s->index_duration == 0 || i < s->index_duration) {
+        *segment = s;
+        *entry = NULL;
+        return cbe_offset + i * s->edit_unit_byte_count;
+      }
+      cbe_offset += s->index_duration * s->edit_unit_byte_count;
+    } else if (i < s->n_index_entries) {
+      *segment = s;
+      *entry = &s->index_entries[i];
+      return (*entry)->stream_offset;
+    }
+  }
+
+  return -1;
+}
+
+/* Returns the offset in the file of element @element of edit unit
+ * @position of the essence container of @etrack, or -1 */
+static guint64
+gst_mxf_demux_find_index_element (GstMXFDemux * demux,
+    GstMXFDemuxEssenceTrack * etrack, gint64 position, gint element,
+    gboolean * keyframe, gint64 * keyframe_position)
+{
+  MXFIndexTableSegment *segment = NULL;
+  MXFIndexEntry *entry = NULL;
+  guint64 stream_offset;
+
+  stream_offset = gst_mxf_demux_find_edit_unit (demux, etrack->body_sid,
+      position, &segment, &entry);
+  if (stream_offset == -1)
+    return -1;
+
+  if (segment->n_delta_entries > 0) {
+    MXFDeltaEntry *delta;
+
+    if (element >= segment->n_delta_entries)
+      return -1;
+
+    delta = &segment->delta_entries[element];
+    stream_offset += delta->element_delta;
+    if (entry && delta->slice > 0 && delta->slice <= segment->slice_count)
+      stream_offset += entry->slice_offset[delta->slice - 1];
+  } else if (element > 0) {
+    return -1;
+  }
+
+  /* Random access flag, edit units without index entries are all
+   * keyframes */
+  if (keyframe)
+    *keyframe = (!entry || (entry->flags & 0x80));
+  if (keyframe_position)
+    *keyframe_position = (!entry || (entry->flags & 0x80)) ? position :
+        position + entry->key_frame_offset;
+
+  return gst_mxf_demux_find_stream_offset (demux, etrack->body_sid,
+      stream_offset);
+}
+
+/* The index table segments describe edit units, find which element of
+ * them belongs to @etrack by comparing with the offsets found while
+ * demuxing */
+static gboolean
+gst_mxf_demux_find_index_element_for_track (GstMXFDemux * demux,
+    GstMXFDemuxEssenceTrack * etrack)
+{
+  guint i, n_checked = 0;
+  gint element;
+
+  if (etrack->index_element >= 0)
+    return TRUE;
+
+  if (etrack->index_element == -2 || !etrack->offsets)
+    return FALSE;
+
+  for (i = 0; i < etrack->offsets->len && n_checked < 4; i++) {
+    GstMXFDemuxIndex *idx =
+        &g_array_index (etrack->offsets, GstMXFDemuxIndex, i);
+
+    if (idx->offset == 0)
+      continue;
+
+    n_checked++;
+    for (element = 0;; element++) {
+      guint64 offset = gst_mxf_demux_find_index_element (demux, etrack, i,
+          element, NULL, NULL);
+
+      if (offset == -1)
+        break;
+
+      if (offset == idx->offset) {
+        GST_DEBUG_OBJECT (demux, "Track %u is element %d of the edit units "
+            "in the index table", etrack->track_number, element);
+        etrack->index_element = element;
+        return TRUE;
+      }
+    }
+  }
+
+  return FALSE;
+}
+
+/* Pulls the index table segments of the partition at @offset, skipping
+ * its header metadata */
+static void
+gst_mxf_demux_pull_partition_index_table_segments (GstMXFDemux * demux,
+    guint64 offset)
+{
+  GstMXFDemuxPartition *p;
+  GstBuffer *buffer = NULL;
+  guint64 length;
+  guint data_offset, read;
+  MXFUL key;
+
+  demux->offset = offset;
+  if (gst_mxf_demux_pull_klv_packet (demux, offset, &key, &buffer,
+          &read) != GST_FLOW_OK)
+    return;
+
+  if (!mxf_is_partition_pack (&key) ||
+      gst_mxf_demux_handle_partition_pack (demux, &key,
+          buffer) != GST_FLOW_OK) {
+    gst_buffer_unref (buffer);
+    return;
+  }
+  gst_buffer_unref (buffer);
+  buffer = NULL;
+
+  p = demux->current_partition;
+  if (p->partition.index_sid == 0 || p->partition.index_byte_count == 0)
+    return;
+
+  GST_DEBUG_OBJECT (demux, "Pulling index table segments of partition at %"
+      G_GUINT64_FORMAT, p->partition.this_partition);
+
+  offset += read;
+  while (gst_mxf_demux_peek_klv_packet (demux, offset, &key, &data_offset,
+          &length) == GST_FLOW_OK) {
+    if (mxf_is_index_table_segment (&key) || (mxf_is_primer_pack (&key)
+            && !p->primer.mappings)) {
+      demux->offset = offset;
+      if (gst_mxf_demux_pull_klv_packet (demux, offset, &key, &buffer,
+              NULL) != GST_FLOW_OK)
+        break;
+      if (mxf_is_primer_pack (&key))
+        gst_mxf_demux_handle_primer_pack (demux, &key, buffer);
+      else
+        gst_mxf_demux_handle_index_table_segment (demux, &key, buffer);
+      gst_buffer_unref (buffer);
+      buffer = NULL;
+    } else if (!mxf_is_fill (&key) && !mxf_is_primer_pack (&key)) {
+      break;
+    }
+
+    /* The header byte count starts with the primer pack */
+    if (mxf_is_primer_pack (&key) && p->partition.header_byte_count > 0)
+      offset += p->partition.header_byte_count;
+    else
+      offset += data_offset + length;
+  }
+}
+
+/* Pulls the index table segments of the footer partition and of the
+ * partitions listed in the random index pack, which are not reached when
+ * demuxing linearly before seeking */
+static void
+gst_mxf_demux_pull_index_table_segments (GstMXFDemux * demux)
+{
+  guint64 old_offset = demux->offset;
+  GstMXFDemuxPartition *old_partition = demux->current_partition;
+  GList *partitions, *l;
+
+  if (demux->pulled_index_table_segments || !demux->random_access)
+    return;
+  demux->pulled_index_table_segments = TRUE;
+
+  if (demux->footer_partition_pack_offset != 0)
+    gst_mxf_demux_pull_partition_index_table_segments (demux,
+        demux->run_in + demux->footer_partition_pack_offset);
+
+  /* Pulling a partition pack updates the list of partitions */
+  partitions = g_list_copy (demux->partitions);
+  for (l = partitions; l; l = l->next) {
+    GstMXFDemuxPartition *p = l->data;
+
+    if (demux->footer_partition_pack_offset != 0 &&
+        p->partition.this_partition == demux->footer_partition_pack_offset)
+      continue;
+
+    gst_mxf_demux_pull_partition_index_table_segments (demux,
+        demux->run_in + p->partition.this_partition);
+  }
+  g_list_free (partitions);
+
+  demux->offset = old_offset;
+  demux->current_partition = old_partition;
+}
+
+/* Fills the offsets of @etrack at @position, and back to the previous
+ * keyframe if @keyframe is set, from the index table segments */
+static void
+gst_mxf_demux_resolve_index_entries (GstMXFDemux * demux,
+    GstMXFDemuxEssenceTrack * etrack, gint64 position, gboolean keyframe)
+{
+  gint64 keyframe_position, i;
+  guint64 offset, length;
+  guint data_offset;
+  gboolean is_keyframe;
+  MXFUL key;
+
+  gst_mxf_demux_pull_index_table_segments (demux);
+
+  if (!demux->index_table_segments || position < 0)
+    return;
+
+  if (etrack->offsets && etrack->offsets->len > position) {
+    GstMXFDemuxIndex *idx =
+        &g_array_index (etrack->offsets, GstMXFDemuxIndex, position);
+
+    if (idx->offset != 0 && (!keyframe || idx->keyframe))
+      return;
+  }
+
+  if (!gst_mxf_demux_find_index_element_for_track (demux, etrack))
+    return;
+
+  offset = gst_mxf_demux_find_index_element (demux, etrack, position,
+      etrack->index_element, &is_keyframe, &keyframe_position);
+  if (offset == -1)
+    return;
+
+  /* The offsets only match the essence elements for frame wrapping, with
+   * clip wrapping they point inside of the single essence element. This
+   * can only be checked when pulling. */
+  if (demux->random_access) {
+    if (gst_mxf_demux_peek_klv_packet (demux, demux->run_in + offset, &key,
+            &data_offset, &length) != GST_FLOW_OK)
+      return;
+
+    if (!(mxf_is_generic_container_essence_element (&key) ||
+            mxf_is_avid_essence_container_essence_element (&key)) ||
+        (etrack->track_number != 0 &&
+            GST_READ_UINT32_BE (&key.u[12]) != etrack->track_number)) {
+      GST_DEBUG_OBJECT (demux, "Index table segments don't point to the "
+          "essence elements of track %u, not using them",
+          etrack->track_number);
+      etrack->index_element = -2;
+      return;
+    }
+  }
+
+  if (!keyframe)
+    keyframe_position = position;
+  keyframe_position = CLAMP (keyframe_position, 0, position);
+
+  GST_DEBUG_OBJECT (demux, "Filling index of track %u from %" G_GINT64_FORMAT
+      " to %" G_GINT64_FORMAT, etrack->track_number, keyframe_position,
+      position);
+
+  if (!etrack->offsets)
+    etrack->offsets = g_array_new (FALSE, TRUE, sizeof (GstMXFDemuxIndex));
+  if (etrack->offsets->len <= position)
+    g_array_set_size (etrack->offsets, position + 1);
+
+  for (i = keyframe_position; i <= position; i++) {
+    GstMXFDemuxIndex *idx =
+        &g_array_index (etrack->offsets, GstMXFDemuxIndex, i);
+
+    if (idx->offset != 0)
+      continue;
+
+    if (i != position) {
+      guint64 o;
+      gboolean k;
+
+      o = gst_mxf_demux_find_index_element (demux, etrack, i,
+          etrack->index_element, &k, NULL);
+      if (o != -1) {
+        idx->offset = o;
+        idx->keyframe = k;
+      }
+    } else {
+      idx->offset = offset;
+      idx->keyframe = is_keyframe;
+    }
+  }
+}
+
 static guint64
 gst_mxf_demux_find_essence_element (GstMXFDemux * demux,
     GstMXFDemuxEssenceTrack * etrack, gint64 * position, gboolean keyframe)
@@ -2398,6 +2910,9 @@ from_index:
     return -1;
   }
 
+  /* Complete our index from the index table segments */
+  gst_mxf_demux_resolve_index_entries (demux, etrack, *position, keyframe);
+
   /* First try to find an offset in our index */
   if (etrack->offsets && etrack->offsets->len > *position) {
     GstMXFDemuxIndex *idx =
@@ -74,6 +74,11 @@ typedef struct
 
   GArray *offsets;
 
+  /* Element of this track inside the edit units of the index table
+   * segments, -1 if not known yet and -2 if the index table segments
+   * don't point to the essence elements of this track */
+  gint index_element;
+
   MXFMetadataSourcePackage *source_package;
   MXFMetadataTimelineTrack *source_track;
 
@@ -149,7 +154,10 @@ struct _GstMXFDemux
   GstMXFDemuxPartition *current_partition;
 
   GArray *essence_tracks;
-  GList *pending_index_table_segments;
+  /* MXFIndexTableSegment, sorted by body SID and start position */
+  GList *index_table_segments;
+  /* TRUE once the index table segments of all partitions were pulled */
+  gboolean pulled_index_table_segments;
 
   GArray *random_index_pack;
 
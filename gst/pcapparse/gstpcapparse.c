@@ -25,6 +25,14 @@
  * #GstPcapParse:src-port and #GstPcapParse:dst-port to restrict which packets
  * should be included.
  *
+ * When #GstPcapParse:split-flows is enabled, every UDP or TCP flow (source
+ * and destination address and port plus protocol) that passes these filters
+ * gets its own sometimes src pad, so that multi-stream captures can be
+ * replayed in one go. The always src pad is not used in that mode.
+ *
+ * Payloads are output as regions of the input buffers and pushed downstream
+ * in a buffer list per pad for each input buffer.
+ *
  * <refsect2>
  * <title>Example pipelines</title>
  * |[
@@ -32,11 +40,15 @@
  * ! ffdec_h264 ! fakesink
  * ]| Read from a pcap dump file using filesrc, extract the raw UDP packets,
  * depayload and decode them.
+ * |[
+ * gst-launch-1.0 filesrc location=streams.pcap blocksize=1048576 !
+ * pcapparse split-flows=true name=p p.src_0 ! queue ! fakesink
+ * p.src_1 ! queue ! fakesink
+ * ]| Replay the first two flows of a capture in parallel.
  * </refsect2>
  */
 
 /* TODO:
- * - React on state-change and update state accordingly.
  * - Implement support for timestamping the buffers.
  */
 
@@ -65,6 +77,7 @@ enum
   PROP_DST_PORT,
   PROP_CAPS,
   PROP_TS_OFFSET,
+  PROP_SPLIT_FLOWS,
   PROP_LAST
 };
 
@@ -81,13 +94,27 @@ static GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE ("src",
     GST_PAD_ALWAYS,
     GST_STATIC_CAPS_ANY);
 
+static GstStaticPadTemplate flow_src_template =
+GST_STATIC_PAD_TEMPLATE ("src_%u",
+    GST_PAD_SRC,
+    GST_PAD_SOMETIMES,
+    GST_STATIC_CAPS_ANY);
+
 static void gst_pcap_parse_finalize (GObject * object);
 static void gst_pcap_parse_get_property (GObject * object, guint prop_id,
     GValue * value, GParamSpec * pspec);
 static void gst_pcap_parse_set_property (GObject * object, guint prop_id,
     const GValue * value, GParamSpec * pspec);
 
+static GstStateChangeReturn gst_pcap_parse_change_state (GstElement *
+    element, GstStateChange transition);
+
 static void gst_pcap_parse_reset (GstPcapParse * self);
+static void gst_pcap_parse_remove_flows (GstPcapParse * self);
+static guint gst_pcap_parse_flow_key_hash (gconstpointer key);
+static gboolean gst_pcap_parse_flow_key_equal (gconstpointer a,
+    gconstpointer b);
+static void gst_pcap_parse_flow_free (gpointer data);
 
 static GstFlowReturn gst_pcap_parse_chain (GstPad * pad,
     GstObject * parent, GstBuffer * buffer);
@@ -137,10 +164,19 @@ gst_pcap_parse_class_init (GstPcapParseClass * klass)
           "Relative timestamp offset (ns) to apply (-1 = use absolute packet time)",
           -1, G_MAXINT64, -1, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
+  g_object_class_install_property (gobject_class, PROP_SPLIT_FLOWS,
+      g_param_spec_boolean ("split-flows", "Split flows",
+          "Output each UDP/TCP flow on its own sometimes pad", FALSE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  element_class->change_state = GST_DEBUG_FUNCPTR (gst_pcap_parse_change_state);
+
   gst_element_class_add_pad_template (element_class,
       gst_static_pad_template_get (&sink_template));
   gst_element_class_add_pad_template (element_class,
       gst_static_pad_template_get (&src_template));
+  gst_element_class_add_pad_template (element_class,
+      gst_static_pad_template_get (&flow_src_template));
 
   gst_element_class_set_metadata (element_class, "PCapParse",
       "Raw/Parser",
@@ -171,6 +207,10 @@ gst_pcap_parse_init (GstPcapParse * self)
   self->dst_port = -1;
   self->offset = -1;
 
+  self->src_flow.pad = self->src_pad;
+  self->flows = g_hash_table_new_full (gst_pcap_parse_flow_key_hash,
+      gst_pcap_parse_flow_key_equal, NULL, gst_pcap_parse_flow_free);
+
   self->adapter = gst_adapter_new ();
 
   gst_pcap_parse_reset (self);
@@ -182,6 +222,9 @@ gst_pcap_parse_finalize (GObject * object)
   GstPcapParse *self = GST_PCAP_PARSE (object);
 
   g_object_unref (self->adapter);
+  g_hash_table_destroy (self->flows);
+  if (self->src_flow.pending)
+    gst_buffer_list_unref (self->src_flow.pending);
   if (self->caps)
     gst_caps_unref (self->caps);
 
@@ -243,6 +286,10 @@ gst_pcap_parse_get_property (GObject * object, guint prop_id,
       g_value_set_int64 (value, self->offset);
       break;
 
+    case PROP_SPLIT_FLOWS:
+      g_value_set_boolean (value, self->split_flows);
+      break;
+
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -297,26 +344,262 @@ gst_pcap_parse_set_property (GObject * object, guint prop_id,
       self->offset = g_value_get_int64 (value);
       break;
 
+    case PROP_SPLIT_FLOWS:
+      self->split_flows = g_value_get_boolean (value);
+      break;
+
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
   }
 }
 
+static void
+gst_pcap_parse_reset_flow (GstPcapParseFlow * flow)
+{
+  if (flow->pending) {
+    gst_buffer_list_unref (flow->pending);
+    flow->pending = NULL;
+  }
+  flow->newsegment_sent = FALSE;
+  flow->last_ret = GST_FLOW_OK;
+}
+
 static void
 gst_pcap_parse_reset (GstPcapParse * self)
 {
+  GHashTableIter iter;
+  gpointer value;
+
   self->initialized = FALSE;
   self->swap_endian = FALSE;
   self->cur_packet_size = -1;
   self->buffer_offset = 0;
   self->cur_ts = GST_CLOCK_TIME_NONE;
   self->base_ts = GST_CLOCK_TIME_NONE;
-  self->newsegment_sent = FALSE;
+  self->segment_start = GST_CLOCK_TIME_NONE;
+
+  gst_pcap_parse_reset_flow (&self->src_flow);
+  g_hash_table_iter_init (&iter, self->flows);
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+    gst_pcap_parse_reset_flow ((GstPcapParseFlow *) value);
 
   gst_adapter_clear (self->adapter);
 }
 
+static GstStateChangeReturn
+gst_pcap_parse_change_state (GstElement * element, GstStateChange transition)
+{
+  GstPcapParse *self = GST_PCAP_PARSE (element);
+  GstStateChangeReturn ret;
+
+  ret = GST_ELEMENT_CLASS (parent_class)->change_state (element, transition);
+
+  switch (transition) {
+    case GST_STATE_CHANGE_PAUSED_TO_READY:
+      gst_pcap_parse_reset (self);
+      gst_pcap_parse_remove_flows (self);
+      break;
+    default:
+      break;
+  }
+
+  return ret;
+}
+
+static guint
+gst_pcap_parse_flow_key_hash (gconstpointer key)
+{
+  const GstPcapParseFlowKey *k = key;
+  guint hash;
+
+  hash = k->src_ip;
+  hash = hash * 31 + k->dst_ip;
+  hash = hash * 31 + ((k->src_port << 16) | k->dst_port);
+  hash = hash * 31 + k->protocol;
+
+  return hash;
+}
+
+static gboolean
+gst_pcap_parse_flow_key_equal (gconstpointer a, gconstpointer b)
+{
+  const GstPcapParseFlowKey *ka = a;
+  const GstPcapParseFlowKey *kb = b;
+
+  return ka->src_ip == kb->src_ip && ka->dst_ip == kb->dst_ip &&
+      ka->src_port == kb->src_port && ka->dst_port == kb->dst_port &&
+      ka->protocol == kb->protocol;
+}
+
+static void
+gst_pcap_parse_flow_free (gpointer data)
+{
+  GstPcapParseFlow *flow = data;
+
+  if (flow->pending)
+    gst_buffer_list_unref (flow->pending);
+  g_slice_free (GstPcapParseFlow, flow);
+}
+
+static GstPcapParseFlow *
+gst_pcap_parse_add_flow (GstPcapParse * self, const GstPcapParseFlowKey * key)
+{
+  GstElementClass *klass = GST_ELEMENT_GET_CLASS (self);
+  GstPcapParseFlow *flow;
+  gchar *name, *stream_id;
+
+  flow = g_slice_new0 (GstPcapParseFlow);
+  flow->key = *key;
+  flow->last_ret = GST_FLOW_OK;
+
+  name = g_strdup_printf ("src_%u", self->n_flows++);
+  flow->pad =
+      gst_pad_new_from_template (gst_element_class_get_pad_template (klass,
+          "src_%u"), name);
+  gst_pad_use_fixed_caps (flow->pad);
+
+  GST_DEBUG_OBJECT (self, "new flow %08x:%u -> %08x:%u (proto %u) on pad %s",
+      GUINT32_FROM_BE (key->src_ip), key->src_port,
+      GUINT32_FROM_BE (key->dst_ip), key->dst_port, key->protocol, name);
+
+  gst_pad_set_active (flow->pad, TRUE);
+
+  stream_id = gst_pad_create_stream_id (flow->pad, GST_ELEMENT_CAST (self),
+      name + 4);
+  gst_pad_push_event (flow->pad, gst_event_new_stream_start (stream_id));
+  g_free (stream_id);
+  g_free (name);
+
+  g_hash_table_insert (self->flows, &flow->key, flow);
+  gst_element_add_pad (GST_ELEMENT_CAST (self), flow->pad);
+
+  return flow;
+}
+
+static void
+gst_pcap_parse_remove_flows (GstPcapParse * self)
+{
+  GHashTableIter iter;
+  gpointer value;
+
+  g_hash_table_iter_init (&iter, self->flows);
+  while (g_hash_table_iter_next (&iter, NULL, &value)) {
+    GstPcapParseFlow *flow = value;
+
+    gst_pad_set_active (flow->pad, FALSE);
+    gst_element_remove_pad (GST_ELEMENT_CAST (self), flow->pad);
+  }
+
+  g_hash_table_remove_all (self->flows);
+  self->n_flows = 0;
+}
+
+static GstPcapParseFlow *
+gst_pcap_parse_get_flow (GstPcapParse * self, const GstPcapParseFlowKey * key)
+{
+  GstPcapParseFlow *flow;
+
+  if (!self->split_flows)
+    return &self->src_flow;
+
+  flow = g_hash_table_lookup (self->flows, key);
+  if (flow == NULL)
+    flow = gst_pcap_parse_add_flow (self, key);
+
+  return flow;
+}
+
+/* Queues @buf to be pushed on the flow's pad at the end of the chain call */
+static void
+gst_pcap_parse_queue_buffer (GstPcapParse * self, GstPcapParseFlow * flow,
+    GstBuffer * buf)
+{
+  if (!flow->newsegment_sent && GST_BUFFER_TIMESTAMP_IS_VALID (buf)) {
+    GstSegment segment;
+
+    if (self->caps)
+      gst_pad_set_caps (flow->pad, self->caps);
+    /* All flows start their segment at the first packet of the capture */
+    if (!GST_CLOCK_TIME_IS_VALID (self->segment_start))
+      self->segment_start = GST_BUFFER_TIMESTAMP (buf);
+
+    gst_segment_init (&segment, GST_FORMAT_TIME);
+    segment.start = self->segment_start;
+    gst_pad_push_event (flow->pad, gst_event_new_segment (&segment));
+    flow->newsegment_sent = TRUE;
+  }
+
+  if (flow->pending == NULL)
+    flow->pending = gst_buffer_list_new ();
+  gst_buffer_list_add (flow->pending, buf);
+}
+
+static GstFlowReturn
+gst_pcap_parse_combine_flows (GstPcapParse * self, GstPcapParseFlow * flow,
+    GstFlowReturn ret)
+{
+  GHashTableIter iter;
+  gpointer value;
+
+  /* store the value */
+  flow->last_ret = ret;
+
+  /* any other return than not-linked can be returned right away */
+  if (ret != GST_FLOW_NOT_LINKED || !self->split_flows)
+    return ret;
+
+  /* only return NOT_LINKED if all other pads returned NOT_LINKED */
+  g_hash_table_iter_init (&iter, self->flows);
+  while (g_hash_table_iter_next (&iter, NULL, &value)) {
+    ret = ((GstPcapParseFlow *) value)->last_ret;
+    if (ret != GST_FLOW_NOT_LINKED)
+      return ret;
+  }
+
+  return GST_FLOW_NOT_LINKED;
+}
+
+static GstFlowReturn
+gst_pcap_parse_push_pending (GstPcapParse * self, GstPcapParseFlow * flow)
+{
+  GstBufferList *list;
+
+  /* Nothing was queued for this pad */
+  if (flow->pending == NULL)
+    return GST_FLOW_OK;
+
+  list = flow->pending;
+  flow->pending = NULL;
+
+  GST_LOG_OBJECT (flow->pad, "pushing %u buffers",
+      gst_buffer_list_length (list));
+
+  return gst_pcap_parse_combine_flows (self, flow,
+      gst_pad_push_list (flow->pad, list));
+}
+
+static GstFlowReturn
+gst_pcap_parse_push_all_pending (GstPcapParse * self)
+{
+  GHashTableIter iter;
+  gpointer value;
+  GstFlowReturn ret, flow_ret;
+
+  if (!self->split_flows)
+    return gst_pcap_parse_push_pending (self, &self->src_flow);
+
+  ret = GST_FLOW_OK;
+  g_hash_table_iter_init (&iter, self->flows);
+  while (g_hash_table_iter_next (&iter, NULL, &value)) {
+    flow_ret = gst_pcap_parse_push_pending (self, (GstPcapParseFlow *) value);
+    if (ret == GST_FLOW_OK)
+      ret = flow_ret;
+  }
+
+  return ret;
+}
+
 static guint32
 gst_pcap_parse_read_uint32 (GstPcapParse * self, const guint8 * p)
 {
@@ -345,7 +628,8 @@ gst_pcap_parse_read_uint32 (GstPcapParse * self, const guint8 * p)
 static gboolean
 gst_pcap_parse_scan_frame (GstPcapParse * self,
     const guint8 * buf,
-    gint buf_size, const guint8 ** payload, gint * payload_size)
+    gint buf_size, const guint8 ** payload, gint * payload_size,
+    GstPcapParseFlowKey * key)
 {
   const guint8 *buf_ip = 0;
   const guint8 *buf_proto;
@@ -437,6 +721,12 @@ gst_pcap_parse_scan_frame (GstPcapParse * self,
   if (self->dst_port >= 0 && dst_port != self->dst_port)
     return FALSE;
 
+  key->src_ip = ip_src_addr;
+  key->dst_ip = ip_dst_addr;
+  key->src_port = src_port;
+  key->dst_port = dst_port;
+  key->protocol = ip_protocol;
+
   return TRUE;
 }
 
@@ -462,6 +752,7 @@ gst_pcap_parse_chain (GstPad * pad, GstObject * parent, GstBuffer * buffer)
         if (self->cur_packet_size > 0) {
           const guint8 *payload_data;
           gint payload_size;
+          GstPcapParseFlowKey key;
 
           data = gst_adapter_map (self->adapter, self->cur_packet_size);
 
@@ -469,47 +760,38 @@ gst_pcap_parse_chain (GstPad * pad, GstObject * parent, GstBuffer * buffer)
               self->cur_packet_size);
 
           if (gst_pcap_parse_scan_frame (self, data, self->cur_packet_size,
-                  &payload_data, &payload_size)) {
-            GstBuffer *out_buf;
-            GstMapInfo map;
-
-            out_buf = gst_buffer_new_and_alloc (payload_size);
-            if (out_buf) {
-
-              if (GST_CLOCK_TIME_IS_VALID (self->cur_ts)) {
-                if (!GST_CLOCK_TIME_IS_VALID (self->base_ts))
-                  self->base_ts = self->cur_ts;
-                if (self->offset >= 0) {
-                  self->cur_ts -= self->base_ts;
-                  self->cur_ts += self->offset;
-                }
+                  &payload_data, &payload_size, &key)) {
+            gsize payload_offset = payload_data - data;
+            GstBuffer *packet, *out_buf;
+
+            gst_adapter_unmap (self->adapter);
+
+            if (GST_CLOCK_TIME_IS_VALID (self->cur_ts)) {
+              if (!GST_CLOCK_TIME_IS_VALID (self->base_ts))
+                self->base_ts = self->cur_ts;
+              if (self->offset >= 0) {
+                self->cur_ts -= self->base_ts;
+                self->cur_ts += self->offset;
               }
-
-              gst_buffer_map (out_buf, &map, GST_MAP_WRITE);
-              memcpy (map.data, payload_data, payload_size);
-              gst_buffer_unmap (out_buf, &map);
-              GST_BUFFER_TIMESTAMP (out_buf) = self->cur_ts;
-
-              if (!self->newsegment_sent &&
-                  GST_CLOCK_TIME_IS_VALID (self->cur_ts)) {
-                GstSegment segment;
-
-                gst_pad_set_caps (self->src_pad, self->caps);
-                gst_segment_init (&segment, GST_FORMAT_TIME);
-                segment.start = self->cur_ts;
-                gst_pad_push_event (self->src_pad,
-                    gst_event_new_segment (&segment));
-                self->newsegment_sent = TRUE;
-              }
-
-              ret = gst_pad_push (self->src_pad, out_buf);
-
-              self->buffer_offset += payload_size;
             }
-          }
 
-          gst_adapter_unmap (self->adapter);
-          gst_adapter_flush (self->adapter, self->cur_packet_size);
+            /* The packet usually lies within a single input buffer, in which
+             * case both of these only share its memory */
+            packet = gst_adapter_take_buffer (self->adapter,
+                self->cur_packet_size);
+            out_buf = gst_buffer_copy_region (packet, GST_BUFFER_COPY_MEMORY,
+                payload_offset, payload_size);
+            gst_buffer_unref (packet);
+            GST_BUFFER_TIMESTAMP (out_buf) = self->cur_ts;
+
+            gst_pcap_parse_queue_buffer (self,
+                gst_pcap_parse_get_flow (self, &key), out_buf);
+
+            self->buffer_offset += payload_size;
+          } else {
+            gst_adapter_unmap (self->adapter);
+            gst_adapter_flush (self->adapter, self->cur_packet_size);
+          }
         }
 
         self->cur_packet_size = -1;
@@ -584,6 +866,9 @@ gst_pcap_parse_chain (GstPad * pad, GstObject * parent, GstBuffer * buffer)
     }
   }
 
+  if (ret == GST_FLOW_OK)
+    ret = gst_pcap_parse_push_all_pending (self);
+
 out:
   if (ret != GST_FLOW_OK)
     gst_pcap_parse_reset (self);
@@ -591,6 +876,25 @@ out:
   return ret;
 }
 
+static gboolean
+gst_pcap_parse_push_event (GstPcapParse * self, GstEvent * event)
+{
+  GHashTableIter iter;
+  gpointer value;
+  gboolean ret = FALSE;
+
+  g_hash_table_iter_init (&iter, self->flows);
+  while (g_hash_table_iter_next (&iter, NULL, &value)) {
+    GstPcapParseFlow *flow = value;
+
+    ret |= gst_pad_push_event (flow->pad, gst_event_ref (event));
+  }
+
+  ret |= gst_pad_push_event (self->src_pad, event);
+
+  return ret;
+}
+
 static gboolean
 gst_pcap_sink_event (GstPad * pad, GstObject * parent, GstEvent * event)
 {
@@ -602,12 +906,15 @@ gst_pcap_sink_event (GstPad * pad, GstObject * parent, GstEvent * event)
       /* Drop it, we'll replace it with our own */
       gst_event_unref (event);
       break;
+    case GST_EVENT_EOS:
+      if (self->split_flows)
+        gst_element_no_more_pads (GST_ELEMENT_CAST (self));
+      ret = gst_pcap_parse_push_event (self, event);
+      break;
     default:
-      ret = gst_pad_push_event (self->src_pad, event);
+      ret = gst_pcap_parse_push_event (self, event);
       break;
   }
 
-  gst_object_unref (self);
-
   return ret;
 }
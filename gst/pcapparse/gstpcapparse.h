@@ -51,6 +51,30 @@ typedef enum
   DLT_SLL = 113
 } GstPcapParseLinktype;
 
+typedef struct _GstPcapParseFlowKey GstPcapParseFlowKey;
+typedef struct _GstPcapParseFlow    GstPcapParseFlow;
+
+/* addresses in network byte order, ports in host byte order */
+struct _GstPcapParseFlowKey
+{
+  guint32 src_ip;
+  guint32 dst_ip;
+  guint16 src_port;
+  guint16 dst_port;
+  guint8 protocol;
+};
+
+struct _GstPcapParseFlow
+{
+  GstPcapParseFlowKey key;
+  GstPad *pad;
+
+  /* payloads queued during the current chain call */
+  GstBufferList *pending;
+  gboolean newsegment_sent;
+  GstFlowReturn last_ret;
+};
+
 /**
  * GstPcapParse:
  *
@@ -72,6 +96,7 @@ struct _GstPcapParse
   gint32 dst_port;
   GstCaps *caps;
   gint64 offset;
+  gboolean split_flows;
 
   /* state */
   GstAdapter * adapter;
@@ -80,9 +105,15 @@ struct _GstPcapParse
   gint64 cur_packet_size;
   GstClockTime cur_ts;
   GstClockTime base_ts;
+  /* start of the segments of all flows, so that they stay in sync */
+  GstClockTime segment_start;
   GstPcapParseLinktype linktype;
 
-  gboolean newsegment_sent;
+  /* output of the always src pad */
+  GstPcapParseFlow src_flow;
+  /* GstPcapParseFlowKey -> GstPcapParseFlow, when splitting flows */
+  GHashTable *flows;
+  guint n_flows;
 
   gint64 buffer_offset;
 };
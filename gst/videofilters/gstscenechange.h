@@ -44,6 +44,8 @@ struct _GstSceneChange
   int n_diffs;
   double diffs[SC_N_DIFFS];
   GstBuffer *oldbuf;
+
+  guint decimation;
 };
 
 struct _GstSceneChangeClass
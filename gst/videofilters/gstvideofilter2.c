@@ -28,6 +28,9 @@
 #include <gst/gst.h>
 #include <gst/base/gstbasetransform.h>
 #include <gst/video/video.h>
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
 #include "gstvideofilter2.h"
 
 GST_DEBUG_CATEGORY_STATIC (gst_video_filter2_debug_category);
@@ -60,9 +63,26 @@ static GstFlowReturn gst_video_filter2_transform_ip (GstBaseTransform * trans,
 
 enum
 {
-  PROP_0
+  PROP_0,
+  PROP_N_THREADS
 };
 
+#define DEFAULT_N_THREADS 0
+#define MAX_N_THREADS 64
+
+/* Frames are split in bands of a multiple of this number of rows, so that
+ * every band starts on a chroma row for all the subsampled formats */
+#define SLICE_ROW_ALIGN 16
+
+typedef struct
+{
+  const GstVideoFilter2Functions *functions;
+  GstBuffer *inbuf;
+  GstBuffer *outbuf;            /* NULL for in place filtering */
+  int start;
+  int end;
+} GstVideoFilter2Slice;
+
 
 /* class initialization */
 
@@ -116,6 +136,11 @@ gst_video_filter2_class_init (GstVideoFilter2Class * klass)
   base_transform_class->transform_ip =
       GST_DEBUG_FUNCPTR (gst_video_filter2_transform_ip);
 
+  g_object_class_install_property (gobject_class, PROP_N_THREADS,
+      g_param_spec_uint ("n-threads", "Number of threads",
+          "Number of threads filtering bands of rows of each frame "
+          "(0 = number of CPUs)", 0, MAX_N_THREADS, DEFAULT_N_THREADS,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 }
 
 static void
@@ -124,15 +149,27 @@ gst_video_filter2_init (GstVideoFilter2 * videofilter2,
 {
 
   gst_base_transform_set_qos_enabled (GST_BASE_TRANSFORM (videofilter2), TRUE);
+
+  videofilter2->n_threads = DEFAULT_N_THREADS;
+  g_mutex_init (&videofilter2->slice_lock);
+  g_cond_init (&videofilter2->slice_cond);
 }
 
 void
 gst_video_filter2_set_property (GObject * object, guint property_id,
     const GValue * value, GParamSpec * pspec)
 {
+  GstVideoFilter2 *videofilter2;
+
   g_return_if_fail (GST_IS_VIDEO_FILTER2 (object));
+  videofilter2 = GST_VIDEO_FILTER2 (object);
 
   switch (property_id) {
+    case PROP_N_THREADS:
+      GST_OBJECT_LOCK (videofilter2);
+      videofilter2->n_threads = g_value_get_uint (value);
+      GST_OBJECT_UNLOCK (videofilter2);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -143,9 +180,17 @@ void
 gst_video_filter2_get_property (GObject * object, guint property_id,
     GValue * value, GParamSpec * pspec)
 {
+  GstVideoFilter2 *videofilter2;
+
   g_return_if_fail (GST_IS_VIDEO_FILTER2 (object));
+  videofilter2 = GST_VIDEO_FILTER2 (object);
 
   switch (property_id) {
+    case PROP_N_THREADS:
+      GST_OBJECT_LOCK (videofilter2);
+      g_value_set_uint (value, videofilter2->n_threads);
+      GST_OBJECT_UNLOCK (videofilter2);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -155,9 +200,16 @@ gst_video_filter2_get_property (GObject * object, guint property_id,
 void
 gst_video_filter2_dispose (GObject * object)
 {
+  GstVideoFilter2 *videofilter2;
+
   g_return_if_fail (GST_IS_VIDEO_FILTER2 (object));
+  videofilter2 = GST_VIDEO_FILTER2 (object);
 
   /* clean up as possible.  may be called multiple times */
+  if (videofilter2->pool) {
+    g_thread_pool_free (videofilter2->pool, FALSE, TRUE);
+    videofilter2->pool = NULL;
+  }
 
   G_OBJECT_CLASS (parent_class)->dispose (object);
 }
@@ -165,9 +217,14 @@ gst_video_filter2_dispose (GObject * object)
 void
 gst_video_filter2_finalize (GObject * object)
 {
+  GstVideoFilter2 *videofilter2;
+
   g_return_if_fail (GST_IS_VIDEO_FILTER2 (object));
+  videofilter2 = GST_VIDEO_FILTER2 (object);
 
   /* clean up object here */
+  g_mutex_clear (&videofilter2->slice_lock);
+  g_cond_clear (&videofilter2->slice_cond);
 
   G_OBJECT_CLASS (parent_class)->finalize (object);
 }
@@ -231,12 +288,169 @@ gst_video_filter2_stop (GstBaseTransform * trans)
   return FALSE;
 }
 
+static guint
+gst_video_filter2_get_n_cpus (void)
+{
+#if defined (HAVE_UNISTD_H) && defined (_SC_NPROCESSORS_ONLN)
+  long n_cpus;
+
+  n_cpus = sysconf (_SC_NPROCESSORS_ONLN);
+  if (n_cpus > 0)
+    return MIN (n_cpus, MAX_N_THREADS);
+#endif
+
+  return 1;
+}
+
+static GstFlowReturn
+gst_video_filter2_filter_slice (GstVideoFilter2 * video_filter2,
+    GstVideoFilter2Slice * slice)
+{
+  if (slice->outbuf)
+    return slice->functions->filter (video_filter2, slice->inbuf,
+        slice->outbuf, slice->start, slice->end);
+
+  return slice->functions->filter_ip (video_filter2, slice->inbuf,
+      slice->start, slice->end);
+}
+
+static void
+gst_video_filter2_slice_func (GstVideoFilter2Slice * slice,
+    GstVideoFilter2 * video_filter2)
+{
+  GstFlowReturn ret;
+
+  ret = gst_video_filter2_filter_slice (video_filter2, slice);
+
+  g_mutex_lock (&video_filter2->slice_lock);
+  if (ret != GST_FLOW_OK && video_filter2->slice_ret == GST_FLOW_OK)
+    video_filter2->slice_ret = ret;
+  if (--video_filter2->pending_slices == 0)
+    g_cond_signal (&video_filter2->slice_cond);
+  g_mutex_unlock (&video_filter2->slice_lock);
+}
+
+/* Splits the frame in bands of rows filtered in parallel by the pool
+ * threads, the calling thread filtering the first band itself */
+static GstFlowReturn
+gst_video_filter2_process (GstVideoFilter2 * video_filter2,
+    const GstVideoFilter2Functions * functions, GstBuffer * inbuf,
+    GstBuffer * outbuf)
+{
+  GstVideoFilter2Class *klass =
+      GST_VIDEO_FILTER2_CLASS (G_OBJECT_GET_CLASS (video_filter2));
+  GstVideoFilter2Slice *slices;
+  GstFlowReturn ret;
+  guint n_threads, n_slices, i;
+  int height = video_filter2->height;
+  int rows;
+
+  GST_OBJECT_LOCK (video_filter2);
+  n_threads = video_filter2->n_threads;
+  GST_OBJECT_UNLOCK (video_filter2);
+
+  if (n_threads == 0)
+    n_threads = gst_video_filter2_get_n_cpus ();
+
+  n_slices = (height + SLICE_ROW_ALIGN - 1) / SLICE_ROW_ALIGN;
+  n_slices = MIN (n_threads, n_slices);
+  if (klass->whole_frame || n_slices <= 1)
+    goto whole_frame;
+
+  rows = (height + n_slices - 1) / n_slices;
+  rows = GST_ROUND_UP_N (rows, SLICE_ROW_ALIGN);
+  n_slices = (height + rows - 1) / rows;
+
+  if (video_filter2->pool == NULL ||
+      video_filter2->pool_threads != n_slices - 1) {
+    GError *err = NULL;
+
+    if (video_filter2->pool)
+      g_thread_pool_free (video_filter2->pool, FALSE, TRUE);
+
+    video_filter2->pool =
+        g_thread_pool_new ((GFunc) gst_video_filter2_slice_func,
+        video_filter2, n_slices - 1, TRUE, &err);
+    if (video_filter2->pool == NULL) {
+      GST_WARNING_OBJECT (video_filter2, "Could not create threads: %s",
+          err->message);
+      g_error_free (err);
+      goto whole_frame;
+    }
+    video_filter2->pool_threads = n_slices - 1;
+    GST_DEBUG_OBJECT (video_filter2, "Filtering frames in %u bands of %d rows",
+        n_slices, rows);
+  }
+
+  slices = g_newa (GstVideoFilter2Slice, n_slices);
+  for (i = 0; i < n_slices; i++) {
+    slices[i].functions = functions;
+    slices[i].inbuf = inbuf;
+    slices[i].outbuf = outbuf;
+    slices[i].start = i * rows;
+    slices[i].end = MIN ((i + 1) * rows, height);
+  }
+
+  video_filter2->pending_slices = n_slices - 1;
+  video_filter2->slice_ret = GST_FLOW_OK;
+  for (i = 1; i < n_slices; i++)
+    g_thread_pool_push (video_filter2->pool, &slices[i], NULL);
+
+  ret = gst_video_filter2_filter_slice (video_filter2, &slices[0]);
+
+  g_mutex_lock (&video_filter2->slice_lock);
+  while (video_filter2->pending_slices > 0)
+    g_cond_wait (&video_filter2->slice_cond, &video_filter2->slice_lock);
+  if (ret == GST_FLOW_OK)
+    ret = video_filter2->slice_ret;
+  g_mutex_unlock (&video_filter2->slice_lock);
+
+  return ret;
+
+whole_frame:
+  {
+    GstVideoFilter2Slice slice = { functions, inbuf, outbuf, 0, height };
+
+    return gst_video_filter2_filter_slice (video_filter2, &slice);
+  }
+}
+
+static const GstVideoFilter2Functions *
+gst_video_filter2_find_functions (GstVideoFilter2 * video_filter2)
+{
+  GstVideoFilter2Class *klass =
+      GST_VIDEO_FILTER2_CLASS (G_OBJECT_GET_CLASS (video_filter2));
+  int i;
+
+  for (i = 0; klass->functions[i].format != GST_VIDEO_FORMAT_UNKNOWN; i++) {
+    if (klass->functions[i].format == video_filter2->format)
+      return &klass->functions[i];
+  }
+
+  return NULL;
+}
+
 static GstFlowReturn
 gst_video_filter2_transform (GstBaseTransform * trans, GstBuffer * inbuf,
     GstBuffer * outbuf)
 {
+  GstVideoFilter2 *video_filter2 = GST_VIDEO_FILTER2 (trans);
+  GstVideoFilter2Class *klass =
+      GST_VIDEO_FILTER2_CLASS (G_OBJECT_GET_CLASS (trans));
+  const GstVideoFilter2Functions *functions;
+  GstFlowReturn ret;
 
-  return GST_FLOW_ERROR;
+  functions = gst_video_filter2_find_functions (video_filter2);
+  if (functions == NULL || functions->filter == NULL)
+    return GST_FLOW_ERROR;
+
+  if (klass->prefilter) {
+    ret = klass->prefilter (video_filter2, inbuf);
+    if (ret != GST_FLOW_OK)
+      return ret;
+  }
+
+  return gst_video_filter2_process (video_filter2, functions, inbuf, outbuf);
 }
 
 static GstFlowReturn
@@ -245,18 +459,21 @@ gst_video_filter2_transform_ip (GstBaseTransform * trans, GstBuffer * buf)
   GstVideoFilter2 *video_filter2 = GST_VIDEO_FILTER2 (trans);
   GstVideoFilter2Class *klass =
       GST_VIDEO_FILTER2_CLASS (G_OBJECT_GET_CLASS (trans));
-  int i;
+  const GstVideoFilter2Functions *functions;
   GstFlowReturn ret;
 
-  for (i = 0; klass->functions[i].format != GST_VIDEO_FORMAT_UNKNOWN; i++) {
-    if (klass->functions[i].format == video_filter2->format) {
-      ret = klass->functions[i].filter_ip (video_filter2, buf, 0,
-          video_filter2->height);
+  functions = gst_video_filter2_find_functions (video_filter2);
+  if (functions == NULL || functions->filter_ip == NULL)
+    return GST_FLOW_ERROR;
+
+  /* Runs once per frame, before the bands are filtered */
+  if (klass->prefilter) {
+    ret = klass->prefilter (video_filter2, buf);
+    if (ret != GST_FLOW_OK)
       return ret;
-    }
   }
 
-  return GST_FLOW_ERROR;
+  return gst_video_filter2_process (video_filter2, functions, buf, NULL);
 }
 
 /* API */
@@ -267,3 +484,19 @@ gst_video_filter2_class_add_functions (GstVideoFilter2Class * klass,
 {
   klass->functions = functions;
 }
+
+/**
+ * gst_video_filter2_class_set_whole_frame:
+ * @klass: a #GstVideoFilter2Class
+ * @whole_frame: whether the filter functions need whole frames
+ *
+ * Filters whose functions don't honour the start and end rows, or keep
+ * state across rows, must set this so frames are not split in bands
+ * filtered in parallel.
+ */
+void
+gst_video_filter2_class_set_whole_frame (GstVideoFilter2Class * klass,
+    gboolean whole_frame)
+{
+  klass->whole_frame = whole_frame;
+}
@@ -43,6 +43,15 @@ struct _GstVideoFilter2
   int width;
   int height;
 
+  /*< private >*/
+  guint n_threads;              /* number of threads, 0 = number of CPUs */
+  GThreadPool *pool;            /* workers filtering the row bands */
+  guint pool_threads;
+  GMutex slice_lock;
+  GCond slice_cond;
+  guint pending_slices;
+  GstFlowReturn slice_ret;
+
   gpointer _gst_reserved[GST_PADDING_LARGE];
 };
 
@@ -54,7 +63,10 @@ struct _GstVideoFilter2Class
 
   GstFlowReturn (*prefilter) (GstVideoFilter2 *filter, GstBuffer *inbuf);
 
-  gpointer _gst_reserved[GST_PADDING_LARGE];
+  /* whether the filter functions can only process whole frames */
+  gboolean whole_frame;
+
+  gpointer _gst_reserved[GST_PADDING_LARGE - 1];
 };
 
 struct _GstVideoFilter2Functions
@@ -75,6 +87,8 @@ GType gst_video_filter2_get_type (void);
 
 void gst_video_filter2_class_add_functions (GstVideoFilter2Class *klass,
     const GstVideoFilter2Functions *functions);
+void gst_video_filter2_class_set_whole_frame (GstVideoFilter2Class *klass,
+    gboolean whole_frame);
 
 G_END_DECLS
 
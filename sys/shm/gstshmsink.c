@@ -71,6 +71,11 @@ struct GstShmClient
 /* Default is user read/write, group read */
 #define DEFAULT_PERMS ( S_IRUSR | S_IWUSR | S_IRGRP )
 
+/* Notifications of single buffers are sent in batches of at most
+ * FLUSH_MAX_PENDING, and at most FLUSH_INTERVAL after the previous batch */
+#define FLUSH_MAX_PENDING 16
+#define FLUSH_INTERVAL (2 * GST_MSECOND)
+
 
 GST_DEBUG_CATEGORY_STATIC (shmsink_debug);
 #define GST_CAT_DEFAULT shmsink_debug
@@ -80,6 +85,183 @@ static GstStaticPadTemplate sinktemplate = GST_STATIC_PAD_TEMPLATE ("sink",
     GST_PAD_ALWAYS,
     GST_STATIC_CAPS_ANY);
 
+/* Allocator handing out memory from the shm area, buffers rendered into it
+ * are sent to the clients without being copied */
+
+#define GST_TYPE_SHM_SINK_ALLOCATOR \
+  (gst_shm_sink_allocator_get_type())
+#define GST_SHM_SINK_ALLOCATOR(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_SHM_SINK_ALLOCATOR,\
+      GstShmSinkAllocator))
+
+typedef struct _GstShmSinkAllocator GstShmSinkAllocator;
+typedef struct _GstShmSinkAllocatorClass GstShmSinkAllocatorClass;
+
+struct _GstShmSinkAllocator
+{
+  GstAllocator parent;
+
+  GstShmSink *sink;
+};
+
+struct _GstShmSinkAllocatorClass
+{
+  GstAllocatorClass parent_class;
+};
+
+typedef struct
+{
+  GstMemory mem;
+
+  gchar *data;
+  ShmBlock *block;              /* NULL for shared sub-memories */
+} GstShmSinkMemory;
+
+GType gst_shm_sink_allocator_get_type (void);
+G_DEFINE_TYPE (GstShmSinkAllocator, gst_shm_sink_allocator,
+    GST_TYPE_ALLOCATOR);
+
+static void
+gst_shm_sink_allocator_dispose (GObject * object)
+{
+  GstShmSinkAllocator *self = GST_SHM_SINK_ALLOCATOR (object);
+
+  if (self->sink)
+    gst_object_unref (self->sink);
+  self->sink = NULL;
+
+  G_OBJECT_CLASS (gst_shm_sink_allocator_parent_class)->dispose (object);
+}
+
+static GstMemory *
+gst_shm_sink_allocator_alloc (GstAllocator * allocator, gsize size,
+    GstAllocationParams * params)
+{
+  GstShmSinkAllocator *self = GST_SHM_SINK_ALLOCATOR (allocator);
+  GstShmSinkMemory *mymem;
+  ShmBlock *block = NULL;
+  gsize maxsize, align, aoffset;
+
+  maxsize = size + params->prefix + params->padding;
+  align = params->align | gst_memory_alignment;
+
+  GST_OBJECT_LOCK (self->sink);
+  if (self->sink->pipe)
+    block = sp_writer_alloc_block (self->sink->pipe, maxsize + align);
+  GST_OBJECT_UNLOCK (self->sink);
+
+  if (!block) {
+    GST_LOG_OBJECT (self->sink, "Not enough shared memory for buffer of %"
+        G_GSIZE_FORMAT " bytes, allocating using standard allocator", size);
+    return gst_allocator_alloc (NULL, size, params);
+  }
+
+  mymem = g_slice_new0 (GstShmSinkMemory);
+  mymem->block = block;
+  mymem->data = sp_writer_block_get_buf (block);
+  if ((aoffset = ((guintptr) mymem->data & align)))
+    mymem->data += (align + 1) - aoffset;
+
+  gst_memory_init (GST_MEMORY_CAST (mymem), params->flags, allocator, NULL,
+      maxsize, align, params->prefix, size);
+
+  if (params->prefix && (params->flags & GST_MEMORY_FLAG_ZERO_PREFIXED))
+    memset (mymem->data, 0, params->prefix);
+  if (params->padding && (params->flags & GST_MEMORY_FLAG_ZERO_PADDED))
+    memset (mymem->data + params->prefix + size, 0, params->padding);
+
+  GST_LOG_OBJECT (self->sink, "Allocated buffer of %" G_GSIZE_FORMAT
+      " bytes from shared memory at %p", size, mymem->data);
+
+  return GST_MEMORY_CAST (mymem);
+}
+
+static void
+gst_shm_sink_allocator_free (GstAllocator * allocator, GstMemory * memory)
+{
+  GstShmSinkAllocator *self = GST_SHM_SINK_ALLOCATOR (allocator);
+  GstShmSinkMemory *mymem = (GstShmSinkMemory *) memory;
+
+  /* the block stays in use until the clients released it */
+  if (mymem->block) {
+    GST_OBJECT_LOCK (self->sink);
+    sp_writer_free_block (mymem->block);
+    GST_OBJECT_UNLOCK (self->sink);
+  }
+
+  g_slice_free (GstShmSinkMemory, mymem);
+}
+
+static gpointer
+gst_shm_sink_allocator_mem_map (GstMemory * mem, gsize maxsize,
+    GstMapFlags flags)
+{
+  return ((GstShmSinkMemory *) mem)->data;
+}
+
+static void
+gst_shm_sink_allocator_mem_unmap (GstMemory * mem)
+{
+}
+
+static GstMemory *
+gst_shm_sink_allocator_mem_share (GstMemory * mem, gssize offset, gssize size)
+{
+  GstShmSinkMemory *mymem = (GstShmSinkMemory *) mem;
+  GstShmSinkMemory *mysub;
+  GstMemory *parent;
+
+  if ((parent = mem->parent) == NULL)
+    parent = mem;
+
+  if (size == -1)
+    size = mem->size - offset;
+
+  /* shared memory is always readonly */
+  mysub = g_slice_new0 (GstShmSinkMemory);
+  mysub->data = mymem->data;
+  gst_memory_init (GST_MEMORY_CAST (mysub),
+      GST_MINI_OBJECT_FLAGS (parent) | GST_MINI_OBJECT_FLAG_LOCK_READONLY,
+      mem->allocator, parent, mem->maxsize, mem->align, mem->offset + offset,
+      size);
+
+  return GST_MEMORY_CAST (mysub);
+}
+
+static void
+gst_shm_sink_allocator_class_init (GstShmSinkAllocatorClass * klass)
+{
+  GObjectClass *gobject_class = (GObjectClass *) klass;
+  GstAllocatorClass *allocator_class = (GstAllocatorClass *) klass;
+
+  gobject_class->dispose = gst_shm_sink_allocator_dispose;
+
+  allocator_class->alloc = gst_shm_sink_allocator_alloc;
+  allocator_class->free = gst_shm_sink_allocator_free;
+}
+
+static void
+gst_shm_sink_allocator_init (GstShmSinkAllocator * self)
+{
+  GstAllocator *allocator = GST_ALLOCATOR_CAST (self);
+
+  allocator->mem_type = "shmsink";
+  allocator->mem_map = gst_shm_sink_allocator_mem_map;
+  allocator->mem_unmap = gst_shm_sink_allocator_mem_unmap;
+  allocator->mem_share = gst_shm_sink_allocator_mem_share;
+}
+
+static GstAllocator *
+gst_shm_sink_allocator_new (GstShmSink * sink)
+{
+  GstShmSinkAllocator *self;
+
+  self = g_object_new (GST_TYPE_SHM_SINK_ALLOCATOR, NULL);
+  self->sink = gst_object_ref (sink);
+
+  return GST_ALLOCATOR_CAST (self);
+}
+
 #define gst_shm_sink_parent_class parent_class
 G_DEFINE_TYPE (GstShmSink, gst_shm_sink, GST_TYPE_BASE_SINK);
 
@@ -92,10 +274,14 @@ static void gst_shm_sink_get_property (GObject * object, guint prop_id,
 static gboolean gst_shm_sink_start (GstBaseSink * bsink);
 static gboolean gst_shm_sink_stop (GstBaseSink * bsink);
 static GstFlowReturn gst_shm_sink_render (GstBaseSink * bsink, GstBuffer * buf);
+static GstFlowReturn gst_shm_sink_render_list (GstBaseSink * bsink,
+    GstBufferList * list);
 
 static gboolean gst_shm_sink_event (GstBaseSink * bsink, GstEvent * event);
 static gboolean gst_shm_sink_unlock (GstBaseSink * bsink);
 static gboolean gst_shm_sink_unlock_stop (GstBaseSink * bsink);
+static gboolean gst_shm_sink_propose_allocation (GstBaseSink * bsink,
+    GstQuery * query);
 
 static gpointer pollthread_func (gpointer data);
 
@@ -128,9 +314,12 @@ gst_shm_sink_class_init (GstShmSinkClass * klass)
   gstbasesink_class->start = GST_DEBUG_FUNCPTR (gst_shm_sink_start);
   gstbasesink_class->stop = GST_DEBUG_FUNCPTR (gst_shm_sink_stop);
   gstbasesink_class->render = GST_DEBUG_FUNCPTR (gst_shm_sink_render);
+  gstbasesink_class->render_list = GST_DEBUG_FUNCPTR (gst_shm_sink_render_list);
   gstbasesink_class->event = GST_DEBUG_FUNCPTR (gst_shm_sink_event);
   gstbasesink_class->unlock = GST_DEBUG_FUNCPTR (gst_shm_sink_unlock);
   gstbasesink_class->unlock_stop = GST_DEBUG_FUNCPTR (gst_shm_sink_unlock_stop);
+  gstbasesink_class->propose_allocation =
+      GST_DEBUG_FUNCPTR (gst_shm_sink_propose_allocation);
 
   g_object_class_install_property (gobject_class, PROP_SOCKET_PATH,
       g_param_spec_string ("socket-path",
@@ -293,6 +482,29 @@ gst_shm_sink_get_property (GObject * object, guint prop_id,
 }
 
 
+/* Called by the pipe with the object lock held once all clients are done
+ * with a buffer. Dropping it can free a block, which takes the lock, so
+ * that is deferred to gst_shm_sink_drop_released_buffers() */
+static void
+gst_shm_sink_buffer_free (void *data, void *user_data)
+{
+  GstShmSink *self = GST_SHM_SINK (user_data);
+
+  self->released_buffers = g_slist_prepend (self->released_buffers, data);
+}
+
+static void
+gst_shm_sink_drop_released_buffers (GstShmSink * self)
+{
+  GSList *buffers;
+
+  GST_OBJECT_LOCK (self);
+  buffers = self->released_buffers;
+  self->released_buffers = NULL;
+  GST_OBJECT_UNLOCK (self);
+
+  g_slist_free_full (buffers, (GDestroyNotify) gst_buffer_unref);
+}
 
 static gboolean
 gst_shm_sink_start (GstBaseSink * bsink)
@@ -319,6 +531,8 @@ gst_shm_sink_start (GstBaseSink * bsink)
   }
 
   sp_set_data (self->pipe, self);
+  sp_writer_set_buffer_free_callback (self->pipe, gst_shm_sink_buffer_free,
+      self);
   g_free (self->socket_path);
   self->socket_path = g_strdup (sp_writer_get_path (self->pipe));
 
@@ -335,6 +549,13 @@ gst_shm_sink_start (GstBaseSink * bsink)
   if (!self->pollthread)
     goto thread_error;
 
+  GST_OBJECT_LOCK (self);
+  self->allocator = gst_shm_sink_allocator_new (self);
+  self->flush_clock = gst_system_clock_obtain ();
+  self->last_flush = GST_CLOCK_TIME_NONE;
+  self->unflushed = 0;
+  GST_OBJECT_UNLOCK (self);
+
   return TRUE;
 
 thread_error:
@@ -352,6 +573,7 @@ static gboolean
 gst_shm_sink_stop (GstBaseSink * bsink)
 {
   GstShmSink *self = GST_SHM_SINK (bsink);
+  GstAllocator *allocator;
 
   self->stop = TRUE;
   gst_poll_set_flushing (self->poll, TRUE);
@@ -361,6 +583,18 @@ gst_shm_sink_stop (GstBaseSink * bsink)
 
   GST_DEBUG_OBJECT (self, "Stopping");
 
+  GST_OBJECT_LOCK (self);
+  if (self->flush_id) {
+    gst_clock_id_unschedule (self->flush_id);
+    gst_clock_id_unref (self->flush_id);
+    self->flush_id = NULL;
+  }
+  if (self->flush_clock) {
+    gst_object_unref (self->flush_clock);
+    self->flush_clock = NULL;
+  }
+  GST_OBJECT_UNLOCK (self);
+
   while (self->clients) {
     struct GstShmClient *client = self->clients->data;
     self->clients = g_list_remove (self->clients, client);
@@ -373,8 +607,20 @@ gst_shm_sink_stop (GstBaseSink * bsink)
   gst_poll_free (self->poll);
   self->poll = NULL;
 
+  GST_OBJECT_LOCK (self);
   sp_close (self->pipe);
   self->pipe = NULL;
+  GST_OBJECT_UNLOCK (self);
+
+  gst_shm_sink_drop_released_buffers (self);
+
+  /* memory still in use upstream keeps the allocator alive */
+  GST_OBJECT_LOCK (self);
+  allocator = self->allocator;
+  self->allocator = NULL;
+  GST_OBJECT_UNLOCK (self);
+  if (allocator)
+    gst_object_unref (allocator);
 
   return TRUE;
 }
@@ -397,51 +643,112 @@ gst_shm_sink_can_render (GstShmSink * self, GstClockTime time)
   return TRUE;
 }
 
+/* Called with the object lock held, sends the queued notifications */
+static void
+gst_shm_sink_flush (GstShmSink * self)
+{
+  sp_writer_flush (self->pipe);
+  self->unflushed = 0;
+  self->last_flush = gst_clock_get_time (self->flush_clock);
+}
+
+static gboolean
+gst_shm_sink_flush_timeout (GstClock * clock, GstClockTime time,
+    GstClockID id, gpointer user_data)
+{
+  GstShmSink *self = GST_SHM_SINK (user_data);
+
+  GST_OBJECT_LOCK (self);
+  if (self->flush_id == id) {
+    gst_clock_id_unref (self->flush_id);
+    self->flush_id = NULL;
+    if (self->pipe && self->unflushed > 0) {
+      GST_LOG_OBJECT (self, "sending %u delayed notifications",
+          self->unflushed);
+      gst_shm_sink_flush (self);
+    }
+  }
+  GST_OBJECT_UNLOCK (self);
+
+  return TRUE;
+}
+
+/* Called with the object lock held after a buffer was rendered. Buffers
+ * rendered close together are announced in batches, a timer sends the last
+ * notifications of a batch if no other buffer follows them */
+static void
+gst_shm_sink_flush_deferred (GstShmSink * self)
+{
+  GstClockTime now;
+
+  now = gst_clock_get_time (self->flush_clock);
+  if (++self->unflushed >= FLUSH_MAX_PENDING
+      || !GST_CLOCK_TIME_IS_VALID (self->last_flush)
+      || now >= self->last_flush + FLUSH_INTERVAL) {
+    gst_shm_sink_flush (self);
+    return;
+  }
+
+  if (self->flush_id == NULL) {
+    self->flush_id = gst_clock_new_single_shot_id (self->flush_clock,
+        self->last_flush + FLUSH_INTERVAL);
+    gst_clock_id_wait_async (self->flush_id, gst_shm_sink_flush_timeout,
+        gst_object_ref (self), (GDestroyNotify) gst_object_unref);
+  }
+}
+
+/* Called with the object lock held, returns FALSE when unlocking. The
+ * queued notifications are sent first, the clients could not release
+ * anything we wait for otherwise */
+static gboolean
+gst_shm_sink_wait (GstShmSink * self)
+{
+  gst_shm_sink_flush (self);
+  g_cond_wait (self->cond, GST_OBJECT_GET_LOCK (self));
+
+  return !self->unlock;
+}
+
+/* Called with the object lock held, the buffer is only announced to the
+ * clients on the next sp_writer_flush() */
 static GstFlowReturn
-gst_shm_sink_render (GstBaseSink * bsink, GstBuffer * buf)
+gst_shm_sink_render_buffer (GstShmSink * self, GstBuffer * buf)
 {
-  GstShmSink *self = GST_SHM_SINK (bsink);
   int rv;
   GstMapInfo map;
 
-  GST_OBJECT_LOCK (self);
   while (self->wait_for_connection && !self->clients) {
-    g_cond_wait (self->cond, GST_OBJECT_GET_LOCK (self));
-    if (self->unlock) {
-      GST_OBJECT_UNLOCK (self);
+    if (!gst_shm_sink_wait (self))
       return GST_FLOW_FLUSHING;
-    }
   }
 
   while (!gst_shm_sink_can_render (self, GST_BUFFER_TIMESTAMP (buf))) {
-    g_cond_wait (self->cond, GST_OBJECT_GET_LOCK (self));
-    if (self->unlock) {
-      GST_OBJECT_UNLOCK (self);
+    if (!gst_shm_sink_wait (self))
       return GST_FLOW_FLUSHING;
-    }
   }
 
+  /* Succeeds for buffers allocated from the shm area. The clients read
+   * straight from the buffer memory, so it is kept until they released it
+   * to prevent a buffer pool from recycling it under them */
   gst_buffer_map (buf, &map, GST_MAP_READ);
   rv = sp_writer_send_buf (self->pipe, (char *) map.data, map.size,
-      GST_BUFFER_TIMESTAMP (buf));
+      GST_BUFFER_TIMESTAMP (buf), buf);
   gst_buffer_unmap (buf, &map);
 
+  if (rv > 0)
+    gst_buffer_ref (buf);
+
   if (rv == -1) {
     ShmBlock *block = NULL;
     gchar *shmbuf = NULL;
     while ((block = sp_writer_alloc_block (self->pipe,
                 gst_buffer_get_size (buf))) == NULL) {
-      g_cond_wait (self->cond, GST_OBJECT_GET_LOCK (self));
-      if (self->unlock) {
-        GST_OBJECT_UNLOCK (self);
+      if (!gst_shm_sink_wait (self))
         return GST_FLOW_FLUSHING;
-      }
     }
     while (self->wait_for_connection && !self->clients) {
-      g_cond_wait (self->cond, GST_OBJECT_GET_LOCK (self));
-      if (self->unlock) {
+      if (!gst_shm_sink_wait (self)) {
         sp_writer_free_block (block);
-        GST_OBJECT_UNLOCK (self);
         return GST_FLOW_FLUSHING;
       }
     }
@@ -449,75 +756,61 @@ gst_shm_sink_render (GstBaseSink * bsink, GstBuffer * buf)
     shmbuf = sp_writer_block_get_buf (block);
     gst_buffer_extract (buf, 0, shmbuf, gst_buffer_get_size (buf));
     sp_writer_send_buf (self->pipe, shmbuf, gst_buffer_get_size (buf),
-        GST_BUFFER_TIMESTAMP (buf));
+        GST_BUFFER_TIMESTAMP (buf), NULL);
     sp_writer_free_block (block);
   }
 
-  GST_OBJECT_UNLOCK (self);
-
   return GST_FLOW_OK;
 }
 
-#if 0
-
-/* FIXME 0.11 implement some bufferpool support */
-
-static void
-gst_shm_sink_free_buffer (gpointer data)
+static GstFlowReturn
+gst_shm_sink_render (GstBaseSink * bsink, GstBuffer * buf)
 {
-  ShmPipe *pipe;
-  ShmBlock *block = data;
-  GstShmSink *self;
-
-  pipe = sp_writer_block_get_pipe (block);
-  self = sp_get_data (pipe);
+  GstShmSink *self = GST_SHM_SINK (bsink);
+  GstFlowReturn ret;
 
   GST_OBJECT_LOCK (self);
-  sp_writer_free_block (block);
+  ret = gst_shm_sink_render_buffer (self, buf);
+  gst_shm_sink_flush_deferred (self);
   GST_OBJECT_UNLOCK (self);
-  g_object_unref (self);
+
+  return ret;
 }
 
+/* The buffers of a list are announced to each client in one go */
 static GstFlowReturn
-gst_shm_sink_buffer_alloc (GstBaseSink * sink, guint64 offset, guint size,
-    GstCaps * caps, GstBuffer ** out_buf)
+gst_shm_sink_render_list (GstBaseSink * bsink, GstBufferList * list)
 {
-  GstShmSink *self = GST_SHM_SINK (sink);
-  GstBuffer *buffer;
-  ShmBlock *block = NULL;
-  gpointer buf = NULL;
+  GstShmSink *self = GST_SHM_SINK (bsink);
+  GstFlowReturn ret = GST_FLOW_OK;
+  guint i, len;
+
+  len = gst_buffer_list_length (list);
 
   GST_OBJECT_LOCK (self);
-  block = sp_writer_alloc_block (self->pipe, size);
-  if (block) {
-    buf = sp_writer_block_get_buf (block);
-    g_object_ref (self);
-  }
+  for (i = 0; i < len && ret == GST_FLOW_OK; i++)
+    ret = gst_shm_sink_render_buffer (self, gst_buffer_list_get (list, i));
+  gst_shm_sink_flush (self);
   GST_OBJECT_UNLOCK (self);
 
-  if (block) {
-    buffer = gst_buffer_new ();
-    GST_BUFFER_DATA (buffer) = buf;
-    GST_BUFFER_MALLOCDATA (buffer) = (guint8 *) block;
-    GST_BUFFER_FREE_FUNC (buffer) =
-        GST_DEBUG_FUNCPTR (gst_shm_sink_free_buffer);
-    GST_BUFFER_SIZE (buffer) = size;
-    GST_LOG_OBJECT (self,
-        "Allocated buffer of %u bytes from shared memory at %p", size, buf);
-  } else {
-    buffer = gst_buffer_new_and_alloc (size);
-    GST_LOG_OBJECT (self, "Not enough shared memory for buffer of %u bytes, "
-        "allocating using standard allocator", size);
-  }
+  return ret;
+}
 
-  GST_BUFFER_OFFSET (buffer) = offset;
-  gst_buffer_set_caps (buffer, caps);
+static gboolean
+gst_shm_sink_propose_allocation (GstBaseSink * bsink, GstQuery * query)
+{
+  GstShmSink *self = GST_SHM_SINK (bsink);
+  GstAllocationParams params;
 
-  *out_buf = buffer;
+  gst_allocation_params_init (&params);
 
-  return GST_FLOW_OK;
+  GST_OBJECT_LOCK (self);
+  if (self->allocator)
+    gst_query_add_allocation_param (query, self->allocator, &params);
+  GST_OBJECT_UNLOCK (self);
+
+  return TRUE;
 }
-#endif
 
 static gpointer
 pollthread_func (gpointer data)
@@ -623,6 +916,8 @@ pollthread_func (gpointer data)
       goto again;
     }
 
+    gst_shm_sink_drop_released_buffers (self);
+
     g_cond_broadcast (self->cond);
   }
 
@@ -637,6 +932,7 @@ gst_shm_sink_event (GstBaseSink * bsink, GstEvent * event)
   switch (GST_EVENT_TYPE (event)) {
     case GST_EVENT_EOS:
       GST_OBJECT_LOCK (self);
+      gst_shm_sink_flush (self);
       while (self->wait_for_connection && sp_writer_pending_writes (self->pipe)
           && !self->unlock)
         g_cond_wait (self->cond, GST_OBJECT_GET_LOCK (self));
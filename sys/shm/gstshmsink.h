@@ -64,6 +64,15 @@ struct _GstShmSink
   GstClockTimeDiff buffer_time;
 
   GCond *cond;
+
+  GstAllocator *allocator;
+  GSList *released_buffers;
+
+  /* notifications not sent yet, see gst_shm_sink_flush_deferred() */
+  GstClock *flush_clock;
+  GstClockID flush_id;
+  GstClockTime last_flush;
+  guint unflushed;
 };
 
 struct _GstShmSinkClass
@@ -296,6 +296,11 @@ free_buffer (gpointer data)
 
   GST_OBJECT_LOCK (gsb->pipe->src);
   sp_client_recv_finish (gsb->pipe->pipe, gsb->buf);
+  /* The acks are batched until the streaming thread waits for the next
+   * buffer, unless it is already waiting or will not come back */
+  if (gsb->pipe->src->waiting || gsb->pipe->src->unlocked ||
+      gsb->pipe->src->pipe != gsb->pipe)
+    sp_client_flush (gsb->pipe->pipe);
   GST_OBJECT_UNLOCK (gsb->pipe->src);
 
   gst_shm_pipe_dec (gsb->pipe);
@@ -309,43 +314,64 @@ gst_shm_src_create (GstPushSrc * psrc, GstBuffer ** outbuf)
   GstShmSrc *self = GST_SHM_SRC (psrc);
   gchar *buf = NULL;
   int rv = 0;
+  gboolean pending;
   struct GstShmBuffer *gsb;
 
   do {
-    if (gst_poll_wait (self->poll, GST_CLOCK_TIME_NONE) < 0) {
-      if (errno == EBUSY)
-        return GST_FLOW_FLUSHING;
-      GST_ELEMENT_ERROR (self, RESOURCE, READ, ("Failed to read from shmsrc"),
-          ("Poll failed on fd: %s", strerror (errno)));
-      return GST_FLOW_ERROR;
+    /* Packets read along with the previous ones do not wake up the poll,
+     * and the acks still queued are sent before going to sleep */
+    GST_OBJECT_LOCK (self);
+    pending = sp_client_has_pending (self->pipe->pipe);
+    if (!pending) {
+      sp_client_flush (self->pipe->pipe);
+      self->waiting = TRUE;
     }
+    GST_OBJECT_UNLOCK (self);
 
-    if (self->unlocked)
-      return GST_FLOW_FLUSHING;
-
-    if (gst_poll_fd_has_closed (self->poll, &self->pollfd)) {
-      GST_ELEMENT_ERROR (self, RESOURCE, READ, ("Failed to read from shmsrc"),
-          ("Control socket has closed"));
-      return GST_FLOW_ERROR;
-    }
+    if (!pending) {
+      rv = gst_poll_wait (self->poll, GST_CLOCK_TIME_NONE);
 
-    if (gst_poll_fd_has_error (self->poll, &self->pollfd)) {
-      GST_ELEMENT_ERROR (self, RESOURCE, READ, ("Failed to read from shmsrc"),
-          ("Control socket has error"));
-      return GST_FLOW_ERROR;
-    }
-
-    if (gst_poll_fd_can_read (self->poll, &self->pollfd)) {
-      buf = NULL;
-      GST_LOG_OBJECT (self, "Reading from pipe");
       GST_OBJECT_LOCK (self);
-      rv = sp_client_recv (self->pipe->pipe, &buf);
+      self->waiting = FALSE;
       GST_OBJECT_UNLOCK (self);
+
       if (rv < 0) {
-        GST_ELEMENT_ERROR (self, RESOURCE, READ, ("Failed to read from shmsrc"),
-            ("Error reading control data: %d", rv));
+        if (errno == EBUSY)
+          return GST_FLOW_FLUSHING;
+        GST_ELEMENT_ERROR (self, RESOURCE, READ,
+            ("Failed to read from shmsrc"),
+            ("Poll failed on fd: %s", strerror (errno)));
         return GST_FLOW_ERROR;
       }
+
+      if (self->unlocked)
+        return GST_FLOW_FLUSHING;
+
+      if (gst_poll_fd_has_closed (self->poll, &self->pollfd)) {
+        GST_ELEMENT_ERROR (self, RESOURCE, READ,
+            ("Failed to read from shmsrc"), ("Control socket has closed"));
+        return GST_FLOW_ERROR;
+      }
+
+      if (gst_poll_fd_has_error (self->poll, &self->pollfd)) {
+        GST_ELEMENT_ERROR (self, RESOURCE, READ,
+            ("Failed to read from shmsrc"), ("Control socket has error"));
+        return GST_FLOW_ERROR;
+      }
+
+      if (!gst_poll_fd_can_read (self->poll, &self->pollfd))
+        continue;
+    }
+
+    buf = NULL;
+    GST_LOG_OBJECT (self, "Reading from pipe");
+    GST_OBJECT_LOCK (self);
+    rv = sp_client_recv (self->pipe->pipe, &buf);
+    GST_OBJECT_UNLOCK (self);
+    if (rv < 0) {
+      GST_ELEMENT_ERROR (self, RESOURCE, READ, ("Failed to read from shmsrc"),
+          ("Error reading control data: %d", rv));
+      return GST_FLOW_ERROR;
     }
   } while (buf == NULL);
 
@@ -56,6 +56,7 @@ struct _GstShmSrc
 
   GstFlowReturn flow_return;
   gboolean unlocked;
+  gboolean waiting;             /* Blocked waiting for the next packet */
 };
 
 struct _GstShmSrcClass
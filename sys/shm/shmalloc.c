@@ -33,17 +33,43 @@
 #include <string.h>
 #include <assert.h>
 
+/* The space is tiled by extents, allocated blocks and free space, kept in a
+ * list in offset order so that a freed block is merged with its free
+ * neighbours in constant time.
+ *
+ * Free extents are binned by size class, class n holding the extents of
+ * 2^n to 2^(n+1)-1 bytes, and a bitmap records the non-empty classes. An
+ * allocation takes the first extent of the smallest class that is
+ * guaranteed to fit, which makes it O(1) regardless of the number of
+ * blocks in flight.
+ *
+ * Allocated blocks are also kept in a treap sorted by offset so that
+ * shm_alloc_space_block_get() is O(log n).
+ */
+
+#define SHM_ALLOC_NUM_CLASSES ((int) sizeof (unsigned long) * 8)
+
 /* This is the allocated space to hold multiple blocks */
 struct _ShmAllocSpace
 {
   /* The total size of this space */
   size_t size;
 
-  /* chained list of the blocks contained in this space */
-  ShmAllocBlock *blocks;
+  /* All the extents of this space, in offset order */
+  ShmAllocBlock *extents;
+
+  /* Free extents by size class and the mask of the non-empty classes */
+  ShmAllocBlock *free_lists[SHM_ALLOC_NUM_CLASSES];
+  uint64_t free_classes;
+
+  /* Allocated blocks by offset */
+  ShmAllocBlock *root;
+  uint32_t seed;
+
+  ShmAllocStats stats;
 };
 
-/* A single block of data */
+/* A single block of data, or a free extent when use_count is 0 */
 struct _ShmAllocBlock
 {
   int use_count;
@@ -56,10 +82,159 @@ struct _ShmAllocBlock
   /* The size of the block */
   unsigned long size;
 
-  /* Pointer to the next block in the chain */
+  /* Neighbouring extents in offset order */
+  ShmAllocBlock *prev;
   ShmAllocBlock *next;
+
+  /* Free extents: links in the size class list */
+  ShmAllocBlock *prev_free;
+  ShmAllocBlock *next_free;
+
+  /* Allocated blocks: treap links */
+  ShmAllocBlock *left;
+  ShmAllocBlock *right;
+  uint32_t priority;
 };
 
+static int
+size_class (unsigned long size)
+{
+#if defined (__GNUC__)
+  return SHM_ALLOC_NUM_CLASSES - 1 - __builtin_clzl (size);
+#else
+  int c = 0;
+
+  while (size >>= 1)
+    c++;
+
+  return c;
+#endif
+}
+
+static int
+first_class (uint64_t mask)
+{
+#if defined (__GNUC__)
+  return __builtin_ctzll (mask);
+#else
+  int c = 0;
+
+  while (!(mask & 1)) {
+    mask >>= 1;
+    c++;
+  }
+
+  return c;
+#endif
+}
+
+static void
+free_list_add (ShmAllocSpace * self, ShmAllocBlock * extent)
+{
+  int c = size_class (extent->size);
+
+  extent->prev_free = NULL;
+  extent->next_free = self->free_lists[c];
+  if (extent->next_free)
+    extent->next_free->prev_free = extent;
+  self->free_lists[c] = extent;
+  self->free_classes |= (uint64_t) 1 << c;
+
+  self->stats.n_free_extents++;
+  self->stats.free_size += extent->size;
+}
+
+static void
+free_list_remove (ShmAllocSpace * self, ShmAllocBlock * extent)
+{
+  int c = size_class (extent->size);
+
+  if (extent->prev_free)
+    extent->prev_free->next_free = extent->next_free;
+  else
+    self->free_lists[c] = extent->next_free;
+  if (extent->next_free)
+    extent->next_free->prev_free = extent->prev_free;
+
+  if (!self->free_lists[c])
+    self->free_classes &= ~((uint64_t) 1 << c);
+
+  self->stats.n_free_extents--;
+  self->stats.free_size -= extent->size;
+}
+
+static ShmAllocBlock *
+tree_insert (ShmAllocBlock * root, ShmAllocBlock * block)
+{
+  ShmAllocBlock *child;
+
+  if (!root)
+    return block;
+
+  if (block->offset < root->offset) {
+    root->left = tree_insert (root->left, block);
+    if (root->left->priority > root->priority) {
+      child = root->left;
+      root->left = child->right;
+      child->right = root;
+      root = child;
+    }
+  } else {
+    root->right = tree_insert (root->right, block);
+    if (root->right->priority > root->priority) {
+      child = root->right;
+      root->right = child->left;
+      child->left = root;
+      root = child;
+    }
+  }
+
+  return root;
+}
+
+/* All the blocks of left are before the ones of right */
+static ShmAllocBlock *
+tree_merge (ShmAllocBlock * left, ShmAllocBlock * right)
+{
+  if (!left)
+    return right;
+  if (!right)
+    return left;
+
+  if (left->priority > right->priority) {
+    left->right = tree_merge (left->right, right);
+    return left;
+  } else {
+    right->left = tree_merge (left, right->left);
+    return right;
+  }
+}
+
+static ShmAllocBlock *
+tree_remove (ShmAllocBlock * root, ShmAllocBlock * block)
+{
+  assert (root);
+
+  if (block->offset < root->offset)
+    root->left = tree_remove (root->left, block);
+  else if (block->offset > root->offset)
+    root->right = tree_remove (root->right, block);
+  else
+    return tree_merge (root->left, root->right);
+
+  return root;
+}
+
+static uint32_t
+next_priority (ShmAllocSpace * self)
+{
+  /* xorshift, the treap only needs the priorities to be well spread */
+  self->seed ^= self->seed << 13;
+  self->seed ^= self->seed >> 17;
+  self->seed ^= self->seed << 5;
+
+  return self->seed;
+}
 
 ShmAllocSpace *
 shm_alloc_space_new (size_t size)
@@ -69,6 +244,17 @@ shm_alloc_space_new (size_t size)
   memset (self, 0, sizeof (ShmAllocSpace));
 
   self->size = size;
+  self->seed = 2463534242U;
+
+  if (size > 0) {
+    ShmAllocBlock *extent = spalloc_new (ShmAllocBlock);
+
+    memset (extent, 0, sizeof (ShmAllocBlock));
+    extent->space = self;
+    extent->size = size;
+    self->extents = extent;
+    free_list_add (self, extent);
+  }
 
   return self;
 }
@@ -76,7 +262,14 @@ shm_alloc_space_new (size_t size)
 void
 shm_alloc_space_free (ShmAllocSpace * self)
 {
-  assert (self && self->blocks == NULL);
+  assert (self && self->root == NULL);
+
+  /* Only the free extent covering the whole space is left */
+  if (self->extents) {
+    assert (self->extents->next == NULL);
+    spalloc_free (ShmAllocBlock, self->extents);
+  }
+
   spalloc_free (ShmAllocSpace, self);
 }
 
@@ -85,44 +278,66 @@ ShmAllocBlock *
 shm_alloc_space_alloc_block (ShmAllocSpace * self, unsigned long size)
 {
   ShmAllocBlock *block;
-  ShmAllocBlock *item = NULL;
-  ShmAllocBlock *prev_item = NULL;
-  unsigned long prev_end_offset = 0;
-
-
-  for (item = self->blocks; item; item = item->next) {
-    unsigned long max_size = 0;
-
-    max_size = item->offset - prev_end_offset;
-
-    if (max_size >= size)
-      break;
-
-    prev_end_offset = item->offset + item->size;
-    prev_item = item;
+  ShmAllocBlock *extent = NULL;
+  uint64_t mask = 0;
+  int c;
+
+  /* Zero sized blocks could not be found by their offset */
+  if (size == 0)
+    size = 1;
+
+  /* Smallest class where every extent is big enough */
+  c = size_class (size);
+  if (size & (size - 1))
+    c++;
+
+  if (c < SHM_ALLOC_NUM_CLASSES)
+    mask = self->free_classes & (~(uint64_t) 0 << c);
+
+  if (mask) {
+    extent = self->free_lists[first_class (mask)];
+  } else if (size & (size - 1)) {
+    /* Otherwise some extents of the class below may still be big enough */
+    for (extent = self->free_lists[c - 1]; extent; extent = extent->next_free)
+      if (extent->size >= size)
+        break;
   }
 
-  /* Did not find space before an existing block */
-  if (self->blocks && !item) {
-    /* Return NULL if there is no big enough space, otherwise, there is space
-     * at the end */
-    if (self->size - prev_end_offset < size)
-      return NULL;
+  if (!extent)
+    return NULL;
+
+  free_list_remove (self, extent);
+
+  if (extent->size == size) {
+    block = extent;
+  } else {
+    /* Take the start of the extent, the rest stays free */
+    block = spalloc_new (ShmAllocBlock);
+    memset (block, 0, sizeof (ShmAllocBlock));
+    block->space = self;
+    block->offset = extent->offset;
+    block->size = size;
+
+    block->prev = extent->prev;
+    block->next = extent;
+    if (block->prev)
+      block->prev->next = block;
+    else
+      self->extents = block;
+    extent->prev = block;
+
+    extent->offset += size;
+    extent->size -= size;
+    free_list_add (self, extent);
   }
 
-  block = spalloc_new (ShmAllocBlock);
-  memset (block, 0, sizeof (ShmAllocBlock));
-  block->offset = prev_end_offset;
-  block->size = size;
   block->use_count = 1;
-  block->space = self;
+  block->left = block->right = NULL;
+  block->priority = next_priority (self);
+  self->root = tree_insert (self->root, block);
 
-  if (prev_item)
-    prev_item->next = block;
-  else
-    self->blocks = block;
-
-  block->next = item;
+  self->stats.n_blocks++;
+  self->stats.allocated_size += size;
 
   return block;
 }
@@ -133,40 +348,85 @@ shm_alloc_space_alloc_block_get_offset (ShmAllocBlock * block)
   return block->offset;
 }
 
+/* Merges the extent following extent into it */
+static void
+shm_alloc_space_merge_next (ShmAllocBlock * extent)
+{
+  ShmAllocBlock *next = extent->next;
+
+  extent->size += next->size;
+  extent->next = next->next;
+  if (extent->next)
+    extent->next->prev = extent;
+
+  spalloc_free (ShmAllocBlock, next);
+}
+
 static void
 shm_alloc_space_free_block (ShmAllocBlock * block)
 {
-  ShmAllocBlock *item = NULL;
-  ShmAllocBlock *prev_item = NULL;
   ShmAllocSpace *self = block->space;
+  ShmAllocBlock *prev = block->prev;
+  ShmAllocBlock *next = block->next;
 
-  for (item = self->blocks; item; item = item->next) {
-    if (item == block) {
-      if (prev_item)
-        prev_item->next = item->next;
-      else
-        self->blocks = item->next;
-      break;
-    }
-    prev_item = item;
+  self->root = tree_remove (self->root, block);
+
+  self->stats.n_blocks--;
+  self->stats.allocated_size -= block->size;
+
+  if (next && next->use_count == 0) {
+    free_list_remove (self, next);
+    shm_alloc_space_merge_next (block);
+  }
+
+  if (prev && prev->use_count == 0) {
+    free_list_remove (self, prev);
+    shm_alloc_space_merge_next (prev);
+    block = prev;
   }
 
-  spalloc_free (ShmAllocBlock, block);
+  free_list_add (self, block);
 }
 
 ShmAllocBlock *
 shm_alloc_space_block_get (ShmAllocSpace * self, unsigned long offset)
 {
-  ShmAllocBlock *block = NULL;
-
-  for (block = self->blocks; block; block = block->next) {
-    if (block->offset <= offset && (block->offset + block->size) > offset)
+  ShmAllocBlock *block = self->root;
+
+  while (block) {
+    if (offset < block->offset)
+      block = block->left;
+    else if (offset >= block->offset + block->size)
+      block = block->right;
+    else
       return block;
   }
 
   return NULL;
 }
 
+void
+shm_alloc_space_get_stats (ShmAllocSpace * self, ShmAllocStats * stats)
+{
+  ShmAllocBlock *extent;
+  int c;
+
+  *stats = self->stats;
+  stats->largest_free = 0;
+
+  if (!self->free_classes)
+    return;
+
+  /* The largest free extent is in the highest non-empty class */
+  c = SHM_ALLOC_NUM_CLASSES - 1;
+  while (!(self->free_classes & ((uint64_t) 1 << c)))
+    c--;
+
+  for (extent = self->free_lists[c]; extent; extent = extent->next_free)
+    if (extent->size > stats->largest_free)
+      stats->largest_free = extent->size;
+}
+
 
 void
 shm_alloc_space_block_inc (ShmAllocBlock * block)
@@ -179,6 +439,8 @@ shm_alloc_space_block_dec (ShmAllocBlock * block)
 {
   block->use_count--;
 
-  if (block->use_count <= 0)
+  if (block->use_count <= 0) {
+    block->use_count = 0;
     shm_alloc_space_free_block (block);
+  }
 }
@@ -23,6 +23,7 @@
  */
 
 #include <stdlib.h>
+#include <stdint.h>
 
 #ifndef __SHMALLOC_H__
 #define __SHMALLOC_H__
@@ -52,6 +53,19 @@ extern "C" {
 
 typedef struct _ShmAllocSpace ShmAllocSpace;
 typedef struct _ShmAllocBlock ShmAllocBlock;
+typedef struct _ShmAllocStats ShmAllocStats;
+
+/* The free space is fragmented when the largest free extent is much
+ * smaller than the total free size */
+struct _ShmAllocStats
+{
+  unsigned long n_blocks;
+  unsigned long allocated_size;
+
+  unsigned long n_free_extents;
+  unsigned long free_size;
+  unsigned long largest_free;
+};
 
 ShmAllocSpace *shm_alloc_space_new (size_t size);
 void shm_alloc_space_free (ShmAllocSpace * self);
@@ -66,6 +80,8 @@ void shm_alloc_space_block_dec (ShmAllocBlock * block);
 ShmAllocBlock * shm_alloc_space_block_get (ShmAllocSpace * space,
     unsigned long offset);
 
+void shm_alloc_space_get_stats (ShmAllocSpace * space, ShmAllocStats * stats);
+
 
 #ifdef __cplusplus
 }
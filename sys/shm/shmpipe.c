@@ -64,6 +64,10 @@
  * Type 4 goes from the client to the server
  * The rest are from the server to the client
  * The client should never write in the SHM
+ *
+ * Both sides queue the buffer and ack packets and write them in batches,
+ * and read as many packets as are available at once, so that streams of
+ * small buffers do not cost a syscall per buffer and per client.
  */
 
 
@@ -77,6 +81,41 @@ enum
   COMMAND_ACK_BUFFER = 4
 };
 
+struct CommandBuffer
+{
+  unsigned int type;
+  int area_id;
+
+  union
+  {
+    struct
+    {
+      size_t size;
+      unsigned int path_size;
+      /* Followed by path */
+    } new_shm_area;
+    struct
+    {
+      unsigned long offset;
+      unsigned long size;
+    } buffer;
+    struct
+    {
+      unsigned long offset;
+    } ack_buffer;
+  } payload;
+};
+
+/* Number of packets read or written at once */
+#define COMMAND_BATCH_SIZE 32
+
+struct CommandQueue
+{
+  char data[COMMAND_BATCH_SIZE * sizeof (struct CommandBuffer)];
+  size_t head;
+  size_t tail;
+};
+
 typedef struct _ShmArea ShmArea;
 
 struct _ShmArea
@@ -109,10 +148,11 @@ struct _ShmBuffer
 
   ShmBuffer *next;
 
+  uint64_t tag;
+  void *data;
+
   int num_clients;
   int clients[0];
-
-  uint64_t tag;
 };
 
 
@@ -133,12 +173,22 @@ struct _ShmPipe
   ShmClient *clients;
 
   mode_t perms;
+
+  /* Client side, packets from and to the server */
+  struct CommandQueue in;
+  struct CommandQueue out;
+
+  sp_buffer_free_callback buffer_free_callback;
+  void *buffer_free_user_data;
 };
 
 struct _ShmClient
 {
   int fd;
 
+  struct CommandQueue in;
+  struct CommandQueue out;
+
   ShmClient *next;
 };
 
@@ -149,31 +199,6 @@ struct _ShmBlock
   ShmAllocBlock *ablock;
 };
 
-struct CommandBuffer
-{
-  unsigned int type;
-  int area_id;
-
-  union
-  {
-    struct
-    {
-      size_t size;
-      unsigned int path_size;
-      /* Followed by path */
-    } new_shm_area;
-    struct
-    {
-      unsigned long offset;
-      unsigned long size;
-    } buffer;
-    struct
-    {
-      unsigned long offset;
-    } ack_buffer;
-  } payload;
-};
-
 static ShmArea *sp_open_shm (char *path, int id, mode_t perms, size_t size);
 static void sp_close_shm (ShmArea * area);
 static int sp_shmbuf_dec (ShmPipe * self, ShmBuffer * buf,
@@ -388,6 +413,16 @@ sp_set_data (ShmPipe * self, void *data)
   self->data = data;
 }
 
+/* The callback is called with the data given to sp_writer_send_buf() once
+ * every client has released the buffer */
+void
+sp_writer_set_buffer_free_callback (ShmPipe * self,
+    sp_buffer_free_callback callback, void *user_data)
+{
+  self->buffer_free_callback = callback;
+  self->buffer_free_user_data = user_data;
+}
+
 static void
 sp_inc (ShmPipe * self)
 {
@@ -452,6 +487,39 @@ send_command (int fd, struct CommandBuffer *cb, unsigned short int type,
   return 1;
 }
 
+static int
+flush_commands (int fd, struct CommandQueue *queue)
+{
+  size_t size = queue->tail - queue->head;
+
+  queue->head = queue->tail = 0;
+
+  if (size == 0)
+    return 1;
+
+  if (send (fd, queue->data, size, MSG_NOSIGNAL) != (ssize_t) size)
+    return 0;
+
+  return 1;
+}
+
+static int
+queue_command (int fd, struct CommandQueue *queue, struct CommandBuffer *cb,
+    unsigned short int type, int area_id)
+{
+  cb->type = type;
+  cb->area_id = area_id;
+
+  if (queue->tail + sizeof (struct CommandBuffer) > sizeof (queue->data) &&
+      !flush_commands (fd, queue))
+    return 0;
+
+  memcpy (queue->data + queue->tail, cb, sizeof (struct CommandBuffer));
+  queue->tail += sizeof (struct CommandBuffer);
+
+  return 1;
+}
+
 int
 sp_writer_resize (ShmPipe * self, size_t size)
 {
@@ -478,6 +546,10 @@ sp_writer_resize (ShmPipe * self, size_t size)
   for (client = self->clients; client; client = client->next) {
     struct CommandBuffer cb = { 0 };
 
+    /* The queued buffers must arrive before the area is closed */
+    if (!flush_commands (client->fd, &client->out))
+      continue;
+
     if (!send_command (client->fd, &cb, COMMAND_CLOSE_SHM_AREA,
             old_current->id))
       continue;
@@ -540,10 +612,12 @@ sp_writer_free_block (ShmBlock * block)
   spalloc_free (ShmBlock, block);
 }
 
-/* Returns the number of client this has successfully been sent to */
+/* Returns the number of client this has successfully been sent to, the
+ * notifications are only queued until the next sp_writer_flush() */
 
 int
-sp_writer_send_buf (ShmPipe * self, char *buf, size_t size, uint64_t tag)
+sp_writer_send_buf (ShmPipe * self, char *buf, size_t size, uint64_t tag,
+    void *data)
 {
   ShmArea *area = NULL;
   unsigned long offset = 0;
@@ -579,12 +653,14 @@ sp_writer_send_buf (ShmPipe * self, char *buf, size_t size, uint64_t tag)
   sb->num_clients = self->num_clients;
   sb->ablock = ablock;
   sb->tag = tag;
+  sb->data = data;
 
   for (client = self->clients; client; client = client->next) {
     struct CommandBuffer cb = { 0 };
     cb.payload.buffer.offset = offset;
     cb.payload.buffer.size = bsize;
-    if (!send_command (client->fd, &cb, COMMAND_NEW_BUFFER, self->shm_area->id))
+    if (!queue_command (client->fd, &client->out, &cb, COMMAND_NEW_BUFFER,
+            area->id))
       continue;
     sb->clients[i++] = client->fd;
     c++;
@@ -606,17 +682,54 @@ sp_writer_send_buf (ShmPipe * self, char *buf, size_t size, uint64_t tag)
   return c;
 }
 
+void
+sp_writer_flush (ShmPipe * self)
+{
+  ShmClient *client;
+
+  /* A client that failed is noticed and closed when reading from it */
+  for (client = self->clients; client; client = client->next)
+    flush_commands (client->fd, &client->out);
+}
+
+/* Reads the available packets in the queue, returns -1 on error or if the
+ * socket was closed */
 static int
-recv_command (int fd, struct CommandBuffer *cb)
+recv_commands (int fd, struct CommandQueue *queue)
 {
-  int retval;
+  ssize_t retval;
 
-  retval = recv (fd, cb, sizeof (struct CommandBuffer), MSG_DONTWAIT);
-  if (retval == sizeof (struct CommandBuffer)) {
-    return 1;
-  } else {
-    return 0;
+  if (queue->head > 0) {
+    memmove (queue->data, queue->data + queue->head,
+        queue->tail - queue->head);
+    queue->tail -= queue->head;
+    queue->head = 0;
   }
+
+  if (queue->tail == sizeof (queue->data))
+    return 0;
+
+  retval = recv (fd, queue->data + queue->tail,
+      sizeof (queue->data) - queue->tail, MSG_DONTWAIT);
+  if (retval < 0)
+    return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+  if (retval == 0)
+    return -1;
+
+  queue->tail += retval;
+  return retval;
+}
+
+static int
+next_command (struct CommandQueue *queue, struct CommandBuffer *cb)
+{
+  if (queue->tail - queue->head < sizeof (struct CommandBuffer))
+    return 0;
+
+  memcpy (cb, queue->data + queue->head, sizeof (struct CommandBuffer));
+  queue->head += sizeof (struct CommandBuffer);
+
+  return 1;
 }
 
 long int
@@ -626,10 +739,16 @@ sp_client_recv (ShmPipe * self, char **buf)
   ShmArea *newarea;
   ShmArea *area;
   struct CommandBuffer cb;
+  size_t queued;
   int retval;
 
-  if (!recv_command (self->main_socket, &cb))
-    return -1;
+  if (!next_command (&self->in, &cb)) {
+    if (recv_commands (self->main_socket, &self->in) < 0)
+      return -1;
+    /* Only part of a packet arrived so far */
+    if (!next_command (&self->in, &cb))
+      return 0;
+  }
 
   switch (cb.type) {
     case COMMAND_NEW_SHM_AREA:
@@ -637,11 +756,21 @@ sp_client_recv (ShmPipe * self, char **buf)
       assert (cb.payload.new_shm_area.size > 0);
 
       area_name = malloc (cb.payload.new_shm_area.path_size);
-      retval = recv (self->main_socket, area_name,
-          cb.payload.new_shm_area.path_size, 0);
-      if (retval != cb.payload.new_shm_area.path_size) {
-        free (area_name);
-        return -3;
+
+      /* The start of the path may already have been read with the packet */
+      queued = self->in.tail - self->in.head;
+      if (queued > cb.payload.new_shm_area.path_size)
+        queued = cb.payload.new_shm_area.path_size;
+      memcpy (area_name, self->in.data + self->in.head, queued);
+      self->in.head += queued;
+
+      if (queued < cb.payload.new_shm_area.path_size) {
+        retval = recv (self->main_socket, area_name + queued,
+            cb.payload.new_shm_area.path_size - queued, MSG_WAITALL);
+        if (retval != (int) (cb.payload.new_shm_area.path_size - queued)) {
+          free (area_name);
+          return -3;
+        }
       }
 
       newarea = sp_open_shm (area_name, cb.area_id, 0,
@@ -681,33 +810,43 @@ sp_client_recv (ShmPipe * self, char **buf)
   return 0;
 }
 
+int
+sp_client_has_pending (ShmPipe * self)
+{
+  return self->in.tail - self->in.head >= sizeof (struct CommandBuffer);
+}
+
+/* Handles all the acks the client sent since the last call */
 int
 sp_writer_recv (ShmPipe * self, ShmClient * client)
 {
   ShmBuffer *buf = NULL, *prev_buf = NULL;
   struct CommandBuffer cb;
 
-  if (!recv_command (client->fd, &cb))
+  if (recv_commands (client->fd, &client->in) < 0)
     return -1;
 
-  switch (cb.type) {
-    case COMMAND_ACK_BUFFER:
-
-      for (buf = self->buffers; buf; buf = buf->next) {
-        if (buf->shm_area->id == cb.area_id &&
-            buf->offset == cb.payload.ack_buffer.offset) {
-          sp_shmbuf_dec (self, buf, prev_buf, client);
-          break;
+  while (next_command (&client->in, &cb)) {
+    switch (cb.type) {
+      case COMMAND_ACK_BUFFER:
+
+        prev_buf = NULL;
+        for (buf = self->buffers; buf; buf = buf->next) {
+          if (buf->shm_area->id == cb.area_id &&
+              buf->offset == cb.payload.ack_buffer.offset) {
+            sp_shmbuf_dec (self, buf, prev_buf, client);
+            break;
+          }
+          prev_buf = buf;
         }
-        prev_buf = buf;
-      }
 
-      if (!buf)
-        return -2;
+        if (!buf)
+          return -2;
 
-      break;
-    default:
-      return -99;
+        break;
+      default:
+        return -99;
+    }
   }
 
   return 0;
@@ -718,6 +857,7 @@ sp_client_recv_finish (ShmPipe * self, char *buf)
 {
   ShmArea *shm_area = NULL;
   unsigned long offset;
+  int area_id;
   struct CommandBuffer cb = { 0 };
 
   for (shm_area = self->shm_area; shm_area; shm_area = shm_area->next) {
@@ -729,12 +869,20 @@ sp_client_recv_finish (ShmPipe * self, char *buf)
   assert (shm_area);
 
   offset = buf - shm_area->shm_area_buf;
+  area_id = shm_area->id;
 
   sp_shm_area_dec (self, shm_area);
 
+  /* Sent with the next batch or by sp_client_flush() */
   cb.payload.ack_buffer.offset = offset;
-  return send_command (self->main_socket, &cb, COMMAND_ACK_BUFFER,
-      self->shm_area->id);
+  return queue_command (self->main_socket, &self->out, &cb,
+      COMMAND_ACK_BUFFER, area_id);
+}
+
+int
+sp_client_flush (ShmPipe * self)
+{
+  return flush_commands (self->main_socket, &self->out);
 }
 
 ShmPipe *
@@ -796,6 +944,7 @@ sp_writer_accept_client (ShmPipe * self)
   }
 
   client = spalloc_new (ShmClient);
+  memset (client, 0, sizeof (ShmClient));
   client->fd = fd;
 
   /* Prepend ot linked list */
@@ -841,6 +990,9 @@ sp_shmbuf_dec (ShmPipe * self, ShmBuffer * buf, ShmBuffer * prev_buf,
     else
       self->buffers = buf->next;
 
+    if (buf->data && self->buffer_free_callback)
+      self->buffer_free_callback (buf->data, self->buffer_free_user_data);
+
     shm_alloc_space_block_dec (buf->ablock);
     sp_shm_area_dec (self, buf->shm_area);
     spalloc_free1 (sizeof (ShmBuffer) + sizeof (int) * buf->num_clients, buf);
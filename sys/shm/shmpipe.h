@@ -78,6 +78,8 @@ typedef struct _ShmPipe ShmPipe;
 typedef struct _ShmBlock ShmBlock;
 typedef struct _ShmBuffer ShmBuffer;
 
+typedef void (*sp_buffer_free_callback) (void *data, void *user_data);
+
 ShmPipe *sp_writer_create (const char *path, size_t size, mode_t perms);
 const char *sp_writer_get_path (ShmPipe *pipe);
 void sp_close (ShmPipe * self);
@@ -92,7 +94,11 @@ int sp_writer_get_client_fd (ShmClient * client);
 
 ShmBlock *sp_writer_alloc_block (ShmPipe * self, size_t size);
 void sp_writer_free_block (ShmBlock *block);
-int sp_writer_send_buf (ShmPipe * self, char *buf, size_t size, uint64_t tag);
+int sp_writer_send_buf (ShmPipe * self, char *buf, size_t size, uint64_t tag,
+    void *data);
+void sp_writer_set_buffer_free_callback (ShmPipe * self,
+    sp_buffer_free_callback callback, void *user_data);
+void sp_writer_flush (ShmPipe * self);
 char *sp_writer_block_get_buf (ShmBlock *block);
 ShmPipe *sp_writer_block_get_pipe (ShmBlock *block);
 
@@ -105,6 +111,8 @@ int sp_writer_pending_writes (ShmPipe * self);
 ShmPipe *sp_client_open (const char *path);
 long int sp_client_recv (ShmPipe * self, char **buf);
 int sp_client_recv_finish (ShmPipe * self, char *buf);
+int sp_client_flush (ShmPipe * self);
+int sp_client_has_pending (ShmPipe * self);
 
 ShmBuffer *sp_writer_get_pending_buffers (ShmPipe * self);
 ShmBuffer *sp_writer_get_next_buffer (ShmBuffer * buffer);
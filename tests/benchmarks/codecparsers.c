@@ -0,0 +1,777 @@
+/* GStreamer
+ *
+ * codecparsers.c: benchmark of the codecparsers library and videoparsers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* Generates 1080p elementary streams at a contribution bitrate with a fixed
+ * seed, so that runs are comparable, and measures:
+ *
+ *  - the start code scan of parserutils over each stream
+ *  - gst_h264_parser_identify_nalu() and gst_h264_parser_parse_slice_hdr()
+ *  - gst_mpeg_video_parse()
+ *  - gst_mpeg4_parse()
+ *  - gst_vc1_identify_next_bdu() and gst_vc1_parse_frame_header()
+ *  - the h264parse, mpegvideoparse and mpeg4videoparse elements, reading
+ *    the streams from a file
+ *
+ * Slice payloads are random, escaped the way each format requires, so the
+ * scans see realistic data. The library results are printed in ns per
+ * unit and MB/s, the element results in MB/s. */
+
+#include <stdlib.h>
+#include <string.h>
+#include <glib/gstdio.h>
+#include <gst/gst.h>
+#include <gst/codecparsers/gsth264parser.h>
+#include <gst/codecparsers/gstmpegvideoparser.h>
+#include <gst/codecparsers/gstmpeg4parser.h>
+#include <gst/codecparsers/gstvc1parser.h>
+
+#include "parserutils.h"
+
+#define WIDTH 1920
+#define HEIGHT 1088
+#define FPS 25
+#define DEFAULT_BITRATE 50      /* Mbit/s */
+#define DEFAULT_N_FRAMES 100
+#define SLICES_PER_FRAME 8
+#define GOP_LENGTH 25
+#define N_REPEATS 10
+#define MAX_START_CODES 4096
+
+typedef struct
+{
+  guint8 data[64];
+  guint pos;                    /* in bits */
+} BitWriter;
+
+static void
+bit_writer_put (BitWriter * bw, guint32 val, guint nbits)
+{
+  while (nbits > 0) {
+    nbits--;
+    if ((val >> nbits) & 1)
+      bw->data[bw->pos / 8] |= 0x80 >> (bw->pos % 8);
+    bw->pos++;
+  }
+}
+
+static void
+bit_writer_put_ue (BitWriter * bw, guint32 val)
+{
+  guint len = g_bit_storage (val + 1);
+
+  bit_writer_put (bw, 0, len - 1);
+  bit_writer_put (bw, val + 1, len);
+}
+
+static void
+bit_writer_put_se (BitWriter * bw, gint32 val)
+{
+  bit_writer_put_ue (bw, val > 0 ? 2 * val - 1 : -2 * val);
+}
+
+/* rbsp_trailing_bits () */
+static void
+bit_writer_put_trailing_bits (BitWriter * bw)
+{
+  bit_writer_put (bw, 1, 1);
+  if (bw->pos % 8)
+    bit_writer_put (bw, 0, 8 - bw->pos % 8);
+}
+
+/* Appends @rbsp with emulation prevention bytes inserted, as H.264 and
+ * VC-1 advanced profile do */
+static void
+append_escaped (GByteArray * out, const guint8 * rbsp, guint size)
+{
+  static const guint8 epb = 0x03;
+  guint i, zeros = 0;
+
+  for (i = 0; i < size; i++) {
+    if (zeros >= 2 && rbsp[i] <= 3) {
+      g_byte_array_append (out, &epb, 1);
+      zeros = 0;
+    }
+    g_byte_array_append (out, &rbsp[i], 1);
+    zeros = rbsp[i] ? 0 : zeros + 1;
+  }
+}
+
+/* Random payload of @size bytes that ends with a stop bit */
+static guint8 *
+random_payload (GRand * rand, guint size)
+{
+  guint8 *data = g_malloc (size);
+  guint i;
+
+  for (i = 0; i < size; i++)
+    data[i] = g_rand_int_range (rand, 0, 256);
+  data[size - 1] = 0x80;
+
+  return data;
+}
+
+/* Random payload without any 00 00 01, as MPEG-1/2 and MPEG-4 part 2
+ * streams have no escaping */
+static void
+append_random_unescaped (GByteArray * out, GRand * rand, guint size)
+{
+  guint8 *data = random_payload (rand, size);
+  guint i, zeros = 0;
+
+  for (i = 0; i < size; i++) {
+    if (zeros >= 2 && data[i] == 1)
+      data[i] = 2;
+    zeros = data[i] ? 0 : zeros + 1;
+  }
+  g_byte_array_append (out, data, size);
+  g_free (data);
+}
+
+static void
+append_start_code (GByteArray * out, guint8 code)
+{
+  const guint8 sc[4] = { 0x00, 0x00, 0x01, code };
+
+  g_byte_array_append (out, sc, 4);
+}
+
+static void
+append_bits (GByteArray * out, const BitWriter * bw)
+{
+  g_byte_array_append (out, bw->data, (bw->pos + 7) / 8);
+}
+
+static guint
+frame_size (guint bitrate)
+{
+  return bitrate * 1000000 / 8 / FPS;
+}
+
+/* Main profile, CABAC, POC type 0 */
+static GByteArray *
+generate_h264 (GRand * rand, guint n_frames, guint bitrate)
+{
+  static const guint8 aud[] = { 0x00, 0x00, 0x00, 0x01, 0x09, 0xf0 };
+  GByteArray *out = g_byte_array_new ();
+  guint mbs_per_slice = (WIDTH / 16) * (HEIGHT / 16) / SLICES_PER_FRAME;
+  guint slice_size = frame_size (bitrate) / SLICES_PER_FRAME;
+  guint i, j;
+  BitWriter bw;
+
+  for (i = 0; i < n_frames; i++) {
+    gboolean idr = (i % GOP_LENGTH) == 0;
+
+    g_byte_array_append (out, aud, sizeof (aud));
+
+    if (idr) {
+      /* SPS */
+      memset (&bw, 0, sizeof (bw));
+      bit_writer_put (&bw, 0x67, 8);
+      bit_writer_put (&bw, 77, 8);      /* profile_idc */
+      bit_writer_put (&bw, 0, 8);       /* constraint flags */
+      bit_writer_put (&bw, 40, 8);      /* level_idc */
+      bit_writer_put_ue (&bw, 0);       /* seq_parameter_set_id */
+      bit_writer_put_ue (&bw, 1);       /* log2_max_frame_num_minus4 */
+      bit_writer_put_ue (&bw, 0);       /* pic_order_cnt_type */
+      bit_writer_put_ue (&bw, 2);       /* log2_max_pic_order_cnt_lsb_minus4 */
+      bit_writer_put_ue (&bw, 1);       /* num_ref_frames */
+      bit_writer_put (&bw, 0, 1);       /* gaps_in_frame_num_allowed */
+      bit_writer_put_ue (&bw, WIDTH / 16 - 1);
+      bit_writer_put_ue (&bw, HEIGHT / 16 - 1);
+      bit_writer_put (&bw, 1, 1);       /* frame_mbs_only_flag */
+      bit_writer_put (&bw, 1, 1);       /* direct_8x8_inference_flag */
+      bit_writer_put (&bw, 0, 1);       /* frame_cropping_flag */
+      bit_writer_put (&bw, 0, 1);       /* vui_parameters_present_flag */
+      bit_writer_put_trailing_bits (&bw);
+      append_start_code (out, bw.data[0]);
+      append_escaped (out, bw.data + 1, bw.pos / 8 - 1);
+
+      /* PPS */
+      memset (&bw, 0, sizeof (bw));
+      bit_writer_put (&bw, 0x68, 8);
+      bit_writer_put_ue (&bw, 0);       /* pic_parameter_set_id */
+      bit_writer_put_ue (&bw, 0);       /* seq_parameter_set_id */
+      bit_writer_put (&bw, 1, 1);       /* entropy_coding_mode_flag */
+      bit_writer_put (&bw, 0, 1);       /* pic_order_present_flag */
+      bit_writer_put_ue (&bw, 0);       /* num_slice_groups_minus1 */
+      bit_writer_put_ue (&bw, 0);       /* num_ref_idx_l0_active_minus1 */
+      bit_writer_put_ue (&bw, 0);       /* num_ref_idx_l1_active_minus1 */
+      bit_writer_put (&bw, 0, 1);       /* weighted_pred_flag */
+      bit_writer_put (&bw, 0, 2);       /* weighted_bipred_idc */
+      bit_writer_put_se (&bw, 0);       /* pic_init_qp_minus26 */
+      bit_writer_put_se (&bw, 0);       /* pic_init_qs_minus26 */
+      bit_writer_put_se (&bw, 0);       /* chroma_qp_index_offset */
+      bit_writer_put (&bw, 1, 1);       /* deblocking_filter_control_present */
+      bit_writer_put (&bw, 0, 1);       /* constrained_intra_pred_flag */
+      bit_writer_put (&bw, 0, 1);       /* redundant_pic_cnt_present_flag */
+      bit_writer_put_trailing_bits (&bw);
+      append_start_code (out, bw.data[0]);
+      append_escaped (out, bw.data + 1, bw.pos / 8 - 1);
+    }
+
+    for (j = 0; j < SLICES_PER_FRAME; j++) {
+      GByteArray *rbsp = g_byte_array_new ();
+      guint8 *payload;
+
+      memset (&bw, 0, sizeof (bw));
+      bit_writer_put (&bw, idr ? 0x65 : 0x41, 8);
+      bit_writer_put_ue (&bw, j * mbs_per_slice);       /* first_mb_in_slice */
+      bit_writer_put_ue (&bw, idr ? 7 : 5);     /* slice_type, I or P */
+      bit_writer_put_ue (&bw, 0);       /* pic_parameter_set_id */
+      bit_writer_put (&bw, i % GOP_LENGTH, 5);  /* frame_num */
+      if (idr)
+        bit_writer_put_ue (&bw, (i / GOP_LENGTH) % 2);  /* idr_pic_id */
+      bit_writer_put (&bw, (2 * i) % 64, 6);    /* pic_order_cnt_lsb */
+      if (!idr) {
+        bit_writer_put (&bw, 0, 1);     /* num_ref_idx_active_override */
+        bit_writer_put (&bw, 0, 1);     /* ref_pic_list_modification_l0 */
+      }
+      /* dec_ref_pic_marking () */
+      if (idr)
+        bit_writer_put (&bw, 0, 2);
+      else
+        bit_writer_put (&bw, 0, 1);
+      if (!idr)
+        bit_writer_put_ue (&bw, 0);     /* cabac_init_idc */
+      bit_writer_put_se (&bw, g_rand_int_range (rand, -4, 5));
+      bit_writer_put_ue (&bw, 0);       /* disable_deblocking_filter_idc */
+      bit_writer_put_se (&bw, 0);       /* slice_alpha_c0_offset_div2 */
+      bit_writer_put_se (&bw, 0);       /* slice_beta_offset_div2 */
+      /* cabac_alignment_one_bit */
+      if (bw.pos % 8)
+        bit_writer_put (&bw, 0xff, 8 - bw.pos % 8);
+
+      g_byte_array_append (rbsp, bw.data + 1, bw.pos / 8 - 1);
+      payload = random_payload (rand, slice_size);
+      g_byte_array_append (rbsp, payload, slice_size);
+      g_free (payload);
+
+      if (j == 0)
+        g_byte_array_append (out, (const guint8 *) "\0", 1);
+      append_start_code (out, bw.data[0]);
+      append_escaped (out, rbsp->data, rbsp->len);
+      g_byte_array_free (rbsp, TRUE);
+    }
+  }
+
+  /* end of stream, so that the last slice is complete */
+  append_start_code (out, 0x0b);
+
+  return out;
+}
+
+/* MPEG-2 main profile, one slice per macroblock row */
+static GByteArray *
+generate_mpeg2 (GRand * rand, guint n_frames, guint bitrate)
+{
+  GByteArray *out = g_byte_array_new ();
+  guint rows = HEIGHT / 16;
+  guint slice_size = frame_size (bitrate) / rows;
+  guint i, j;
+  BitWriter bw;
+
+  for (i = 0; i < n_frames; i++) {
+    gboolean intra = (i % GOP_LENGTH) == 0;
+
+    if (intra) {
+      memset (&bw, 0, sizeof (bw));
+      bit_writer_put (&bw, WIDTH, 12);
+      bit_writer_put (&bw, HEIGHT, 12);
+      bit_writer_put (&bw, 3, 4);       /* aspect_ratio_information, 16:9 */
+      bit_writer_put (&bw, 3, 4);       /* frame_rate_code, 25 */
+      bit_writer_put (&bw, bitrate * 2500, 18); /* bit_rate_value */
+      bit_writer_put (&bw, 1, 1);       /* marker_bit */
+      bit_writer_put (&bw, 112, 10);    /* vbv_buffer_size_value */
+      bit_writer_put (&bw, 0, 3);       /* constrained, no matrices */
+      append_start_code (out, GST_MPEG_VIDEO_PACKET_SEQUENCE);
+      append_bits (out, &bw);
+
+      memset (&bw, 0, sizeof (bw));
+      bit_writer_put (&bw, GST_MPEG_VIDEO_PACKET_EXT_SEQUENCE, 4);
+      bit_writer_put (&bw, 0x48, 8);    /* main profile, main level */
+      bit_writer_put (&bw, 1, 1);       /* progressive_sequence */
+      bit_writer_put (&bw, 1, 2);       /* chroma_format, 4:2:0 */
+      bit_writer_put (&bw, 0, 4);       /* size extensions */
+      bit_writer_put (&bw, 0, 12);      /* bit_rate_extension */
+      bit_writer_put (&bw, 1, 1);       /* marker_bit */
+      bit_writer_put (&bw, 0, 8);       /* vbv_buffer_size_extension */
+      bit_writer_put (&bw, 0, 1);       /* low_delay */
+      bit_writer_put (&bw, 0, 7);       /* frame rate extensions */
+      append_start_code (out, GST_MPEG_VIDEO_PACKET_EXTENSION);
+      append_bits (out, &bw);
+
+      memset (&bw, 0, sizeof (bw));
+      bit_writer_put (&bw, 0, 25);      /* time_code */
+      bit_writer_put (&bw, 1, 1);       /* closed_gop */
+      bit_writer_put (&bw, 0, 1);       /* broken_link */
+      append_start_code (out, GST_MPEG_VIDEO_PACKET_GOP);
+      append_bits (out, &bw);
+    }
+
+    memset (&bw, 0, sizeof (bw));
+    bit_writer_put (&bw, i % GOP_LENGTH, 10);   /* temporal_reference */
+    bit_writer_put (&bw, intra ? 1 : 2, 3);     /* picture_coding_type */
+    bit_writer_put (&bw, 0xffff, 16);   /* vbv_delay */
+    if (!intra)
+      bit_writer_put (&bw, 7, 4);       /* full_pel_forward, forward_f_code */
+    bit_writer_put (&bw, 0, 1);         /* extra_bit_picture */
+    append_start_code (out, GST_MPEG_VIDEO_PACKET_PICTURE);
+    append_bits (out, &bw);
+
+    memset (&bw, 0, sizeof (bw));
+    bit_writer_put (&bw, GST_MPEG_VIDEO_PACKET_EXT_PICTURE, 4);
+    bit_writer_put (&bw, intra ? 0xffff : 0x22ff, 16);  /* f_codes */
+    bit_writer_put (&bw, 0, 2);         /* intra_dc_precision */
+    bit_writer_put (&bw, 3, 2);         /* picture_structure, frame */
+    /* top_field_first to chroma_420_type, frame_pred_frame_dct set */
+    bit_writer_put (&bw, 0x41, 8);
+    bit_writer_put (&bw, 1, 1);         /* progressive_frame */
+    bit_writer_put (&bw, 0, 1);         /* composite_display_flag */
+    append_start_code (out, GST_MPEG_VIDEO_PACKET_EXTENSION);
+    append_bits (out, &bw);
+
+    for (j = 0; j < rows; j++) {
+      append_start_code (out, GST_MPEG_VIDEO_PACKET_SLICE_MIN + j);
+      append_random_unescaped (out, rand, slice_size);
+    }
+  }
+
+  append_start_code (out, GST_MPEG_VIDEO_PACKET_SEQUENCE_END);
+
+  return out;
+}
+
+/* MPEG-4 part 2 simple profile, one VOP per frame */
+static GByteArray *
+generate_mpeg4 (GRand * rand, guint n_frames, guint bitrate)
+{
+  GByteArray *out = g_byte_array_new ();
+  guint i;
+  BitWriter bw;
+
+  memset (&bw, 0, sizeof (bw));
+  bit_writer_put (&bw, 0x08, 8);        /* simple profile, level 0 */
+  append_start_code (out, GST_MPEG4_VISUAL_OBJ_SEQ_START);
+  append_bits (out, &bw);
+
+  memset (&bw, 0, sizeof (bw));
+  bit_writer_put (&bw, 0, 1);           /* is_visual_object_identifier */
+  bit_writer_put (&bw, 1, 4);           /* visual_object_type, video */
+  bit_writer_put (&bw, 0, 1);           /* video_signal_type */
+  bit_writer_put (&bw, 0x1, 2);         /* next_start_code () stuffing */
+  append_start_code (out, GST_MPEG4_VISUAL_OBJ);
+  append_bits (out, &bw);
+
+  append_start_code (out, GST_MPEG4_VIDEO_OBJ_FIRST);
+
+  memset (&bw, 0, sizeof (bw));
+  bit_writer_put (&bw, 0, 1);           /* random_accessible_vol */
+  bit_writer_put (&bw, 1, 8);           /* video_object_type_indication */
+  bit_writer_put (&bw, 0, 1);           /* is_object_layer_identifier */
+  bit_writer_put (&bw, 1, 4);           /* aspect_ratio_info, square */
+  bit_writer_put (&bw, 0, 1);           /* vol_control_parameters */
+  bit_writer_put (&bw, 0, 2);           /* video_object_layer_shape */
+  bit_writer_put (&bw, 1, 1);           /* marker_bit */
+  bit_writer_put (&bw, FPS, 16);        /* vop_time_increment_resolution */
+  bit_writer_put (&bw, 1, 1);           /* marker_bit */
+  bit_writer_put (&bw, 0, 1);           /* fixed_vop_rate */
+  bit_writer_put (&bw, 1, 1);           /* marker_bit */
+  bit_writer_put (&bw, WIDTH, 13);
+  bit_writer_put (&bw, 1, 1);           /* marker_bit */
+  bit_writer_put (&bw, HEIGHT, 13);
+  bit_writer_put (&bw, 1, 1);           /* marker_bit */
+  bit_writer_put (&bw, 0, 1);           /* interlaced */
+  bit_writer_put (&bw, 1, 1);           /* obmc_disable */
+  bit_writer_put (&bw, 0, 1);           /* sprite_enable */
+  bit_writer_put (&bw, 0, 1);           /* not_8_bit */
+  bit_writer_put (&bw, 0, 1);           /* quant_type */
+  bit_writer_put (&bw, 1, 1);           /* complexity_estimation_disable */
+  bit_writer_put (&bw, 1, 1);           /* resync_marker_disable */
+  bit_writer_put (&bw, 0, 1);           /* data_partitioned */
+  bit_writer_put (&bw, 0, 1);           /* scalability */
+  /* next_start_code () stuffing */
+  bit_writer_put (&bw, 0, 1);
+  if (bw.pos % 8)
+    bit_writer_put (&bw, 0xff, 8 - bw.pos % 8);
+  append_start_code (out, GST_MPEG4_VIDEO_LAYER_FIRST);
+  append_bits (out, &bw);
+
+  for (i = 0; i < n_frames; i++) {
+    gboolean intra = (i % GOP_LENGTH) == 0;
+
+    memset (&bw, 0, sizeof (bw));
+    bit_writer_put (&bw, intra ? 0 : 1, 2);     /* vop_coding_type */
+    bit_writer_put (&bw, 0, 1);         /* modulo_time_base */
+    bit_writer_put (&bw, 1, 1);         /* marker_bit */
+    bit_writer_put (&bw, i % FPS, 5);   /* vop_time_increment */
+    bit_writer_put (&bw, 1, 1);         /* marker_bit */
+    bit_writer_put (&bw, 1, 1);         /* vop_coded */
+    append_start_code (out, GST_MPEG4_VIDEO_OBJ_PLANE);
+    append_bits (out, &bw);
+    append_random_unescaped (out, rand, frame_size (bitrate));
+  }
+
+  append_start_code (out, GST_MPEG4_VISUAL_OBJ_SEQ_END);
+
+  return out;
+}
+
+/* VC-1 advanced profile frame BDUs, only the start codes are looked at */
+static GByteArray *
+generate_vc1 (GRand * rand, guint n_frames, guint bitrate)
+{
+  GByteArray *out = g_byte_array_new ();
+  guint i;
+
+  for (i = 0; i < n_frames; i++) {
+    guint8 *payload = random_payload (rand, frame_size (bitrate));
+
+    append_start_code (out, GST_VC1_FRAME);
+    append_escaped (out, payload, frame_size (bitrate));
+    g_free (payload);
+  }
+
+  append_start_code (out, GST_VC1_END_OF_SEQ);
+
+  return out;
+}
+
+/* Main profile I frame headers, with a few bytes of picture data */
+static guint8 *
+generate_vc1_frame_headers (GRand * rand, guint n_headers, guint header_size)
+{
+  guint8 *out = g_malloc0 (n_headers * header_size);
+  guint i, j;
+
+  for (i = 0; i < n_headers; i++) {
+    BitWriter bw;
+
+    memset (&bw, 0, sizeof (bw));
+    bit_writer_put (&bw, i % 4, 2);     /* frmcnt */
+    bit_writer_put (&bw, 0, 1);         /* ptype, I */
+    bit_writer_put (&bw, g_rand_int_range (rand, 0, 128), 7);   /* bf */
+    bit_writer_put (&bw, g_rand_int_range (rand, 1, 32), 5);    /* pqindex */
+    for (j = bw.pos / 8 + 1; j < header_size; j++)
+      bw.data[j] = g_rand_int_range (rand, 0, 256);
+    memcpy (out + i * header_size, bw.data, header_size);
+  }
+
+  return out;
+}
+
+static void
+report (const gchar * name, GstClockTime elapsed, guint64 n_units,
+    const gchar * unit, guint64 n_bytes)
+{
+  g_print ("%-40s %10.1f ns/%-6s %10.1f MB/s\n", name,
+      (gdouble) elapsed / MAX (n_units, 1), unit,
+      (gdouble) n_bytes / 1e6 / ((gdouble) elapsed / GST_SECOND));
+}
+
+static void
+bench_scan (const gchar * name, const GByteArray * stream)
+{
+  guint *offsets = g_new (guint, MAX_START_CODES);
+  GstClockTime start, elapsed;
+  guint64 n_codes = 0;
+  guint r, pos, n;
+
+  start = gst_util_get_timestamp ();
+  for (r = 0; r < N_REPEATS; r++) {
+    pos = 0;
+    do {
+      n = scan_for_all_start_codes (stream->data + pos, stream->len - pos,
+          offsets, MAX_START_CODES);
+      n_codes += n;
+      if (n > 0)
+        pos += offsets[n - 1] + 3;
+    } while (n == MAX_START_CODES);
+  }
+  elapsed = gst_util_get_timestamp () - start;
+
+  report (name, elapsed, n_codes, "code", (guint64) stream->len * N_REPEATS);
+  g_free (offsets);
+}
+
+static void
+bench_h264 (const GByteArray * stream)
+{
+  GstH264NalParser *parser = gst_h264_nal_parser_new ();
+  GArray *slices = g_array_new (FALSE, FALSE, sizeof (GstH264NalUnit));
+  GstClockTime start, elapsed;
+  GstH264NalUnit nalu;
+  GstH264SliceHdr slice;
+  guint64 n_nals = 0, n_bytes = 0;
+  guint r, i, offset;
+
+  /* collect the slices once, and fill in the parameter sets */
+  offset = 0;
+  while (gst_h264_parser_identify_nalu (parser, stream->data, offset,
+          stream->len, &nalu) == GST_H264_PARSER_OK) {
+    if (nalu.type == GST_H264_NAL_SPS || nalu.type == GST_H264_NAL_PPS)
+      gst_h264_parser_parse_nal (parser, &nalu);
+    else if (nalu.type == GST_H264_NAL_SLICE ||
+        nalu.type == GST_H264_NAL_SLICE_IDR)
+      g_array_append_val (slices, nalu);
+    offset = nalu.offset + nalu.size;
+  }
+
+  start = gst_util_get_timestamp ();
+  for (r = 0; r < N_REPEATS; r++) {
+    offset = 0;
+    while (gst_h264_parser_identify_nalu (parser, stream->data, offset,
+            stream->len, &nalu) == GST_H264_PARSER_OK) {
+      offset = nalu.offset + nalu.size;
+      n_nals++;
+    }
+    n_bytes += offset;
+  }
+  elapsed = gst_util_get_timestamp () - start;
+  report ("gst_h264_parser_identify_nalu", elapsed, n_nals, "NAL", n_bytes);
+
+  n_bytes = 0;
+  start = gst_util_get_timestamp ();
+  for (r = 0; r < N_REPEATS; r++) {
+    for (i = 0; i < slices->len; i++) {
+      GstH264NalUnit *s = &g_array_index (slices, GstH264NalUnit, i);
+
+      if (gst_h264_parser_parse_slice_hdr (parser, s, &slice, TRUE,
+              TRUE) != GST_H264_PARSER_OK) {
+        g_printerr ("Could not parse slice header %u\n", i);
+        exit (1);
+      }
+      n_bytes += slice.header_size / 8;
+    }
+  }
+  elapsed = gst_util_get_timestamp () - start;
+  report ("gst_h264_parser_parse_slice_hdr", elapsed,
+      (guint64) slices->len * N_REPEATS, "slice", n_bytes);
+
+  g_array_free (slices, TRUE);
+  gst_h264_nal_parser_free (parser);
+}
+
+static void
+bench_mpeg_video (const GByteArray * stream)
+{
+  GstMpegVideoPacket packet;
+  GstClockTime start, elapsed;
+  guint64 n_packets = 0;
+  guint r, offset;
+
+  start = gst_util_get_timestamp ();
+  for (r = 0; r < N_REPEATS; r++) {
+    offset = 0;
+    while (gst_mpeg_video_parse (&packet, stream->data, stream->len, offset)) {
+      offset = packet.offset;
+      n_packets++;
+    }
+  }
+  elapsed = gst_util_get_timestamp () - start;
+
+  report ("gst_mpeg_video_parse", elapsed, n_packets, "packet",
+      (guint64) stream->len * N_REPEATS);
+}
+
+static void
+bench_mpeg4 (const GByteArray * stream)
+{
+  GstMpeg4Packet packet;
+  GstClockTime start, elapsed;
+  guint64 n_packets = 0;
+  guint r, offset;
+
+  start = gst_util_get_timestamp ();
+  for (r = 0; r < N_REPEATS; r++) {
+    offset = 0;
+    while (gst_mpeg4_parse (&packet, FALSE, NULL, stream->data, offset,
+            stream->len) == GST_MPEG4_PARSER_OK) {
+      offset = packet.offset + packet.size;
+      n_packets++;
+    }
+  }
+  elapsed = gst_util_get_timestamp () - start;
+
+  report ("gst_mpeg4_parse", elapsed, n_packets, "packet",
+      (guint64) stream->len * N_REPEATS);
+}
+
+static void
+bench_vc1 (const GByteArray * stream, GRand * rand)
+{
+  const guint n_headers = 4096, header_size = 32;
+  GstVC1SeqHdr seqhdr;
+  GstVC1FrameHdr framehdr;
+  GstVC1BDU bdu;
+  GstClockTime start, elapsed;
+  guint64 n_bdus = 0;
+  guint8 *headers;
+  guint r, i, offset;
+
+  start = gst_util_get_timestamp ();
+  for (r = 0; r < N_REPEATS; r++) {
+    offset = 0;
+    while (gst_vc1_identify_next_bdu (stream->data + offset,
+            stream->len - offset, &bdu) == GST_VC1_PARSER_OK) {
+      offset += bdu.offset + bdu.size;
+      n_bdus++;
+    }
+  }
+  elapsed = gst_util_get_timestamp () - start;
+  report ("gst_vc1_identify_next_bdu", elapsed, n_bdus, "BDU",
+      (guint64) stream->len * N_REPEATS);
+
+  memset (&seqhdr, 0, sizeof (seqhdr));
+  seqhdr.profile = GST_VC1_PROFILE_MAIN;
+  seqhdr.struct_c.profile = GST_VC1_PROFILE_MAIN;
+  seqhdr.struct_c.quantizer = GST_VC1_QUANTIZER_IMPLICITLY;
+
+  headers = generate_vc1_frame_headers (rand, n_headers, header_size);
+
+  start = gst_util_get_timestamp ();
+  for (r = 0; r < N_REPEATS * 100; r++) {
+    for (i = 0; i < n_headers; i++) {
+      if (gst_vc1_parse_frame_header (headers + i * header_size, header_size,
+              &framehdr, &seqhdr, NULL) != GST_VC1_PARSER_OK) {
+        g_printerr ("Could not parse frame header %u\n", i);
+        exit (1);
+      }
+    }
+  }
+  elapsed = gst_util_get_timestamp () - start;
+  report ("gst_vc1_parse_frame_header", elapsed,
+      (guint64) n_headers * N_REPEATS * 100, "frame",
+      (guint64) n_headers * header_size * N_REPEATS * 100);
+
+  g_free (headers);
+}
+
+static void
+bench_element (const gchar * element, const gchar * caps,
+    const GByteArray * stream)
+{
+  GstElement *pipeline;
+  GstBus *bus;
+  GstMessage *msg;
+  GError *err = NULL;
+  GstClockTime start, elapsed;
+  gchar *filename, *desc, *name;
+
+  name = g_strdup_printf ("codecparsers-%s", element);
+  filename = g_build_filename (g_get_tmp_dir (), name, NULL);
+  g_free (name);
+  if (!g_file_set_contents (filename, (const gchar *) stream->data,
+          stream->len, &err)) {
+    g_printerr ("Could not write stream: %s\n", err->message);
+    exit (1);
+  }
+
+  desc = g_strdup_printf ("filesrc location=%s blocksize=65536 ! %s ! %s ! "
+      "fakesink", filename, caps, element);
+  pipeline = gst_parse_launch (desc, &err);
+  g_free (desc);
+  if (pipeline == NULL) {
+    g_print ("%-40s skipped: %s\n", element, err->message);
+    g_error_free (err);
+    goto done;
+  }
+
+  bus = gst_element_get_bus (pipeline);
+
+  start = gst_util_get_timestamp ();
+  gst_element_set_state (pipeline, GST_STATE_PLAYING);
+  msg = gst_bus_timed_pop_filtered (bus, GST_CLOCK_TIME_NONE,
+      GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+  elapsed = gst_util_get_timestamp () - start;
+
+  if (GST_MESSAGE_TYPE (msg) == GST_MESSAGE_ERROR) {
+    gst_message_parse_error (msg, &err, NULL);
+    g_print ("%-40s failed: %s\n", element, err->message);
+    g_error_free (err);
+  } else {
+    name = g_strdup_printf ("%s element", element);
+    g_print ("%-40s %10.1f MB/s\n", name,
+        (gdouble) stream->len / 1e6 / ((gdouble) elapsed / GST_SECOND));
+    g_free (name);
+  }
+
+  gst_message_unref (msg);
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_object_unref (bus);
+  gst_object_unref (pipeline);
+
+done:
+  g_unlink (filename);
+  g_free (filename);
+}
+
+int
+main (int argc, char **argv)
+{
+  GByteArray *h264, *mpeg2, *mpeg4, *vc1;
+  gint n_frames = DEFAULT_N_FRAMES;
+  gint bitrate = DEFAULT_BITRATE;
+  GRand *rand;
+
+  gst_init (&argc, &argv);
+
+  if (argc > 1)
+    n_frames = atoi (argv[1]);
+  if (argc > 2)
+    bitrate = atoi (argv[2]);
+  if (n_frames <= 0 || bitrate <= 0) {
+    g_printerr ("Usage: %s [n-frames] [bitrate in Mbit/s]\n", argv[0]);
+    return 1;
+  }
+
+  rand = g_rand_new_with_seed (0x2a);
+
+  g_print ("%d frames of %dx%d at %d Mbit/s\n", n_frames, WIDTH, HEIGHT,
+      bitrate);
+
+  h264 = generate_h264 (rand, n_frames, bitrate);
+  mpeg2 = generate_mpeg2 (rand, n_frames, bitrate);
+  mpeg4 = generate_mpeg4 (rand, n_frames, bitrate);
+  vc1 = generate_vc1 (rand, n_frames, bitrate);
+
+  bench_scan ("start code scan, H.264", h264);
+  bench_scan ("start code scan, MPEG-2", mpeg2);
+  bench_scan ("start code scan, MPEG-4", mpeg4);
+  bench_scan ("start code scan, VC-1", vc1);
+
+  bench_h264 (h264);
+  bench_mpeg_video (mpeg2);
+  bench_mpeg4 (mpeg4);
+  bench_vc1 (vc1, rand);
+
+  bench_element ("h264parse", "video/x-h264,stream-format=byte-stream", h264);
+  bench_element ("mpegvideoparse",
+      "video/mpeg,mpegversion=2,systemstream=false", mpeg2);
+  bench_element ("mpeg4videoparse",
+      "video/mpeg,mpegversion=4,systemstream=false", mpeg4);
+
+  g_byte_array_free (h264, TRUE);
+  g_byte_array_free (mpeg2, TRUE);
+  g_byte_array_free (mpeg4, TRUE);
+  g_byte_array_free (vc1, TRUE);
+  g_rand_free (rand);
+
+  return 0;
+}
@@ -0,0 +1,223 @@
+/* GStreamer
+ *
+ * psdemuxseek.c: benchmark of seeking in mpegpsdemux
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* Writes a program stream of the given size in MB (600 by default) made of
+ * video packs at 8 Mbit/s, with pack sizes from 1 to 4 KB picked from a
+ * fixed seed so that runs are comparable. Then seeks mpegpsdemux to random
+ * positions twice and prints the number of ranges pulled by the seeks,
+ * which is the number of scans needed to find the pack to seek to, and
+ * the time spent in them.
+ *
+ * The second round seeks to the same positions, which the packs remembered
+ * by the demuxer during the first round should resolve without I/O. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib/gstdio.h>
+#include <gst/gst.h>
+
+#define DEFAULT_SIZE 600        /* MB */
+#define BYTE_RATE 1000000       /* bytes per second */
+#define MIN_PACK_SIZE 1024
+#define MAX_PACK_SIZE 4096
+#define N_SEEKS 50
+#define SEED 0x5eec
+
+static GThread *seek_thread;
+static guint n_pulls;
+
+static void
+write_pack (FILE * f, guint8 * pack, guint size, guint64 scr)
+{
+  guint64 v, pts = scr + 9000;
+  guint pes_len = size - 14 - 6;
+  guint i;
+
+  /* pack header, MPEG-2 */
+  pack[0] = pack[1] = 0;
+  pack[2] = 1;
+  pack[3] = 0xba;
+  v = (G_GUINT64_CONSTANT (1) << 46) | (((scr >> 30) & 0x7) << 43) |
+      (G_GUINT64_CONSTANT (1) << 42) | (((scr >> 15) & 0x7fff) << 27) |
+      (G_GUINT64_CONSTANT (1) << 26) | ((scr & 0x7fff) << 11) |
+      (1 << 10) | 1;
+  for (i = 0; i < 6; i++)
+    pack[4 + i] = v >> (40 - 8 * i);
+  v = ((BYTE_RATE / 50) << 2) | 3;
+  pack[10] = v >> 16;
+  pack[11] = v >> 8;
+  pack[12] = v;
+  pack[13] = 0xf8;
+
+  /* video PES packet with a PTS */
+  pack[14] = pack[15] = 0;
+  pack[16] = 1;
+  pack[17] = 0xe0;
+  pack[18] = pes_len >> 8;
+  pack[19] = pes_len;
+  pack[20] = 0x80;
+  pack[21] = 0x80;
+  pack[22] = 5;
+  v = (G_GUINT64_CONSTANT (2) << 36) | (((pts >> 30) & 0x7) << 33) |
+      (G_GUINT64_CONSTANT (1) << 32) | (((pts >> 15) & 0x7fff) << 17) |
+      (1 << 16) | ((pts & 0x7fff) << 1) | 1;
+  for (i = 0; i < 5; i++)
+    pack[23 + i] = v >> (32 - 8 * i);
+  memset (pack + 28, 0xff, size - 28);
+
+  fwrite (pack, size, 1, f);
+}
+
+static gboolean
+write_stream (const gchar * filename, guint64 size, GstClockTime * duration)
+{
+  guint8 pack[MAX_PACK_SIZE];
+  guint64 offset = 0, scr = 0;
+  GRand *rand;
+  FILE *f;
+
+  if (!(f = g_fopen (filename, "wb")))
+    return FALSE;
+
+  rand = g_rand_new_with_seed (SEED);
+  while (offset < size) {
+    guint pack_size = g_rand_int_range (rand, MIN_PACK_SIZE,
+        MAX_PACK_SIZE + 1);
+
+    scr = gst_util_uint64_scale (offset, 90000, BYTE_RATE);
+    write_pack (f, pack, pack_size, scr);
+    offset += pack_size;
+  }
+  g_rand_free (rand);
+
+  *duration = gst_util_uint64_scale (scr, GST_SECOND, 90000);
+
+  return fclose (f) == 0;
+}
+
+/* Only counts the ranges pulled by the seeks, not by the streaming
+ * thread */
+static GstPadProbeReturn
+pull_probe (GstPad * pad, GstPadProbeInfo * info, gpointer user_data)
+{
+  if ((GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_BUFFER) &&
+      g_thread_self () == seek_thread)
+    g_atomic_int_inc (&n_pulls);
+
+  return GST_PAD_PROBE_OK;
+}
+
+static void
+run_seeks (GstElement * pipeline, const GstClockTime * positions,
+    const gchar * name)
+{
+  guint i, pulls, total = 0, worst = 0;
+  gint64 start, elapsed = 0;
+
+  for (i = 0; i < N_SEEKS; i++) {
+    n_pulls = 0;
+    start = g_get_monotonic_time ();
+    if (!gst_element_seek_simple (pipeline, GST_FORMAT_TIME,
+            GST_SEEK_FLAG_FLUSH, positions[i]))
+      g_printerr ("Seek to %" GST_TIME_FORMAT " failed\n",
+          GST_TIME_ARGS (positions[i]));
+    elapsed += g_get_monotonic_time () - start;
+    pulls = g_atomic_int_get (&n_pulls);
+    total += pulls;
+    worst = MAX (worst, pulls);
+
+    gst_element_get_state (pipeline, NULL, NULL, GST_CLOCK_TIME_NONE);
+  }
+
+  g_print ("%s: %.1f scans per seek (worst %u), %.3f ms per seek\n", name,
+      (gdouble) total / N_SEEKS, worst, elapsed / 1000.0 / N_SEEKS);
+}
+
+int
+main (int argc, char **argv)
+{
+  GstClockTime positions[N_SEEKS], duration;
+  GstElement *pipeline, *src;
+  GstPad *pad;
+  gchar *filename, *desc;
+  guint64 size = DEFAULT_SIZE;
+  GRand *rand;
+  guint i;
+
+  gst_init (&argc, &argv);
+
+  if (argc > 1)
+    size = g_ascii_strtoull (argv[1], NULL, 10);
+  if (size == 0) {
+    g_printerr ("Usage: %s [size in MB]\n", argv[0]);
+    return 1;
+  }
+
+  filename = g_build_filename (g_get_tmp_dir (), "psdemuxseek.mpg", NULL);
+  if (!write_stream (filename, size * 1024 * 1024, &duration)) {
+    g_printerr ("Failed writing %s\n", filename);
+    return 1;
+  }
+
+  desc = g_strdup_printf ("filesrc name=src location=\"%s\" ! "
+      "mpegpsdemux name=demux demux. ! fakesink", filename);
+  pipeline = gst_parse_launch (desc, NULL);
+  g_free (desc);
+  if (!pipeline) {
+    g_printerr ("Failed creating the pipeline\n");
+    return 1;
+  }
+
+  src = gst_bin_get_by_name (GST_BIN (pipeline), "src");
+  pad = gst_element_get_static_pad (src, "src");
+  gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_PULL | GST_PAD_PROBE_TYPE_BUFFER,
+      pull_probe, NULL, NULL);
+  gst_object_unref (pad);
+  gst_object_unref (src);
+
+  gst_element_set_state (pipeline, GST_STATE_PAUSED);
+  if (gst_element_get_state (pipeline, NULL, NULL,
+          GST_CLOCK_TIME_NONE) != GST_STATE_CHANGE_SUCCESS) {
+    g_printerr ("Failed prerolling the pipeline\n");
+    return 1;
+  }
+
+  rand = g_rand_new_with_seed (SEED);
+  for (i = 0; i < N_SEEKS; i++)
+    positions[i] = gst_util_uint64_scale (g_rand_double (rand) * 1000000,
+        duration, 1000000);
+  g_rand_free (rand);
+
+  g_print ("%" G_GUINT64_FORMAT " MB, %" GST_TIME_FORMAT ", %d seeks\n",
+      size, GST_TIME_ARGS (duration), N_SEEKS);
+
+  seek_thread = g_thread_self ();
+  run_seeks (pipeline, positions, "first seeks");
+  run_seeks (pipeline, positions, "same seeks again");
+
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_object_unref (pipeline);
+
+  g_unlink (filename);
+  g_free (filename);
+
+  return 0;
+}
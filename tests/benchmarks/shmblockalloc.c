@@ -0,0 +1,176 @@
+/* GStreamer
+ *
+ * shmblockalloc.c: benchmark of the shm transport block allocator
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* Replays the allocation pattern of shmsink for several streams: every
+ * operation releases a block that was in flight, allocates a new one and
+ * looks it up by offset like sp_writer_send_buf() does. Blocks are
+ * released in order when there is a single reader and out of order when
+ * several readers ack at different times.
+ *
+ * Prints the time per operation, the allocations that did not fit and
+ * the average fragmentation of the free space, 1 - largest free extent /
+ * free size. */
+
+#include <stdlib.h>
+#include <glib.h>
+
+#include "shmalloc.h"
+
+#define DEFAULT_N_OPS 1000000
+#define SAMPLE_INTERVAL 1024
+
+typedef struct
+{
+  const gchar *name;
+  gsize area_size;
+  guint in_flight;
+  gboolean out_of_order;
+  gulong (*next_size) (GRand * rand);
+} Scenario;
+
+/* 1024 samples of S16 stereo, and a few odd sized ones from resampling */
+static gulong
+audio_size (GRand * rand)
+{
+  if (g_rand_int_range (rand, 0, 8) == 0)
+    return g_rand_int_range (rand, 1000, 1024) * 4;
+  return 4096;
+}
+
+/* Audio interleaved with small metadata buffers */
+static gulong
+audio_metadata_size (GRand * rand)
+{
+  if (g_rand_boolean (rand))
+    return g_rand_int_range (rand, 16, 256);
+  return audio_size (rand);
+}
+
+/* Raw 1080p I420 frames muxed with audio */
+static gulong
+video_audio_size (GRand * rand)
+{
+  if (g_rand_int_range (rand, 0, 4) == 0)
+    return 1920 * 1080 * 3 / 2;
+  return audio_size (rand);
+}
+
+/* Compressed frames, sizes spread from 64 bytes to 64 kB */
+static gulong
+compressed_size (GRand * rand)
+{
+  return 1UL << g_rand_int_range (rand, 6, 16) |
+      g_rand_int_range (rand, 0, 64);
+}
+
+static const Scenario scenarios[] = {
+  {"audio", 256 * 1024 * 4, 200, FALSE, audio_size},
+  {"audio+metadata", 256 * 1024 * 4, 400, FALSE, audio_metadata_size},
+  {"video+audio", 32 * 1024 * 1024, 24, FALSE, video_audio_size},
+  {"compressed, 1 reader", 16 * 1024 * 1024, 1000, FALSE, compressed_size},
+  {"compressed, 4 readers", 16 * 1024 * 1024, 1000, TRUE, compressed_size},
+};
+
+static void
+run_scenario (const Scenario * scenario, guint n_ops)
+{
+  ShmAllocSpace *space;
+  ShmAllocBlock **blocks;
+  ShmAllocStats stats;
+  GRand *rand;
+  gint64 start, elapsed;
+  gdouble fragmentation = 0;
+  guint n_samples = 0, failures = 0, i;
+
+  space = shm_alloc_space_new (scenario->area_size);
+  blocks = g_new0 (ShmAllocBlock *, scenario->in_flight);
+  rand = g_rand_new_with_seed (42);
+
+  start = g_get_monotonic_time ();
+  for (i = 0; i < n_ops; i++) {
+    ShmAllocBlock *block;
+    gulong size;
+    guint slot;
+
+    if (scenario->out_of_order)
+      slot = g_rand_int_range (rand, 0, scenario->in_flight);
+    else
+      slot = i % scenario->in_flight;
+
+    if (blocks[slot])
+      shm_alloc_space_block_dec (blocks[slot]);
+
+    size = scenario->next_size (rand);
+    block = shm_alloc_space_alloc_block (space, size);
+    if (block) {
+      gulong offset = shm_alloc_space_alloc_block_get_offset (block);
+
+      if (shm_alloc_space_block_get (space, offset + size / 2) != block)
+        g_error ("Block at offset %lu not found", offset);
+    } else {
+      failures++;
+    }
+    blocks[slot] = block;
+
+    if (i % SAMPLE_INTERVAL == 0) {
+      shm_alloc_space_get_stats (space, &stats);
+      if (stats.free_size > 0) {
+        fragmentation += 1.0 - (gdouble) stats.largest_free / stats.free_size;
+        n_samples++;
+      }
+    }
+  }
+  elapsed = g_get_monotonic_time () - start;
+
+  shm_alloc_space_get_stats (space, &stats);
+  g_print ("%-24s %8.1f ns/op %8u failed %6.1f%% fragmented, "
+      "%lu blocks in %lu free extents at the end\n", scenario->name,
+      (gdouble) elapsed * 1000 / n_ops, failures,
+      n_samples ? 100 * fragmentation / n_samples : 0.0, stats.n_blocks,
+      stats.n_free_extents);
+
+  for (i = 0; i < scenario->in_flight; i++) {
+    if (blocks[i])
+      shm_alloc_space_block_dec (blocks[i]);
+  }
+  shm_alloc_space_free (space);
+
+  g_rand_free (rand);
+  g_free (blocks);
+}
+
+int
+main (int argc, char **argv)
+{
+  gint n_ops = DEFAULT_N_OPS;
+  guint i;
+
+  if (argc > 1)
+    n_ops = atoi (argv[1]);
+  if (n_ops <= 0) {
+    g_printerr ("Usage: %s [n-operations]\n", argv[0]);
+    return 1;
+  }
+
+  for (i = 0; i < G_N_ELEMENTS (scenarios); i++)
+    run_scenario (&scenarios[i], n_ops);
+
+  return 0;
+}
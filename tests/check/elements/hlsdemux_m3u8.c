@@ -0,0 +1,155 @@
+/* GStreamer unit test for the HLS m3u8 playlist parser
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <gst/check/gstcheck.h>
+
+#include "m3u8.c"
+
+GST_DEBUG_CATEGORY (fragmented_debug);
+
+static const gchar *LIVE_PLAYLIST_1 = "#EXTM3U\n"
+    "#EXT-X-TARGETDURATION:10\n"
+    "#EXT-X-MEDIA-SEQUENCE:5\n"
+    "#EXTINF:10,first\r\n"
+    "seg5.ts\r\n"
+    "#EXTINF:10,second\n"
+    "seg6.ts\n"
+    "#EXTINF:10,\n"
+    "http://other.example.com/seg7.ts\n";
+
+/* one file left the window, two were added, one after a discontinuity */
+static const gchar *LIVE_PLAYLIST_2 = "#EXTM3U\n"
+    "#EXT-X-TARGETDURATION:10\n"
+    "#EXT-X-MEDIA-SEQUENCE:6\n"
+    "#EXTINF:10,second\n"
+    "seg6.ts\n"
+    "#EXTINF:10,\n"
+    "http://other.example.com/seg7.ts\n"
+    "#EXT-X-DISCONTINUITY\n"
+    "#EXTINF:9,third\n"
+    "seg8.ts\n"
+    "#EXTINF:8,fourth\n"
+    "sub/seg9.ts";
+
+/* the file with sequence 8 was replaced */
+static const gchar *LIVE_PLAYLIST_3 = "#EXTM3U\n"
+    "#EXT-X-TARGETDURATION:10\n"
+    "#EXT-X-MEDIA-SEQUENCE:7\n"
+    "#EXTINF:10,\n"
+    "http://other.example.com/seg7.ts\n"
+    "#EXTINF:9,third\n"
+    "other.ts\n"
+    "#EXTINF:8,fourth\n"
+    "sub/seg9.ts\n";
+
+static GstM3U8MediaFile *
+get_file (GstM3U8Client * client, guint n)
+{
+  GList *l = g_list_nth (client->current->files, n);
+
+  fail_unless (l != NULL);
+  return GST_M3U8_MEDIA_FILE (l->data);
+}
+
+GST_START_TEST (test_live_playlist_update)
+{
+  GstM3U8Client *client;
+  GstM3U8MediaFile *file6, *file7, *file9;
+
+  client = gst_m3u8_client_new ("http://example.com/live/playlist.m3u8");
+
+  fail_unless (gst_m3u8_client_update (client, g_strdup (LIVE_PLAYLIST_1)));
+  assert_equals_int (g_list_length (client->current->files), 3);
+  assert_equals_string (get_file (client, 0)->uri,
+      "http://example.com/live/seg5.ts");
+  assert_equals_string (get_file (client, 0)->title, "first");
+  assert_equals_int (get_file (client, 0)->sequence, 5);
+  assert_equals_string (get_file (client, 2)->uri,
+      "http://other.example.com/seg7.ts");
+  fail_unless (get_file (client, 2)->title == NULL);
+  file6 = get_file (client, 1);
+  file7 = get_file (client, 2);
+
+  /* the playlist data is kept intact to detect unchanged updates */
+  fail_if (gst_m3u8_client_update (client, g_strdup (LIVE_PLAYLIST_1)));
+
+  fail_unless (gst_m3u8_client_update (client, g_strdup (LIVE_PLAYLIST_2)));
+  assert_equals_int (g_list_length (client->current->files), 4);
+  fail_unless (get_file (client, 0) == file6);
+  fail_unless (get_file (client, 1) == file7);
+  assert_equals_int (get_file (client, 2)->sequence, 8);
+  assert_equals_string (get_file (client, 2)->uri,
+      "http://example.com/live/seg8.ts");
+  assert_equals_string (get_file (client, 2)->title, "third");
+  assert_equals_uint64 (get_file (client, 2)->duration, 9 * GST_SECOND);
+  assert_equals_int (get_file (client, 3)->sequence, 9);
+  assert_equals_string (get_file (client, 3)->uri,
+      "http://example.com/live/sub/seg9.ts");
+  file9 = get_file (client, 3);
+
+  fail_unless (gst_m3u8_client_update (client, g_strdup (LIVE_PLAYLIST_3)));
+  assert_equals_int (g_list_length (client->current->files), 3);
+  fail_unless (get_file (client, 0) == file7);
+  assert_equals_int (get_file (client, 1)->sequence, 8);
+  assert_equals_string (get_file (client, 1)->uri,
+      "http://example.com/live/other.ts");
+  fail_unless (get_file (client, 2) == file9);
+
+  gst_m3u8_client_free (client);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_resolved_uri_is_equal)
+{
+  GstM3U8 *m3u8 = gst_m3u8_new ();
+
+  gst_m3u8_set_uri (m3u8, g_strdup ("http://example.com/live/playlist.m3u8"));
+
+  fail_unless (gst_m3u8_uri_is_equal (m3u8,
+          "http://example.com/live/seg.ts", "seg.ts", 6));
+  fail_unless (gst_m3u8_uri_is_equal (m3u8,
+          "http://other.example.com/seg.ts",
+          "http://other.example.com/seg.ts", 31));
+  /* an absolute URI only ending with the relative one is another file */
+  fail_if (gst_m3u8_uri_is_equal (m3u8,
+          "http://other.example.com/live/seg.ts", "seg.ts", 6));
+  fail_if (gst_m3u8_uri_is_equal (m3u8,
+          "http://example.com/live/xseg.ts", "seg.ts", 6));
+
+  gst_m3u8_free (m3u8);
+}
+
+GST_END_TEST;
+
+static Suite *
+hlsdemux_m3u8_suite (void)
+{
+  Suite *s = suite_create ("hlsdemux_m3u8");
+  TCase *tc_m3u8 = tcase_create ("m3u8client");
+
+  GST_DEBUG_CATEGORY_INIT (fragmented_debug, "fragmented", 0, "fragmented");
+
+  suite_add_tcase (s, tc_m3u8);
+  tcase_add_test (tc_m3u8, test_live_playlist_update);
+  tcase_add_test (tc_m3u8, test_resolved_uri_is_equal);
+
+  return s;
+}
+
+GST_CHECK_MAIN (hlsdemux_m3u8);
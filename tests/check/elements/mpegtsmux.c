@@ -336,6 +336,63 @@ GST_START_TEST (test_audio)
 GST_END_TEST;
 
 
+GST_START_TEST (test_aligned_output)
+{
+  GstElement *mux;
+  GstBuffer *inbuffer, *outbuffer;
+  GstCaps *caps;
+  GstSegment segment;
+  GstMapInfo map;
+  gchar *padname;
+  GList *l;
+  guint null_packets = 0;
+
+  mux = setup_tsmux (&video_src_template, "sink_%d", &padname);
+  g_object_set (mux, "alignment", 7, NULL);
+  fail_unless (gst_element_set_state (mux,
+          GST_STATE_PLAYING) == GST_STATE_CHANGE_SUCCESS,
+      "could not set to playing");
+
+  gst_segment_init (&segment, GST_FORMAT_TIME);
+  fail_unless (gst_pad_push_event (mysrcpad, gst_event_new_segment (&segment)));
+
+  caps = gst_caps_from_string (VIDEO_CAPS_STRING);
+  gst_pad_set_caps (mysrcpad, caps);
+  gst_caps_unref (caps);
+
+  inbuffer = gst_buffer_new_and_alloc (1);
+  GST_BUFFER_TIMESTAMP (inbuffer) = 0;
+  fail_unless (gst_pad_push (mysrcpad, inbuffer) == GST_FLOW_OK);
+  fail_unless (gst_pad_push_event (mysrcpad, gst_event_new_eos ()));
+
+  /* PAT, PMT and one PES packet fit in a single block, padded on EOS */
+  fail_unless (g_list_length (buffers) >= 1);
+  for (l = buffers; l; l = l->next) {
+    guint8 *data;
+    gsize size;
+
+    outbuffer = GST_BUFFER (l->data);
+    fail_unless_equals_int (gst_buffer_get_size (outbuffer), 7 * 188);
+
+    gst_buffer_map (outbuffer, &map, GST_MAP_READ);
+    for (data = map.data, size = map.size; size; data += 188, size -= 188) {
+      fail_unless (data[0] == 0x47);
+      if ((GST_READ_UINT16_BE (data + 1) & 0x1FFF) == 0x1FFF)
+        null_packets++;
+    }
+    gst_buffer_unmap (outbuffer, &map);
+  }
+  fail_unless (null_packets > 0);
+
+  gst_check_drop_buffers ();
+
+  cleanup_tsmux (mux, padname);
+  g_free (padname);
+}
+
+GST_END_TEST;
+
+
 typedef struct _TestData
 {
   GstEvent *sink_event;
@@ -630,6 +687,7 @@ mpegtsmux_suite (void)
 
   tcase_add_test (tc_chain, test_audio);
   tcase_add_test (tc_chain, test_video);
+  tcase_add_test (tc_chain, test_aligned_output);
   tcase_add_test (tc_chain, test_force_key_unit_event_downstream);
   tcase_add_test (tc_chain, test_force_key_unit_event_upstream);
 